@@ -0,0 +1,648 @@
+/*
+  content-scan.c - rename the resources of a content stream without flex
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "content-scan.h"
+#include "rename-lexer.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CONTENT_SCAN_X86
+#include <immintrin.h>
+#endif
+
+/* the bytes a search stops at */
+#define BYTE_SET_MAX 8
+struct byte_set
+{
+	unsigned char member[256];
+	unsigned char chars[BYTE_SET_MAX];
+	int count;
+};
+
+/* returns the first byte of [p, end) that is in set or end */
+typedef const unsigned char *(*find_func)(const unsigned char *p, 
+	const unsigned char *end, const struct byte_set *set);
+
+struct scan_level
+{
+	char is_dict; // else it's an array
+	char expect_key;
+};
+
+struct scan
+{
+	fz_context *ctx;
+	fz_output *output;
+	const struct rename_table *renames;
+	find_func find;
+
+	const unsigned char *end;
+	const unsigned char *written; // everything in front of it has been written
+
+	/* the open dicts and arrays */
+	struct scan_level *levels;
+	size_t levels_used;
+	size_t levels_cap;
+};
+
+static struct byte_set content_set; // the bytes that start something in a content stream
+static struct byte_set string_set; // the bytes that matter in a literal string
+static struct byte_set hex_end_set;
+static struct byte_set ei_set;
+
+static int selected_backend = -1;
+static find_func selected_find;
+
+static void make_set(struct byte_set *set, const char *chars)
+{
+	memset(set, 0, sizeof(struct byte_set));
+	for(; *chars != '\0' && set->count < BYTE_SET_MAX; chars++) {
+		set->member[(unsigned char) *chars] = 1;
+		set->chars[set->count++] = *chars;
+	}
+}
+
+static const unsigned char *find_scalar(const unsigned char *p, 
+	const unsigned char *end, const struct byte_set *set)
+{
+	while(p < end && !set->member[*p])
+		p++;
+	return(p);
+}
+
+#ifdef CONTENT_SCAN_X86
+__attribute__((target("sse2")))
+static const unsigned char *find_sse2(const unsigned char *p, 
+	const unsigned char *end, const struct byte_set *set)
+{
+	__m128i chars[BYTE_SET_MAX];
+	int i;
+	for(i = 0; i < set->count; i++)
+		chars[i] = _mm_set1_epi8(set->chars[i]);
+
+	while(end - p >= 16) {
+		__m128i block = _mm_loadu_si128((const __m128i *) p);
+		__m128i found = _mm_cmpeq_epi8(block, chars[0]);
+		for(i = 1; i < set->count; i++)
+			found = _mm_or_si128(found, _mm_cmpeq_epi8(block, chars[i]));
+
+		int mask = _mm_movemask_epi8(found);
+		if(mask != 0)
+			return(p + __builtin_ctz(mask));
+		p += 16;
+	}
+
+	return(find_scalar(p, end, set));
+}
+
+__attribute__((target("avx2")))
+static const unsigned char *find_avx2(const unsigned char *p, 
+	const unsigned char *end, const struct byte_set *set)
+{
+	__m256i chars[BYTE_SET_MAX];
+	int i;
+	for(i = 0; i < set->count; i++)
+		chars[i] = _mm256_set1_epi8(set->chars[i]);
+
+	while(end - p >= 32) {
+		__m256i block = _mm256_loadu_si256((const __m256i *) p);
+		__m256i found = _mm256_cmpeq_epi8(block, chars[0]);
+		for(i = 1; i < set->count; i++)
+			found = _mm256_or_si256(found, _mm256_cmpeq_epi8(block, chars[i]));
+
+		unsigned int mask = _mm256_movemask_epi8(found);
+		if(mask != 0)
+			return(p + __builtin_ctz(mask));
+		p += 32;
+	}
+
+	return(find_sse2(p, end, set));
+}
+#endif
+
+int content_scan_set_backend(int backend)
+{
+	if(content_set.count == 0) {
+		make_set(&content_set, "/(<%B");
+		make_set(&string_set, "()\\");
+		make_set(&hex_end_set, ">");
+		make_set(&ei_set, "E");
+	}
+
+#ifdef CONTENT_SCAN_X86
+	__builtin_cpu_init();
+	if(backend == CONTENT_SCAN_AUTO || backend == CONTENT_SCAN_AVX2)
+		backend = (__builtin_cpu_supports("avx2") ? CONTENT_SCAN_AVX2 : CONTENT_SCAN_SSE2);
+	if(backend == CONTENT_SCAN_SSE2 && !__builtin_cpu_supports("sse2"))
+		backend = CONTENT_SCAN_SCALAR;
+#else
+	if(backend != CONTENT_SCAN_FLEX)
+		backend = CONTENT_SCAN_SCALAR;
+#endif
+
+	switch(backend) {
+#ifdef CONTENT_SCAN_X86
+	case CONTENT_SCAN_AVX2:
+		selected_find = find_avx2;
+		break;
+	case CONTENT_SCAN_SSE2:
+		selected_find = find_sse2;
+		break;
+#endif
+	case CONTENT_SCAN_FLEX:
+		selected_find = NULL;
+		break;
+	default:
+		backend = CONTENT_SCAN_SCALAR;
+		selected_find = find_scalar;
+		break;
+	}
+
+	selected_backend = backend;
+	return(backend);
+}
+
+int content_scan_get_backend()
+{
+	if(selected_backend < 0)
+		content_scan_set_backend(CONTENT_SCAN_DEFAULT);
+
+	return(selected_backend);
+}
+
+static int is_white(unsigned char c)
+{
+	return(c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' || c == '\0');
+}
+
+/* regular characters are those of names, numbers and operators */
+static int is_regular(unsigned char c)
+{
+	return(!is_white(c) && strchr("()<>[]{}/%", c) == NULL);
+}
+
+static const unsigned char *skip_regular(const unsigned char *p, 
+	const unsigned char *end)
+{
+	while(p < end && is_regular(*p))
+		p++;
+	return(p);
+}
+
+static void write_up_to(struct scan *scan, const unsigned char *p)
+{
+	if(p > scan->written) {
+		fz_write(scan->ctx, scan->output, scan->written, p - scan->written);
+		scan->written = p;
+	}
+}
+
+/* p points to the / of the name; returns what's behind the name */
+static const unsigned char *scan_name(struct scan *scan, 
+	const unsigned char *p, int rename)
+{
+	const unsigned char *name_end = skip_regular(p + 1, scan->end);
+	size_t len = name_end - (p + 1);
+	if(!rename || len == 0)
+		return(name_end);
+
+	size_t new_len;
+	const char *new_name = rename_table_lookup(scan->renames, 
+		(const char *) p + 1, len, &new_len);
+	if(new_name == NULL) {
+		printf("Rename of /%.*s failed! It will be preserved\n", (int) len, p + 1);
+	} else {
+		write_up_to(scan, p);
+		fz_write(scan->ctx, scan->output, new_name, new_len);
+		scan->written = name_end;
+	}
+
+	return(name_end);
+}
+
+/* p points to the ( */
+static const unsigned char *skip_literal_string(struct scan *scan, 
+	const unsigned char *p)
+{
+	int brackets = 1;
+
+	for(p++; ; p++) {
+		p = scan->find(p, scan->end, &string_set);
+		if(p >= scan->end)
+			return(scan->end);
+
+		if(*p == '\\')
+			p++; // whatever is escaped doesn't count
+		else if(*p == '(')
+			brackets++;
+		else if(--brackets == 0)
+			return(p + 1);
+	}
+}
+
+static const unsigned char *skip_hex_string(struct scan *scan, 
+	const unsigned char *p)
+{
+	p = scan->find(p + 1, scan->end, &hex_end_set);
+	return(p < scan->end ? p + 1 : p);
+}
+
+static const unsigned char *skip_comment(struct scan *scan, 
+	const unsigned char *p)
+{
+	while(p < scan->end && *p != '\n' && *p != '\r')
+		p++;
+	return(p);
+}
+
+static void push_level(struct scan *scan, int is_dict)
+{
+	if(scan->levels_used == scan->levels_cap) {
+		scan->levels_cap = (scan->levels_cap == 0 ? 16 : scan->levels_cap * 2);
+		scan->levels = realloc(scan->levels, 
+			scan->levels_cap * sizeof(struct scan_level));
+	}
+
+	scan->levels[scan->levels_used].is_dict = is_dict;
+	scan->levels[scan->levels_used].expect_key = 1;
+	scan->levels_used++;
+}
+
+/* after a value the next thing in a dict is a key */
+static void after_value(struct scan *scan)
+{
+	if(scan->levels_used > 0 && scan->levels[scan->levels_used - 1].is_dict)
+		scan->levels[scan->levels_used - 1].expect_key = 1;
+}
+
+/* p points to the << of a dict outside of any other dict; all names in it
+   except its keys are renamed (like the flex lexer does) */
+static const unsigned char *scan_dict(struct scan *scan, const unsigned char *p)
+{
+	scan->levels_used = 0;
+	push_level(scan, 1);
+	p += 2;
+
+	while(p < scan->end && scan->levels_used > 0) {
+		struct scan_level *top = &scan->levels[scan->levels_used - 1];
+		int is_key;
+
+		switch(*p) {
+		case '/':
+			is_key = top->is_dict && top->expect_key;
+			p = scan_name(scan, p, !is_key);
+			if(top->is_dict)
+				top->expect_key = !is_key;
+			break;
+		case '(':
+			p = skip_literal_string(scan, p);
+			after_value(scan);
+			break;
+		case '<':
+			if(p + 1 < scan->end && p[1] == '<') {
+				push_level(scan, 1);
+				p += 2;
+			} else {
+				p = skip_hex_string(scan, p);
+				after_value(scan);
+			}
+			break;
+		case '>':
+			if(p + 1 < scan->end && p[1] == '>') {
+				/* an unclosed array ends with its dict */
+				while(scan->levels_used > 0 && 
+					!scan->levels[--scan->levels_used].is_dict);
+				after_value(scan);
+				p += 2;
+			} else {
+				p++;
+			}
+			break;
+		case '[':
+			push_level(scan, 0);
+			p++;
+			break;
+		case ']':
+			if(!top->is_dict) {
+				scan->levels_used--;
+				after_value(scan);
+			}
+			p++;
+			break;
+		case '%':
+			p = skip_comment(scan, p);
+			break;
+		default:
+			if(is_regular(*p)) {
+				p = skip_regular(p, scan->end);
+				after_value(scan);
+			} else {
+				p++;
+			}
+			break;
+		}
+	}
+
+	return(p);
+}
+
+/* p points behind the BI; the whole image is copied unchanged */
+static const unsigned char *skip_inline_image(struct scan *scan, 
+	const unsigned char *p)
+{
+	const unsigned char *header = p;
+
+	/* the header ends with the ID operator */
+	for(;; p++) {
+		if(p + 1 >= scan->end)
+			return(scan->end);
+		if(p[0] == 'I' && p[1] == 'D' && !is_regular(p[-1]) && 
+			(p + 2 == scan->end || !is_regular(p[2])))
+		{
+			break;
+		}
+	}
+
+	/* one whitespace belongs to ID, the data starts behind it (so data
+	   that starts with EI doesn't end the image) */
+	const unsigned char *data = p + 2;
+	int separated = (data < scan->end && is_white(*data));
+	if(separated)
+		data++;
+
+	size_t length;
+	if(separated && 
+		content_scan_image_length((const char *) header, p - header, &length))
+	{
+		/* like the flex lexer, everything up to the end is data then */
+		if(length > (size_t) (scan->end - data))
+			return(scan->end);
+
+		const unsigned char *ei = data + length;
+		while(ei < scan->end && is_white(*ei))
+			ei++;
+		if(ei + 1 < scan->end && ei[0] == 'E' && ei[1] == 'I')
+			return(ei + 2);
+
+		/* the length was wrong, so search behind it */
+		data += length;
+	}
+
+	/* EI needs whitespace in front of it and must not continue */
+	for(p = data; ; p++) {
+		p = scan->find(p, scan->end, &ei_set);
+		if(p + 1 >= scan->end)
+			return(scan->end);
+		if(p > data && is_white(p[-1]) && p[1] == 'I' && 
+			(p + 2 == scan->end || !is_regular(p[2])))
+		{
+			return(p + 2);
+		}
+	}
+}
+
+static void scan_content(struct scan *scan, const unsigned char *p)
+{
+	const unsigned char *start = p;
+
+	while(p < scan->end) {
+		p = scan->find(p, scan->end, &content_set);
+		if(p >= scan->end)
+			break;
+
+		switch(*p) {
+		case '/':
+			p = scan_name(scan, p, 1);
+			break;
+		case '(':
+			p = skip_literal_string(scan, p);
+			break;
+		case '<':
+			if(p + 1 < scan->end && p[1] == '<')
+				p = scan_dict(scan, p);
+			else
+				p = skip_hex_string(scan, p);
+			break;
+		case '%':
+			p = skip_comment(scan, p);
+			break;
+		case 'B':
+			/* only the operator BI matters, not BT, BDC... */
+			if(p + 1 < scan->end && p[1] == 'I' && 
+				(p == start || !is_regular(p[-1])) && 
+				(p + 2 == scan->end || !is_regular(p[2])))
+			{
+				p = skip_inline_image(scan, p + 2);
+			} else {
+				p = skip_regular(p, scan->end);
+			}
+			break;
+		}
+	}
+}
+
+int content_scan_rename_res(fz_context *in_ctx, fz_stream *input, 
+	fz_context *out_ctx, fz_output *output, const struct rename_table *renames)
+{
+	if(content_scan_get_backend() == CONTENT_SCAN_FLEX)
+		return(rename_res_in_content_stream(in_ctx, input, out_ctx, output, renames));
+
+	/* content streams are small enough to have them in memory at once */
+	fz_buffer *buffer = fz_read_all(in_ctx, input, 0);
+
+	struct scan scan;
+	memset(&scan, 0, sizeof(struct scan));
+	scan.ctx = out_ctx;
+	scan.output = output;
+	scan.renames = renames;
+	scan.find = selected_find;
+	scan.written = buffer->data;
+	scan.end = buffer->data + buffer->len;
+
+	scan_content(&scan, buffer->data);
+	write_up_to(&scan, scan.end);
+
+	free(scan.levels);
+	fz_drop_buffer(in_ctx, buffer);
+
+	return(0);
+}
+
+/* what we need to know about an inline image to find the end of its data */
+struct inline_image
+{
+	int width;
+	int height;
+	int bpc;
+	int components; // -1 if unknown (e. g. a named color space)
+	int filtered;
+	int image_mask;
+	int length; // /L of PDF 2.0, -1 if not given
+};
+
+static const char *skip_whitespace(const char *p)
+{
+	while(*p != '\0' && is_white(*p))
+		p++;
+	return(p);
+}
+
+static int is_delimiter(char c)
+{
+	return(c == '\0' || !is_regular(c));
+}
+
+/* copies the name (without /) at p to name and returns what's behind it */
+static const char *read_name(const char *p, char *name, size_t size)
+{
+	size_t len = 0;
+	for(p++; !is_delimiter(*p); p++) {
+		if(len + 1 < size)
+			name[len++] = *p;
+	}
+	name[len] = '\0';
+
+	return(p);
+}
+
+static int components_of(const char *color_space)
+{
+	if(!strcmp(color_space, "G") || !strcmp(color_space, "DeviceGray") || 
+		!strcmp(color_space, "CalGray") || !strcmp(color_space, "I") || 
+		!strcmp(color_space, "Indexed"))
+	{
+		return(1);
+	} else if(!strcmp(color_space, "RGB") || !strcmp(color_space, "DeviceRGB") || 
+		!strcmp(color_space, "CalRGB"))
+	{
+		return(3);
+	} else if(!strcmp(color_space, "CMYK") || !strcmp(color_space, "DeviceCMYK")) {
+		return(4);
+	}
+
+	return(-1);
+}
+
+/* skips one value of the header, but remembers a name or the first name of 
+   an array in name */
+static const char *read_value(const char *p, char *name, size_t size, int *number)
+{
+	name[0] = '\0';
+	*number = 0;
+
+	p = skip_whitespace(p);
+	if(*p == '/') {
+		return(read_name(p, name, size));
+	} else if(*p == '[' || (*p == '<' && p[1] == '<')) {
+		/* arrays and dicts (DecodeParms) may be nested */
+		int level = 0;
+		do {
+			if(*p == '[' || (*p == '<' && p[1] == '<')) {
+				level++;
+				p += (*p == '[' ? 1 : 2);
+			} else if(*p == ']' || (*p == '>' && p[1] == '>')) {
+				level--;
+				p += (*p == ']' ? 1 : 2);
+			} else if(*p == '/' && name[0] == '\0') {
+				p = read_name(p, name, size);
+			} else {
+				p++;
+			}
+		} while(level > 0 && *p != '\0');
+		return(p);
+	}
+
+	const char *start = p;
+	while(!is_delimiter(*p))
+		p++;
+	if(p - start == 4 && !strncmp(start, "true", 4))
+		*number = 1;
+	else
+		*number = atoi(start);
+
+	return(p);
+}
+
+static void parse_image_header(const char *p, struct inline_image *image)
+{
+	char key[32];
+	char name[32];
+	int number;
+
+	memset(image, 0, sizeof(struct inline_image));
+	image->components = -1;
+	image->length = -1;
+
+	while(*(p = skip_whitespace(p)) == '/') {
+		p = read_name(p, key, sizeof(key));
+		p = read_value(p, name, sizeof(name), &number);
+
+		if(!strcmp(key, "W") || !strcmp(key, "Width"))
+			image->width = number;
+		else if(!strcmp(key, "H") || !strcmp(key, "Height"))
+			image->height = number;
+		else if(!strcmp(key, "BPC") || !strcmp(key, "BitsPerComponent"))
+			image->bpc = number;
+		else if(!strcmp(key, "CS") || !strcmp(key, "ColorSpace"))
+			image->components = components_of(name);
+		else if(!strcmp(key, "F") || !strcmp(key, "Filter"))
+			image->filtered = 1;
+		else if(!strcmp(key, "IM") || !strcmp(key, "ImageMask"))
+			image->image_mask = number;
+		else if(!strcmp(key, "L") || !strcmp(key, "Length"))
+			image->length = number;
+	}
+}
+
+int content_scan_image_length(const char *header, size_t header_len, 
+	size_t *length)
+{
+	if(header_len == 0)
+		return(0);
+
+	char *text = malloc(header_len + 1);
+	memcpy(text, header, header_len);
+	text[header_len] = '\0';
+
+	struct inline_image image;
+	parse_image_header(text, &image);
+	free(text);
+
+	if(image.length >= 0) {
+		*length = image.length;
+		return(1);
+	}
+
+	/* the size of filtered data is only known after decoding it */
+	if(image.filtered)
+		return(0);
+	if(image.image_mask) {
+		image.components = 1;
+		image.bpc = 1;
+	}
+	if(image.components < 0 || image.bpc <= 0 || 
+		image.width <= 0 || image.height < 0)
+	{
+		return(0);
+	}
+
+	size_t row = ((size_t) image.width * image.components * image.bpc + 7) / 8;
+	*length = row * image.height;
+
+	return(1);
+}
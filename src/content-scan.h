@@ -0,0 +1,62 @@
+/*
+  content-scan.h - rename the resources of a content stream without flex
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _JUGGLER_CONTENT_SCAN_H_
+#define _JUGGLER_CONTENT_SCAN_H_
+
+#include <mupdf/fitz.h>
+#include <mupdf/pdf.h>
+
+#include "rename-table.h"
+
+/* the tokenizer of this module does the same as the flex lexer, but it 
+   looks for the few bytes that matter (/, (, < ...) 16 or 32 bytes at a 
+   time and copies everything between them in one go */
+
+/* the backends to rename the resources of a content stream */
+#define CONTENT_SCAN_FLEX 0 // the lexer of rename-lexer.l
+#define CONTENT_SCAN_SCALAR 1 // the tokenizer, one byte at a time
+#define CONTENT_SCAN_SSE2 2 // the tokenizer, 16 bytes at a time
+#define CONTENT_SCAN_AVX2 3 // the tokenizer, 32 bytes at a time
+#define CONTENT_SCAN_AUTO 4 // the fastest tokenizer this cpu supports
+
+/* the backend until content_scan_set_backend() is called; the tokenizer 
+   only becomes the default of a build after "make test" has passed against
+   the real lexer, see CONTENT_SCAN in the Makefile */
+#ifndef CONTENT_SCAN_DEFAULT
+#define CONTENT_SCAN_DEFAULT CONTENT_SCAN_FLEX
+#endif
+
+/* returns the backend that is really used, as SSE2 and AVX2 fall back to 
+   what the cpu supports */
+extern int content_scan_set_backend(int backend);
+
+extern int content_scan_get_backend();
+
+/* copies input to output, but renames all resources as renames says, by 
+   the selected backend */
+extern int content_scan_rename_res(fz_context *in_ctx, fz_stream *input, 
+	fz_context *out_ctx, fz_output *output, const struct rename_table *renames);
+
+/* returns 1 and sets length if the length of an inline image's data can be
+   computed from its header (the text between BI and ID) */
+extern int content_scan_image_length(const char *header, size_t header_len, 
+	size_t *length);
+
+#endif /* _JUGGLER_CONTENT_SCAN_H_ */
@@ -0,0 +1,480 @@
+/*
+  copy-dedup.c - find objects that already have been copied to a document
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "copy-dedup.h"
+
+#define COPY_DEDUP_MIN_CAP 256
+
+struct dedup_entry
+{
+	copy_fingerprint_t fingerprint;
+	int dest_num; // 0 if unused
+};
+
+struct copy_dedup
+{
+	/* open-addressing hash table, at most half full */
+	struct dedup_entry *entries;
+	size_t cap;
+	size_t used;
+
+	copy_dedup_stats_t stats;
+};
+
+/* NEW: loaded, but not hashed yet */
+enum { FINGERPRINT_NEW, FINGERPRINT_HASHING, FINGERPRINT_DONE, FINGERPRINT_NONE };
+
+struct fingerprint_memo
+{
+	pdf_obj *obj; // NULL if it has not been loaded
+	int is_stream;
+	int excluded;
+	int data_hashed;
+	copy_fingerprint_t data; // the hash of the raw stream data
+
+	copy_fingerprint_t fingerprint;
+	size_t stream_length;
+	int state;
+};
+
+struct copy_fingerprints
+{
+	fz_context *ctx;
+	struct copy_map *new_ids;
+	int xref_len;
+	int prepared; // the annotations have been excluded
+
+	/* source number -> index in memos + 1 */
+	struct copy_map *index;
+	struct fingerprint_memo *memos;
+	size_t count;
+	size_t cap;
+};
+
+/* two independent 64 bit hashes: FNV-1a and a multiply-xorshift one */
+static void hash_init(copy_fingerprint_t *hash)
+{
+	hash->a = 14695981039346656037ULL;
+	hash->b = 0x9e3779b97f4a7c15ULL;
+}
+
+static void hash_bytes(copy_fingerprint_t *hash, const void *data, size_t len)
+{
+	const unsigned char *bytes = data;
+
+	size_t i;
+	for(i = 0; i < len; i++) {
+		hash->a = (hash->a ^ bytes[i]) * 1099511628211ULL;
+		hash->b = (hash->b ^ bytes[i]) * 0xff51afd7ed558ccdULL;
+		hash->b ^= hash->b >> 29;
+	}
+}
+
+static void hash_int(copy_fingerprint_t *hash, int64_t value)
+{
+	hash_bytes(hash, &value, sizeof(value));
+}
+
+static void hash_tag(copy_fingerprint_t *hash, char tag)
+{
+	hash_bytes(hash, &tag, 1);
+}
+
+struct copy_dedup *copy_dedup_new(void)
+{
+	struct copy_dedup *dedup = calloc(1, sizeof(struct copy_dedup));
+	dedup->cap = COPY_DEDUP_MIN_CAP;
+	dedup->entries = calloc(dedup->cap, sizeof(struct dedup_entry));
+
+	return(dedup);
+}
+
+void copy_dedup_delete(struct copy_dedup *dedup)
+{
+	free(dedup->entries);
+	free(dedup);
+}
+
+static struct dedup_entry *find_entry(struct dedup_entry *entries, size_t cap, 
+	const copy_fingerprint_t *fingerprint)
+{
+	size_t i = (size_t) fingerprint->a & (cap - 1);
+	while(entries[i].dest_num != 0 && 
+		(entries[i].fingerprint.a != fingerprint->a || 
+		 entries[i].fingerprint.b != fingerprint->b))
+	{
+		i = (i + 1) & (cap - 1);
+	}
+
+	return(&entries[i]);
+}
+
+int copy_dedup_lookup(struct copy_dedup *dedup, 
+	const copy_fingerprint_t *fingerprint, size_t stream_length)
+{
+	dedup->stats.lookups++;
+
+	struct dedup_entry *entry = 
+		find_entry(dedup->entries, dedup->cap, fingerprint);
+	if(entry->dest_num != 0) {
+		dedup->stats.hits++;
+		dedup->stats.bytes_saved += stream_length;
+	}
+
+	return(entry->dest_num);
+}
+
+void copy_dedup_insert(struct copy_dedup *dedup, 
+	const copy_fingerprint_t *fingerprint, int dest_num)
+{
+	if((dedup->used + 1) * 2 > dedup->cap) {
+		size_t new_cap = dedup->cap * 2;
+		struct dedup_entry *entries = 
+			calloc(new_cap, sizeof(struct dedup_entry));
+
+		size_t i;
+		for(i = 0; i < dedup->cap; i++) {
+			if(dedup->entries[i].dest_num != 0) {
+				*find_entry(entries, new_cap, &dedup->entries[i].fingerprint) = 
+					dedup->entries[i];
+			}
+		}
+
+		free(dedup->entries);
+		dedup->entries = entries;
+		dedup->cap = new_cap;
+	}
+
+	struct dedup_entry *entry = 
+		find_entry(dedup->entries, dedup->cap, fingerprint);
+	if(entry->dest_num == 0)
+		dedup->used++;
+	entry->fingerprint = *fingerprint;
+	entry->dest_num = dest_num;
+}
+
+void copy_dedup_count_reads(struct copy_dedup *dedup, 
+	size_t objects, size_t seeks, size_t bytes)
+{
+	dedup->stats.objects_read += objects;
+	dedup->stats.seeks += seeks;
+	dedup->stats.bytes_spanned += bytes;
+}
+
+void copy_dedup_get_stats(struct copy_dedup *dedup, copy_dedup_stats_t *stats)
+{
+	*stats = dedup->stats;
+}
+
+struct copy_fingerprints *copy_fingerprints_new(fz_context *ctx, 
+	pdf_document *src, struct copy_map *new_ids)
+{
+	struct copy_fingerprints *fingerprints = 
+		calloc(1, sizeof(struct copy_fingerprints));
+	fingerprints->ctx = ctx;
+	fingerprints->new_ids = new_ids;
+	fingerprints->xref_len = pdf_xref_len(ctx, src);
+	fingerprints->index = 
+		copy_map_new(fingerprints->xref_len, COPY_MAP_UNKNOWN);
+
+	return(fingerprints);
+}
+
+void copy_fingerprints_delete(struct copy_fingerprints *fingerprints)
+{
+	copy_map_delete(fingerprints->index);
+	free(fingerprints->memos);
+	free(fingerprints);
+}
+
+static struct fingerprint_memo *get_memo(struct copy_fingerprints *fingerprints,
+	int num)
+{
+	if(num <= 0 || num >= fingerprints->xref_len)
+		return(NULL);
+
+	int index = copy_map_get(fingerprints->index, num);
+	if(index != 0)
+		return(&fingerprints->memos[index - 1]);
+
+	if(fingerprints->count == fingerprints->cap) {
+		fingerprints->cap = (fingerprints->cap == 0 ? 64 : fingerprints->cap * 2);
+		fingerprints->memos = realloc(fingerprints->memos, 
+			fingerprints->cap * sizeof(struct fingerprint_memo));
+	}
+	copy_map_set(fingerprints->index, num, fingerprints->count + 1);
+
+	struct fingerprint_memo *memo = &fingerprints->memos[fingerprints->count++];
+	memset(memo, 0, sizeof(struct fingerprint_memo));
+	return(memo);
+}
+
+int copy_dedup_hash_stream(fz_context *ctx, pdf_document *doc, int num, 
+	int gen, copy_fingerprint_t *hash, size_t *stream_length)
+{
+	unsigned char chunk[COPY_DEDUP_CHUNK];
+	fz_stream *stream = NULL;
+	fz_var(stream);
+
+	hash_init(hash);
+	*stream_length = 0;
+
+	fz_try(ctx) {
+		stream = pdf_open_raw_stream(ctx, doc, num, gen);
+
+		int read;
+		while((read = fz_read(ctx, stream, chunk, sizeof(chunk))) > 0) {
+			hash_bytes(hash, chunk, read);
+			*stream_length += read;
+		}
+	} fz_always(ctx) {
+		fz_drop_stream(ctx, stream);
+	} fz_catch(ctx) {
+		return(0);
+	}
+
+	return(1);
+}
+
+void copy_fingerprints_add(struct copy_fingerprints *fingerprints, int num, 
+	pdf_obj *obj, int is_stream, size_t stream_length, 
+	const copy_fingerprint_t *data_hash)
+{
+	struct fingerprint_memo *memo = get_memo(fingerprints, num);
+	if(memo == NULL || memo->obj != NULL)
+		return;
+
+	memo->obj = obj;
+	memo->is_stream = is_stream;
+	memo->stream_length = stream_length;
+	if(data_hash != NULL) {
+		memo->data_hashed = 1;
+		memo->data = *data_hash;
+	}
+}
+
+/* the object never gets a fingerprint */
+static void exclude_num(struct copy_fingerprints *fingerprints, int num)
+{
+	struct fingerprint_memo *memo = get_memo(fingerprints, num);
+	if(memo != NULL)
+		memo->excluded = 1;
+}
+
+/* the annotations in a /Annots array; nothing is resolved, as the objects 
+   may belong to a reader's document */
+static void exclude_array_refs(struct copy_fingerprints *fingerprints, 
+	pdf_obj *array)
+{
+	fz_context *ctx = fingerprints->ctx;
+
+	int i;
+	for(i = 0; i < pdf_array_len(ctx, array); i++) {
+		pdf_obj *annot = pdf_array_get(ctx, array, i);
+		if(pdf_is_indirect(ctx, annot))
+			exclude_num(fingerprints, pdf_to_num(ctx, annot));
+	}
+}
+
+/* annotations point back to their page, so they are never shared between 
+   pages: all of them are known once the objects have been loaded */
+static void exclude_annotations(struct copy_fingerprints *fingerprints)
+{
+	fz_context *ctx = fingerprints->ctx;
+
+	size_t i;
+	for(i = 0; i < fingerprints->count; i++) {
+		pdf_obj *obj = fingerprints->memos[i].obj;
+		if(obj == NULL || !pdf_is_dict(ctx, obj))
+			continue;
+
+		if(pdf_dict_gets(ctx, obj, "P") != NULL)
+			fingerprints->memos[i].excluded = 1;
+
+		pdf_obj *annots = pdf_dict_gets(ctx, obj, "Annots");
+		if(pdf_is_indirect(ctx, annots)) {
+			struct fingerprint_memo *memo = 
+				get_memo(fingerprints, pdf_to_num(ctx, annots));
+			if(memo != NULL) {
+				memo->excluded = 1;
+				annots = memo->obj; // may be NULL, then it's not copied
+			}
+		}
+		if(annots != NULL && !pdf_is_indirect(ctx, annots))
+			exclude_array_refs(fingerprints, annots);
+	}
+
+	fingerprints->prepared = 1;
+}
+
+static int fingerprint_num(struct copy_fingerprints *fingerprints, 
+	struct copy_dedup *dedup, int num, int depth, 
+	copy_fingerprint_t *fingerprint, size_t *stream_length);
+
+/* nothing is resolved here, references are followed through the loaded 
+   objects */
+static int hash_obj(struct copy_fingerprints *fingerprints, 
+	struct copy_dedup *dedup, pdf_obj *obj, int depth, const char *skipped_key,
+	copy_fingerprint_t *hash)
+{
+	fz_context *ctx = fingerprints->ctx;
+
+	if(pdf_is_indirect(ctx, obj)) {
+		int num = pdf_to_num(ctx, obj);
+		int dest_num = (num > 0 && num < fingerprints->xref_len) ? 
+			copy_map_get(fingerprints->new_ids, num) : 0;
+		if(dest_num != 0) {
+			hash_tag(hash, 'd');
+			hash_int(hash, dest_num);
+		} else {
+			copy_fingerprint_t referenced;
+			size_t length;
+			if(!fingerprint_num(fingerprints, dedup, num, depth + 1, 
+				&referenced, &length))
+			{
+				return(0);
+			}
+			hash_tag(hash, 'r');
+			hash_bytes(hash, &referenced, sizeof(referenced));
+		}
+	} else if(pdf_is_null(ctx, obj)) {
+		hash_tag(hash, 'n');
+	} else if(pdf_is_bool(ctx, obj)) {
+		hash_tag(hash, pdf_to_bool(ctx, obj) ? 't' : 'f');
+	} else if(pdf_is_int(ctx, obj)) {
+		hash_tag(hash, 'i');
+		hash_int(hash, pdf_to_int(ctx, obj));
+	} else if(pdf_is_real(ctx, obj)) {
+		float value = pdf_to_real(ctx, obj);
+		hash_tag(hash, 'f');
+		hash_bytes(hash, &value, sizeof(value));
+	} else if(pdf_is_name(ctx, obj)) {
+		const char *name = pdf_to_name(ctx, obj);
+		hash_tag(hash, '/');
+		hash_bytes(hash, name, strlen(name) + 1);
+	} else if(pdf_is_string(ctx, obj)) {
+		hash_tag(hash, '(');
+		hash_int(hash, pdf_to_str_len(ctx, obj));
+		hash_bytes(hash, pdf_to_str_buf(ctx, obj), pdf_to_str_len(ctx, obj));
+	} else if(pdf_is_array(ctx, obj)) {
+		int len = pdf_array_len(ctx, obj);
+		hash_tag(hash, '[');
+		hash_int(hash, len);
+
+		int i;
+		for(i = 0; i < len; i++) {
+			if(!hash_obj(fingerprints, dedup, pdf_array_get(ctx, obj, i), 
+				depth, NULL, hash))
+			{
+				return(0);
+			}
+		}
+	} else if(pdf_is_dict(ctx, obj)) {
+		/* the order of the keys doesn't matter, so each entry is hashed on 
+		   its own and the results are added up */
+		copy_fingerprint_t sum = { 0, 0 };
+		int len = pdf_dict_len(ctx, obj);
+
+		int i;
+		for(i = 0; i < len; i++) {
+			const char *key = pdf_to_name(ctx, pdf_dict_get_key(ctx, obj, i));
+			if(skipped_key != NULL && !strcmp(key, skipped_key))
+				continue;
+
+			copy_fingerprint_t entry;
+			hash_init(&entry);
+			hash_bytes(&entry, key, strlen(key) + 1);
+			if(!hash_obj(fingerprints, dedup, pdf_dict_get_val(ctx, obj, i), 
+				depth, NULL, &entry))
+			{
+				return(0);
+			}
+			sum.a += entry.a;
+			sum.b += entry.b;
+		}
+
+		hash_tag(hash, '<');
+		hash_bytes(hash, &sum, sizeof(sum));
+	} else {
+		return(0);
+	}
+
+	return(1);
+}
+
+static int fingerprint_num(struct copy_fingerprints *fingerprints, 
+	struct copy_dedup *dedup, int num, int depth, 
+	copy_fingerprint_t *fingerprint, size_t *stream_length)
+{
+	if(num <= 0 || num >= fingerprints->xref_len || depth > COPY_DEDUP_MAX_DEPTH)
+		return(0);
+
+	int index = copy_map_get(fingerprints->index, num);
+	if(index == 0) // not loaded
+		return(0);
+
+	struct fingerprint_memo *memo = &fingerprints->memos[index - 1];
+	*fingerprint = memo->fingerprint;
+	*stream_length = memo->stream_length;
+	if(memo->state != FINGERPRINT_NEW)
+		return(memo->state == FINGERPRINT_DONE);
+	if(memo->obj == NULL || memo->excluded || 
+		(memo->is_stream && !memo->data_hashed))
+	{
+		memo->state = FINGERPRINT_NONE;
+		dedup->stats.unhashable++;
+		return(0);
+	}
+
+	/* if we see it again while hashing, it is part of a cycle */
+	memo->state = FINGERPRINT_HASHING;
+
+	copy_fingerprint_t hash;
+	hash_init(&hash);
+	int hashed;
+	if(memo->is_stream) {
+		/* /Length may be a reference, its value is hashed with the data */
+		hashed = hash_obj(fingerprints, dedup, memo->obj, depth, "Length", &hash);
+		hash_tag(&hash, 's');
+		hash_int(&hash, memo->stream_length);
+		hash_bytes(&hash, &memo->data, sizeof(memo->data));
+	} else {
+		hashed = hash_obj(fingerprints, dedup, memo->obj, depth, NULL, &hash);
+	}
+
+	/* hash_obj() may have moved the memos */
+	memo = &fingerprints->memos[index - 1];
+	memo->fingerprint = hash;
+	memo->state = (hashed ? FINGERPRINT_DONE : FINGERPRINT_NONE);
+	if(!hashed)
+		dedup->stats.unhashable++;
+
+	*fingerprint = hash;
+	return(hashed);
+}
+
+int copy_fingerprint_object(struct copy_fingerprints *fingerprints, 
+	struct copy_dedup *dedup, int num, 
+	copy_fingerprint_t *fingerprint, size_t *stream_length)
+{
+	if(!fingerprints->prepared)
+		exclude_annotations(fingerprints);
+
+	return(fingerprint_num(fingerprints, dedup, num, 0, 
+		fingerprint, stream_length));
+}
@@ -0,0 +1,116 @@
+/*
+  copy-dedup.h - find objects that already have been copied to a document
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JUGGLER_COPY_DEDUP_H_
+#define _JUGGLER_COPY_DEDUP_H_
+
+#include <stdint.h>
+
+#include <mupdf/fitz.h>
+#include <mupdf/pdf.h>
+
+#include "copy-map.h"
+
+/* if many files embed the same fonts or images, each of them would be copied
+   again as the object numbers differ; thus every copied object gets a 
+   fingerprint of its content and of everything it references, and objects
+   with a known fingerprint are not copied but reused */
+
+/* references this deep are not followed, the object is just copied */
+#define COPY_DEDUP_MAX_DEPTH 64
+
+/* the raw data of streams is hashed in chunks of this size */
+#define COPY_DEDUP_CHUNK (16 * 1024)
+
+typedef struct
+{
+	uint64_t a;
+	uint64_t b;
+} copy_fingerprint_t;
+
+typedef struct
+{
+	size_t lookups; // objects that got a fingerprint
+	size_t hits; // ...and were already in the destination
+	size_t unhashable; // objects in reference cycles (e. g. pages) or 
+	                   // belonging to a page (annotations, anything with /P)
+	size_t bytes_saved; // raw stream data that was not copied again
+
+	/* how the copied objects have been read from the sources */
+	size_t objects_read;
+	size_t seeks; // backwards or far forward
+	size_t bytes_spanned; // sum of the distances between the objects
+} copy_dedup_stats_t;
+
+struct copy_dedup;
+
+/* the fingerprints of the objects of one source file, only valid while it
+   is copied from */
+struct copy_fingerprints;
+
+extern struct copy_dedup *copy_dedup_new(void);
+
+extern void copy_dedup_delete(struct copy_dedup *dedup);
+
+/* returns the object in the destination that has been copied from an object 
+   with the same content or 0 */
+extern int copy_dedup_lookup(struct copy_dedup *dedup, 
+	const copy_fingerprint_t *fingerprint, size_t stream_length);
+
+extern void copy_dedup_insert(struct copy_dedup *dedup, 
+	const copy_fingerprint_t *fingerprint, int dest_num);
+
+extern void copy_dedup_count_reads(struct copy_dedup *dedup, 
+	size_t objects, size_t seeks, size_t bytes);
+
+extern void copy_dedup_get_stats(struct copy_dedup *dedup, 
+	copy_dedup_stats_t *stats);
+
+/* references that are already in new_ids are hashed as their new number, 
+   as they point to the same object in the destination. The fingerprints 
+   are computed from the objects the copy has loaded anyway, so nothing is 
+   read from the file for them */
+extern struct copy_fingerprints *copy_fingerprints_new(fz_context *ctx, 
+	pdf_document *src, struct copy_map *new_ids);
+
+extern void copy_fingerprints_delete(struct copy_fingerprints *fingerprints);
+
+/* hashes all raw data of the stream num into hash and returns 1, or 0 if 
+   it can't be read; stream_length is how many bytes there are. Streams that
+   only share their start must never be taken for each other, so all of the
+   data counts. This may be called from any thread that owns doc */
+extern int copy_dedup_hash_stream(fz_context *ctx, pdf_document *doc, int num,
+	int gen, copy_fingerprint_t *hash, size_t *stream_length);
+
+/* makes a loaded object known; obj may belong to another document with the
+   same objects (a reader's), it is never resolved and has to stay valid 
+   until the fingerprints are deleted; data_hash is the result of 
+   copy_dedup_hash_stream() for streams, a stream without one is never 
+   reused */
+extern void copy_fingerprints_add(struct copy_fingerprints *fingerprints, 
+	int num, pdf_obj *obj, int is_stream, size_t stream_length, 
+	const copy_fingerprint_t *data_hash);
+
+/* all objects num references have to be added before; returns 0 if num 
+   can't get a fingerprint, stream_length is the length of its raw stream
+   data (0 if none) */
+extern int copy_fingerprint_object(struct copy_fingerprints *fingerprints, 
+	struct copy_dedup *dedup, int num, 
+	copy_fingerprint_t *fingerprint, size_t *stream_length);
+
+#endif /* _JUGGLER_COPY_DEDUP_H_ */
@@ -18,6 +18,10 @@
 
 #include "copy-helper.h"
 
+#include "deferred-streams.h"
+#include "copy-dedup.h"
+#include "copy-readers.h"
+
 typedef struct {
 	int *vals;
 	size_t len;
@@ -95,11 +99,110 @@ typedef struct {
 	fz_context *dest_ctx;
 	pdf_document *dest;
 	objref_stack *to_do;
-	int *new_ids;
+	struct copy_map *new_ids;
+
+	/* if not NULL, stream data is copied later, see deferred-streams.h */
+	struct deferred_streams *deferred;
+	juggler_t *src_juggler;
+
+	/* if not NULL, objects that are already in dest are reused */
+	struct copy_dedup *dedup;
+	struct copy_fingerprints *fingerprints;
+
+	int order; // COPY_ORDER_*
+	struct copy_readers *readers; // NULL if everything is read here
+
+	/* the objects that are not in dest yet are read first, then they get
+	   their fingerprints and numbers, then they are copied */
+	struct loaded_obj *loaded;
+	size_t loaded_count;
+	size_t loaded_cap;
+	struct copy_map *loaded_index; // source number -> index in loaded + 1
+
+	int last_offset; // where the last object has been read from the file
+	size_t objects;
+	size_t seeks;
+	size_t bytes;
 } copy_info;
 
+/* a jump of more than this forward in the file counts as a seek */
+#define COPY_SEEK_DISTANCE (64 * 1024)
+
+typedef struct {
+	int num;
+	int gen;
+	int offset; // of the object or of its object stream
+	int index; // in the object stream
+} pending_obj;
+
+struct loaded_obj
+{
+	int num;
+	int gen;
+	pdf_obj *obj; // NULL until it is read
+	int is_stream;
+	int owned; // else it belongs to a reader's document
+	int copy; // it needs a new object in dest
+
+	int hashed;
+	copy_fingerprint_t fingerprint;
+	size_t stream_length;
+};
+
 static pdf_obj *copy_obj(pdf_obj *src, copy_info *copy);
 
+/* src_num will be read, unless it has been queued before */
+static void queue_object(copy_info *info, int src_num, int src_gen)
+{
+	if(src_num < 1 || src_num >= pdf_xref_len(info->src_ctx, info->src))
+		return;
+	if(copy_map_get(info->new_ids, src_num) != 0 || 
+		copy_map_get(info->loaded_index, src_num) != 0)
+	{
+		return;
+	}
+
+	if(info->loaded_count == info->loaded_cap) {
+		info->loaded_cap = (info->loaded_cap == 0 ? 256 : info->loaded_cap * 2);
+		info->loaded = realloc(info->loaded, 
+			info->loaded_cap * sizeof(struct loaded_obj));
+	}
+	struct loaded_obj *loaded = &info->loaded[info->loaded_count++];
+	memset(loaded, 0, sizeof(struct loaded_obj));
+	loaded->num = src_num;
+	loaded->gen = src_gen;
+	copy_map_set(info->loaded_index, src_num, info->loaded_count);
+
+	objref_stack_push(info->to_do, src_num, src_gen);
+}
+
+/* with only_unassigned those already queued are pushed again, but not those
+   that have a number; references are never resolved, as obj may belong to 
+   a reader's document */
+static void push_references(copy_info *info, pdf_obj *obj, int only_unassigned)
+{
+	fz_context *ctx = info->src_ctx;
+
+	if(pdf_is_indirect(ctx, obj)) {
+		int num = pdf_to_num(ctx, obj);
+		if(!only_unassigned) {
+			queue_object(info, num, pdf_to_gen(ctx, obj));
+		} else if(copy_map_get(info->loaded_index, num) != 0 && 
+			copy_map_get(info->new_ids, num) == 0)
+		{
+			objref_stack_push(info->to_do, num, pdf_to_gen(ctx, obj));
+		}
+	} else if(pdf_is_array(ctx, obj)) {
+		int i;
+		for(i = 0; i < pdf_array_len(ctx, obj); i++)
+			push_references(info, pdf_array_get(ctx, obj, i), only_unassigned);
+	} else if(pdf_is_dict(ctx, obj)) {
+		int i;
+		for(i = 0; i < pdf_dict_len(ctx, obj); i++)
+			push_references(info, pdf_dict_get_val(ctx, obj, i), only_unassigned);
+	}
+}
+
 static pdf_obj *copy_dict(pdf_obj *src, copy_info *copy)
 {
 	int len = pdf_dict_len(copy->src_ctx, src);
@@ -135,24 +238,24 @@ static pdf_obj *copy_array(pdf_obj *src, copy_info *copy)
 
 static pdf_obj *copy_obj(pdf_obj *src, copy_info *copy)
 {
-	if(pdf_is_null(copy->src_ctx, src)) {
-		return(pdf_new_null(copy->dest_ctx, copy->dest));
-
 	/* check for indirects first, else MuPDF resolves them and tells us the
-	   type of the reference's destination */
-	} else if(pdf_is_indirect(copy->src_ctx, src)) {
+	   type of the reference's destination (and src may belong to a reader's
+	   document that must not be used here) */
+	if(pdf_is_indirect(copy->src_ctx, src)) {
 		int src_num = pdf_to_num(copy->src_ctx, src);
 		int src_gen = pdf_to_gen(copy->src_ctx, src); // TODO: validate gen?
-		if(src_num < 1 || src_num > pdf_xref_len(copy->src_ctx, copy->src))
+		if(src_num < 1 || src_num >= pdf_xref_len(copy->src_ctx, copy->src))
 			return(pdf_new_null(copy->dest_ctx, copy->dest));
 
-		int new_id = copy->new_ids[src_num];
+		/* every reference has got its number before anything is copied */
+		int new_id = copy_map_get(copy->new_ids, src_num);
 		if(new_id == 0) {
-			new_id = pdf_create_object(copy->dest_ctx, copy->dest);
-			copy->new_ids[src_num] = new_id;
-			objref_stack_push(copy->to_do, src_num, src_gen);
+			fz_warn(copy->dest_ctx, "%d %d R has not been read", src_num, src_gen);
+			return(pdf_new_null(copy->dest_ctx, copy->dest));
 		}
 		return(pdf_new_indirect(copy->dest_ctx, copy->dest, new_id, 0));
+	} else if(pdf_is_null(copy->src_ctx, src)) {
+		return(pdf_new_null(copy->dest_ctx, copy->dest));
 	} else if(pdf_is_bool(copy->src_ctx, src)) {
 		return(pdf_new_bool(copy->dest_ctx, copy->dest, 
 			pdf_to_bool(copy->src_ctx, src)));
@@ -179,145 +282,499 @@ static pdf_obj *copy_obj(pdf_obj *src, copy_info *copy)
 	
 }
 
-static void copy_stream(fz_context *src_ctx, pdf_document *src_doc, 
-	pdf_obj *src_obj, int src_num, int src_gen, fz_context *dest_ctx, 
-	pdf_document *dest_doc, pdf_obj *dest_obj, int dest_num)
-{
-	int length = 
-		pdf_to_int(dest_ctx, pdf_dict_gets(src_ctx, src_obj, "Length"));
-	if(length == 0) // TODO: Error case
-		return;
+/* the raw stream is read in chunks of this size into a buffer that has the 
+   size of /Length, so it is neither allocated twice nor trusted blindly */
+#define COPY_STREAM_CHUNK (64 * 1024)
 
-    /* we have to allocate a lot of memory here, but there is no other way in
-	   mupdf's api */
-	unsigned char *dest_data = fz_malloc(dest_ctx, length);
+ErrorCode copy_stream_data(fz_context *src_ctx, pdf_document *src, 
+	int src_num, int src_gen, fz_context *dest_ctx, pdf_document *dest, 
+	int dest_num)
+{
+	fz_stream *src_stream = NULL;
+	fz_buffer *dest_buffer = NULL;
+	pdf_obj *dest_ref = NULL;
+	fz_var(src_stream);
+	fz_var(dest_buffer);
+	fz_var(dest_ref);
 
 	fz_try(dest_ctx) {
-		fz_stream *src_stream = 
-			pdf_open_raw_stream(src_ctx, src_doc, src_num, src_gen);
-
-        /* read all to the data part of the new buffer */
-		length = fz_read(src_ctx, src_stream, dest_data, length);
-
+		pdf_obj *src_obj = pdf_load_object(src_ctx, src, src_num, src_gen);
+		int length = pdf_to_int(src_ctx, pdf_dict_gets(src_ctx, src_obj, "Length"));
+		pdf_drop_obj(src_ctx, src_obj);
+
+		dest_buffer = fz_new_buffer(dest_ctx, length > 0 ? length : COPY_STREAM_CHUNK);
+		src_stream = pdf_open_raw_stream(src_ctx, src, src_num, src_gen);
+
+		int read;
+		do {
+			if(dest_buffer->cap - dest_buffer->len < COPY_STREAM_CHUNK && 
+				dest_buffer->len >= length)
+			{
+				fz_resize_buffer(dest_ctx, dest_buffer, 
+					dest_buffer->cap + COPY_STREAM_CHUNK);
+			}
+			int want = dest_buffer->cap - dest_buffer->len;
+			if(want > COPY_STREAM_CHUNK)
+				want = COPY_STREAM_CHUNK;
+			read = fz_read(src_ctx, src_stream, 
+				dest_buffer->data + dest_buffer->len, want);
+			dest_buffer->len += read;
+		} while(read > 0);
+
+		// TODO: Currently its okay, to tell everything is compressed as MuPDF only
+		// removes Filter- and DecodeParams-entries if this is 0, but nothing more
+		// if compression is used... But will it change?
+		dest_ref = pdf_new_indirect(dest_ctx, dest, dest_num, 0);
+		pdf_update_stream(dest_ctx, dest, dest_ref, dest_buffer, 1); 
+	} fz_always(dest_ctx) {
+		pdf_drop_obj(dest_ctx, dest_ref);
+		fz_drop_buffer(dest_ctx, dest_buffer);
 		fz_drop_stream(src_ctx, src_stream);
 	} fz_catch(dest_ctx) {
-		fz_free(dest_ctx, dest_data);
-		return;
+		fz_warn(dest_ctx, "cannot copy stream %d %d R", src_num, src_gen);
+		return(ErrorStreamCopy);
 	}
 
-	fz_buffer *dest_buffer = 
-		fz_new_buffer_from_data(dest_ctx, dest_data, length);
-	// TODO: Currently its okay, to tell everything is compressed as MuPDF only
-	// removes Filter- and DecodeParams-entries if this is 0, but nothing more
-	// if compression is used... But will it change?
-	pdf_update_stream(dest_ctx, dest_doc, dest_obj, dest_buffer, 1); 
-	fz_drop_buffer(dest_ctx, dest_buffer);
+	return(NoError);
 }
 
-pdf_obj *copy_object_continue(fz_context *dest_ctx, pdf_document *dest, 
-	fz_context *src_ctx, pdf_document *src, pdf_obj *src_obj, int **new_ids_ptr)
+static void copy_stream(copy_info *info, int src_num, int src_gen, int dest_num)
+{
+	if(info->deferred != NULL) {
+		deferred_streams_add(info->deferred, info->src_juggler, 
+			src_num, src_gen, dest_num);
+	} else {
+		if(copy_stream_data(info->src_ctx, info->src, src_num, src_gen, 
+			info->dest_ctx, info->dest, dest_num) != NoError)
+		{
+			fz_throw(info->dest_ctx, FZ_ERROR_GENERIC, 
+				"cannot copy stream %d %d R", src_num, src_gen);
+		}
+	}
+}
+
+/* where src_num is stored in the source file */
+static void get_file_position(copy_info *info, int src_num, 
+	int *offset, int *index)
+{
+	pdf_xref_entry *entry = 
+		pdf_get_xref_entry(info->src_ctx, info->src, src_num);
+	*offset = *index = 0;
+
+	if(entry->type == 'n') {
+		*offset = entry->ofs;
+	} else if(entry->type == 'o') {
+		/* ofs is the number of the object stream, gen the index in it */
+		pdf_xref_entry *stream = 
+			pdf_get_xref_entry(info->src_ctx, info->src, entry->ofs);
+		*offset = stream->ofs;
+		*index = entry->gen;
+	}
+}
+
+/* the reads are counted in the order they happen, so the seeks tell how 
+   the file has really been accessed */
+static void count_read(copy_info *info, int src_num)
+{
+	int offset, index;
+	get_file_position(info, src_num, &offset, &index);
+	if(offset < info->last_offset || 
+		offset > info->last_offset + COPY_SEEK_DISTANCE)
+	{
+		info->seeks++;
+	}
+	info->bytes += abs(offset - info->last_offset);
+	info->last_offset = offset;
+	info->objects++;
+}
+
+/* the object has been read, either here or by a reader */
+static void set_loaded(copy_info *info, int src_num, pdf_obj *obj, 
+	int is_stream, int owned, size_t stream_length, 
+	const copy_fingerprint_t *data_hash)
+{
+	struct loaded_obj *loaded = 
+		&info->loaded[copy_map_get(info->loaded_index, src_num) - 1];
+	loaded->obj = obj;
+	loaded->is_stream = is_stream;
+	loaded->owned = owned;
+
+	if(info->fingerprints != NULL) {
+		copy_fingerprints_add(info->fingerprints, src_num, obj, is_stream, 
+			stream_length, data_hash);
+	}
+	count_read(info, src_num);
+
+	push_references(info, obj, 0);
+}
+
+static void load_object(copy_info *info, int src_num, int src_gen)
+{
+	pdf_obj *obj = pdf_load_object(info->src_ctx, info->src, src_num, src_gen);
+	int is_stream = pdf_is_stream(info->src_ctx, info->src, src_num, src_gen);
+
+	/* the data is right behind the object, so it's hashed now for the 
+	   fingerprint */
+	size_t stream_length = 0;
+	copy_fingerprint_t data_hash;
+	int data_hashed = 0;
+	if(is_stream && info->fingerprints != NULL) {
+		data_hashed = copy_dedup_hash_stream(info->src_ctx, info->src, 
+			src_num, src_gen, &data_hash, &stream_length);
+	}
+
+	set_loaded(info, src_num, obj, is_stream, 1, stream_length, 
+		data_hashed ? &data_hash : NULL);
+}
+
+/* if src has the object in memory, reading it here costs nothing */
+static int is_parsed(copy_info *info, int src_num)
+{
+	pdf_xref_entry *entry = 
+		pdf_get_xref_entry(info->src_ctx, info->src, src_num);
+	return(entry->obj != NULL);
+}
+
+static int compare_file_position(const void *a, const void *b)
+{
+	const pending_obj *obj_a = a, *obj_b = b;
+	if(obj_a->offset != obj_b->offset)
+		return(obj_a->offset < obj_b->offset ? -1 : 1);
+	return(obj_a->index - obj_b->index);
+}
+
+/* all objects found so far are read in the order of the file, those they 
+   reference form the next batch */
+static void load_pending_in_file_order(copy_info *info)
+{
+	size_t cap = 0;
+	pending_obj *batch = NULL;
+	int *nums = NULL, *gens = NULL;
+
+	while(objref_stack_len(info->to_do) > 0) {
+		size_t count = objref_stack_len(info->to_do);
+		if(count > cap) {
+			cap = count;
+			batch = realloc(batch, cap * sizeof(pending_obj));
+			nums = realloc(nums, cap * sizeof(int));
+			gens = realloc(gens, cap * sizeof(int));
+		}
+
+		size_t i;
+		for(i = 0; i < count; i++) {
+			objref_stack_pop(info->to_do, &batch[i].num, &batch[i].gen);
+			get_file_position(info, batch[i].num, 
+				&batch[i].offset, &batch[i].index);
+		}
+		qsort(batch, count, sizeof(pending_obj), compare_file_position);
+
+		/* objects that src has parsed already are not parsed again by the
+		   readers */
+		size_t unparsed = 0;
+		for(i = 0; i < count; i++) {
+			if(info->readers != NULL && !is_parsed(info, batch[i].num)) {
+				nums[unparsed] = batch[i].num;
+				gens[unparsed++] = batch[i].gen;
+			}
+		}
+		if(unparsed < COPY_READERS_MIN_BATCH) {
+			for(i = 0; i < count; i++)
+				load_object(info, batch[i].num, batch[i].gen);
+			continue;
+		}
+
+		/* the readers parse the batch while those objects that are ready 
+		   are taken over here, they stay in the readers' documents until
+		   the copy is done */
+		copy_readers_start(info->readers, nums, gens, unparsed, 
+			info->fingerprints != NULL);
+		const copy_read_result_t *read = NULL;
+		size_t next = 0, ready = 0;
+		for(i = 0; i < count; i++) {
+			if(next == unparsed || batch[i].num != nums[next]) {
+				load_object(info, batch[i].num, batch[i].gen);
+				continue;
+			}
+
+			/* the lock is only taken when the ready objects are used up */
+			if(ready == 0)
+				ready = copy_readers_wait(info->readers, next, &read);
+			if(read->obj == NULL) { // try again here
+				load_object(info, batch[i].num, batch[i].gen);
+			} else {
+				set_loaded(info, batch[i].num, read->obj, read->is_stream, 0, 
+					read->stream_length, 
+					read->data_hashed ? &read->data_hash : NULL);
+			}
+			read++, next++, ready--;
+		}
+		copy_readers_finish(info->readers);
+	}
+
+	free(batch);
+	free(nums);
+	free(gens);
+}
+
+/* reads all objects in to_do and everything they reference that is not in
+   dest yet */
+static void load_pending_objects(copy_info *info)
+{
+	if(info->order == COPY_ORDER_FILE) {
+		load_pending_in_file_order(info);
+	} else {
+		while(objref_stack_len(info->to_do) > 0) {
+			int src_num, src_gen;
+			objref_stack_pop(info->to_do, &src_num, &src_gen);
+			load_object(info, src_num, src_gen);
+		}
+	}
+
+	if(info->dedup != NULL)
+		copy_dedup_count_reads(info->dedup, info->objects, info->seeks, info->bytes);
+	info->objects = info->seeks = info->bytes = 0;
+}
+
+/* gives the objects in to_do and everything they reference a number in 
+   dest: an object with a known fingerprint gets the number of its earlier 
+   copy, and what it references isn't needed then; all others are copied */
+static void assign_numbers(copy_info *info)
+{
+	/* all fingerprints first, so that none of them depends on the numbers
+	   given here */
+	size_t i;
+	for(i = 0; info->dedup != NULL && i < info->loaded_count; i++) {
+		struct loaded_obj *loaded = &info->loaded[i];
+		loaded->hashed = copy_fingerprint_object(info->fingerprints, 
+			info->dedup, loaded->num, &loaded->fingerprint, 
+			&loaded->stream_length);
+	}
+
+	while(objref_stack_len(info->to_do) > 0) {
+		int src_num, src_gen;
+		objref_stack_pop(info->to_do, &src_num, &src_gen);
+		if(copy_map_get(info->new_ids, src_num) != 0)
+			continue;
+
+		struct loaded_obj *loaded = 
+			&info->loaded[copy_map_get(info->loaded_index, src_num) - 1];
+
+		int new_id = 0;
+		if(loaded->hashed) {
+			new_id = copy_dedup_lookup(info->dedup, &loaded->fingerprint, 
+				loaded->stream_length);
+		}
+
+		if(new_id == 0) {
+			new_id = pdf_create_object(info->dest_ctx, info->dest);
+			if(loaded->hashed)
+				copy_dedup_insert(info->dedup, &loaded->fingerprint, new_id);
+			loaded->copy = 1;
+		}
+		copy_map_set(info->new_ids, src_num, new_id);
+
+		if(loaded->copy)
+			push_references(info, loaded->obj, 1);
+	}
+}
+
+/* everything is in memory now, so the order doesn't matter any longer */
+static void copy_loaded_objects(copy_info *info)
+{
+	size_t i;
+	for(i = 0; i < info->loaded_count; i++) {
+		struct loaded_obj *loaded = &info->loaded[i];
+		if(!loaded->copy)
+			continue;
+
+		int dest_num = copy_map_get(info->new_ids, loaded->num);
+		pdf_obj *dest_obj = copy_obj(loaded->obj, info);
+		pdf_update_object(info->dest_ctx, info->dest, dest_num, dest_obj);
+		pdf_drop_obj(info->dest_ctx, dest_obj);
+
+		if(loaded->is_stream)
+			copy_stream(info, loaded->num, loaded->gen, dest_num);
+	}
+}
+
+static void begin_copy(copy_info *info)
+{
+	/* all object's that are referenced but not already copied are be put here */
+	info->to_do = objref_stack_new(256);
+	info->loaded_count = 0;
+	info->loaded_index = 
+		copy_map_new(pdf_xref_len(info->src_ctx, info->src), COPY_MAP_UNKNOWN);
+}
+
+static void end_copy(copy_info *info)
+{
+	size_t i;
+	for(i = 0; i < info->loaded_count; i++) {
+		if(info->loaded[i].owned)
+			pdf_drop_obj(info->src_ctx, info->loaded[i].obj);
+	}
+	if(info->readers != NULL)
+		copy_readers_release(info->readers);
+
+	free(info->loaded);
+	info->loaded = NULL;
+	info->loaded_count = info->loaded_cap = 0;
+	copy_map_delete(info->loaded_index);
+	objref_stack_delete(info->to_do);
+}
+
+static void init_copy_info(copy_info *info, fz_context *dest_ctx, 
+	pdf_document *dest, fz_context *src_ctx, pdf_document *src, 
+	struct copy_map **new_ids_ptr)
 {
     /* we need a map from source object numbers to destination object numbers
-	   this is done easily by an array where new_ids[old_ids] is the new number
-	   (or NULL when it was not yet copied and needs a new number */
-	int *new_ids = *new_ids_ptr;
-	if(new_ids == NULL)
-		*new_ids_ptr = new_ids = calloc(pdf_xref_len(src_ctx, src), sizeof(int));
+	   (or 0 when it was not yet copied and needs a new number) */
+	if(*new_ids_ptr == NULL) {
+		*new_ids_ptr = 
+			copy_map_new(pdf_xref_len(src_ctx, src), COPY_MAP_UNKNOWN);
+	}
+
+	info->src_ctx = src_ctx;
+	info->src = src;
+	info->dest_ctx = dest_ctx;
+	info->dest = dest;
+	info->to_do = NULL;
+	info->new_ids = *new_ids_ptr;
+	info->deferred = NULL;
+	info->src_juggler = NULL;
+	info->dedup = NULL;
+	info->fingerprints = NULL;
+	info->order = COPY_ORDER_DISCOVERY;
+	info->readers = NULL;
+	info->loaded = NULL;
+	info->loaded_count = info->loaded_cap = 0;
+	info->loaded_index = NULL;
+	info->last_offset = 0;
+	info->objects = info->seeks = info->bytes = 0;
+}
 
+static void init_juggler_copy_info(copy_info *info, juggler_t *dest, 
+	juggler_t *src, struct copy_map **new_ids_ptr)
+{
+	init_copy_info(info, dest->ctx, dest->pdf, src->ctx, src->pdf, new_ids_ptr);
+	info->deferred = dest->deferred;
+	info->src_juggler = src;
+	info->dedup = dest->imported;
+	info->order = dest->import_order;
+
+	/* the readers see the file, so src must not have been changed and the 
+	   file must still be the one src has been loaded from, else everything 
+	   is read here */
+	if(dest->import_threads > 0 && !src->edited && src->filename != NULL) {
+		if(src->readers != NULL && 
+			!file_id_unchanged(src->filename, &src->file_id))
+		{
+			copy_readers_close(src->readers);
+			copy_readers_forget(src->filename);
+			src->readers = NULL;
+		}
+		if(src->readers == NULL) {
+			src->readers = copy_readers_open(src->ctx, src->filename, 
+				&src->file_id, dest->import_threads);
+		}
+		info->readers = src->readers;
+	}
+	info->fingerprints = 
+		copy_fingerprints_new(src->ctx, src->pdf, info->new_ids);
+}
+
+static pdf_obj *copy_assigned(copy_info *info, pdf_obj *src_obj)
+{
 	/* this function can be called several times... thus the user could call
 	   it with a src_obj that already  has been copied! We don't want to 
 	   copy it a second time */
-	if(new_ids[pdf_to_num(src_ctx, src_obj)] != 0) {
-		//printf("Object src: %d 0 already was copied to %d 0\n", 
-		//	pdf_to_num(src_ctx, src_obj), new_ids[pdf_to_num(src_ctx, src_obj)]);
-		return(pdf_new_indirect(src_ctx, dest, new_ids[pdf_to_num(src_ctx, src_obj)], 0));
-	}
+	int src_num = pdf_to_num(info->src_ctx, src_obj);
+	int dest_obj_num = copy_map_get(info->new_ids, src_num);
+	if(dest_obj_num != 0)
+		return(pdf_new_indirect(info->dest_ctx, info->dest, dest_obj_num, 0));
+
+	int src_gen = pdf_to_gen(info->src_ctx, src_obj);
+	begin_copy(info);
+	queue_object(info, src_num, src_gen);
+	load_pending_objects(info);
+
+	objref_stack_push(info->to_do, src_num, src_gen);
+	assign_numbers(info);
+	copy_loaded_objects(info);
+	end_copy(info);
+
+	dest_obj_num = copy_map_get(info->new_ids, src_num);
+	if(dest_obj_num == 0) // src_num is no valid object
+		return(pdf_new_null(info->dest_ctx, info->dest));
+	return(pdf_new_indirect(info->dest_ctx, info->dest, dest_obj_num, 0));
+}
 
-	/* all object's that are referenced but not already copied are be put here */
-	objref_stack *to_do = objref_stack_new(256);
+static pdf_obj *copy_unassigned(copy_info *info, pdf_obj *src_obj)
+{
+	begin_copy(info);
+	push_references(info, src_obj, 0);
+	load_pending_objects(info);
 
-	/* create a new obj for src_obj in the destination-file and add it to to-do */
-	int dest_obj_num = pdf_create_object(dest_ctx, dest);
-	new_ids[pdf_to_num(src_ctx, src_obj)] = dest_obj_num;
-	objref_stack_push(to_do, 
-		pdf_to_num(src_ctx, src_obj), pdf_to_gen(src_ctx, src_obj));
-	
-	copy_info info;
-	info.src_ctx = src_ctx;
-	info.src = src;
-	info.dest_ctx = dest_ctx;
-	info.dest = dest;
-	info.to_do = to_do;
-	info.new_ids = new_ids;
-
-	while(objref_stack_len(to_do) > 0) {
-		int src_num, src_gen;
-		objref_stack_pop(to_do, &src_num, &src_gen);
-		
-		pdf_obj *src_obj = pdf_load_object(src_ctx, src, src_num, src_gen);
+	push_references(info, src_obj, 1);
+	assign_numbers(info);
+	copy_loaded_objects(info);
+	pdf_obj *copied_obj = copy_obj(src_obj, info);
+	end_copy(info);
 
-		pdf_obj *dest_obj = copy_obj(src_obj, &info);
-		pdf_update_object(dest_ctx, dest, new_ids[src_num], dest_obj);
-		pdf_drop_obj(dest_ctx, dest_obj);
+	return(copied_obj);
+}
 
-		if(pdf_is_stream(src_ctx, src, src_num, src_gen))
-			copy_stream(src_ctx, src, src_obj, src_num, src_gen, 
-				dest_ctx, dest, dest_obj, new_ids[src_num]);
-	}
-	objref_stack_delete(to_do);
+pdf_obj *copy_object_continue(fz_context *dest_ctx, pdf_document *dest, 
+	fz_context *src_ctx, pdf_document *src, pdf_obj *src_obj, 
+	struct copy_map **new_ids_ptr)
+{
+	copy_info info;
+	init_copy_info(&info, dest_ctx, dest, src_ctx, src, new_ids_ptr);
 
-	return(pdf_new_indirect(dest_ctx, dest, dest_obj_num, 0));
+	return(copy_assigned(&info, src_obj));
 }
 
 pdf_obj *copy_object_single(fz_context *dest_ctx, pdf_document *dest, 
 	fz_context *src_ctx, pdf_document *src, pdf_obj *src_obj)
 {
-	int *new_ids = NULL;
+	struct copy_map *new_ids = NULL;
 	pdf_obj *obj = 
 		copy_object_continue(dest_ctx, dest, src_ctx, src, src_obj, &new_ids);
 
-	free(new_ids);
+	copy_map_delete(new_ids);
 	return(obj);
 }
 
 pdf_obj *copy_unassigned_object_continue(fz_context *dest_ctx, pdf_document *dest, 
-	fz_context *src_ctx, pdf_document *src, pdf_obj *src_obj, int **new_ids_ptr)
+	fz_context *src_ctx, pdf_document *src, pdf_obj *src_obj, 
+	struct copy_map **new_ids_ptr)
 {
-    /* we need a map from source object numbers to destination object numbers
-	   this is done easily by an array where new_ids[old_ids] is the new number
-	   (or NULL when it was not yet copied and needs a new number */
-	int *new_ids = *new_ids_ptr;
-	if(new_ids == NULL)
-		*new_ids_ptr = new_ids = calloc(pdf_xref_len(src_ctx, src), sizeof(int));
+	copy_info info;
+	init_copy_info(&info, dest_ctx, dest, src_ctx, src, new_ids_ptr);
 
-	/* all object's that are referenced but not already copied are be put here */
-	objref_stack *to_do = objref_stack_new(256);
+	return(copy_unassigned(&info, src_obj));
+}
 
+pdf_obj *copy_object_deferred(juggler_t *dest, juggler_t *src, 
+	pdf_obj *src_obj, struct copy_map **new_ids_ptr)
+{
 	copy_info info;
-	info.src_ctx = src_ctx;
-	info.src = src;
-	info.dest_ctx = dest_ctx;
-	info.dest = dest;
-	info.to_do = to_do;
-	info.new_ids = new_ids;
-	
-	pdf_obj *copied_obj = copy_obj(src_obj, &info);
+	init_juggler_copy_info(&info, dest, src, new_ids_ptr);
 
-	while(objref_stack_len(to_do) > 0) {
-		int src_num, src_gen;
-		objref_stack_pop(to_do, &src_num, &src_gen);
-		
-		pdf_obj *src_obj = pdf_load_object(src_ctx, src, src_num, src_gen);
+	pdf_obj *copied_obj = copy_assigned(&info, src_obj);
+	copy_fingerprints_delete(info.fingerprints);
 
-		pdf_obj *dest_obj = copy_obj(src_obj, &info);
-		pdf_update_object(dest_ctx, dest, new_ids[src_num], dest_obj);
-		pdf_drop_obj(dest_ctx, dest_obj);
+	return(copied_obj);
+}
 
-		if(pdf_is_stream(src_ctx, src, src_num, src_gen))
-			copy_stream(src_ctx, src, src_obj, src_num, src_gen, 
-				dest_ctx, dest, dest_obj, new_ids[src_num]);
-	}
+pdf_obj *copy_unassigned_object_deferred(juggler_t *dest, juggler_t *src, 
+	pdf_obj *src_obj, struct copy_map **new_ids_ptr)
+{
+	copy_info info;
+	init_juggler_copy_info(&info, dest, src, new_ids_ptr);
+
+	pdf_obj *copied_obj = copy_unassigned(&info, src_obj);
+	copy_fingerprints_delete(info.fingerprints);
 
-	objref_stack_delete(to_do);
 	return(copied_obj);
-}
\ No newline at end of file
+}
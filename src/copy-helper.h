@@ -20,6 +20,16 @@
 #define _COPY_HELPER_H_
 
 #include "document.h"
+#include "copy-map.h"
+
+/* the order in which the objects are read from the source: as they are found
+   (jumps back and forth in the file) or sorted by their position in the file,
+   a whole level of references at once */
+#define COPY_ORDER_DISCOVERY 0
+#define COPY_ORDER_FILE 1
+
+/* with COPY_ORDER_FILE big batches can be parsed by threads, see 
+   copy-readers.h */
 
 /* TODO: All in here needs to be named better! 
    And maybe we should create an extra helper-directory? */
@@ -33,14 +43,16 @@ extern pdf_obj *copy_object_single(fz_context *dest_ctx, pdf_document *dest,
 /* ...And this if you need to copy more than once from src to dest. It will 
    ensure that referenced objects that had already been copied in a previous 
    call to this function won't be copied again!
-   But you are responsible to free the int-array new_ids_ptr! And you have to 
-   assign *new_ids_ptr with NULL for the first call! 
+   But you are responsible to free *new_ids_ptr with copy_map_delete()! And 
+   you have to assign *new_ids_ptr with NULL for the first call (or with your
+   own map from copy_map_new() if you know how many objects you will copy)! 
 
    Returns an indirect pdf_obj * pointing to the copy of src_obj. You are 
    responsible to drop this new item! */
    
 extern pdf_obj *copy_object_continue(fz_context *dest_ctx, pdf_document *dest, 
-	fz_context *src_ctx, pdf_document *src, pdf_obj *src_obj, int **new_ids_ptr);
+	fz_context *src_ctx, pdf_document *src, pdf_obj *src_obj, 
+	struct copy_map **new_ids_ptr);
 	
 /* returns the copied object that does not need to be assigned to an entry in
    the xref-info...
@@ -48,6 +60,24 @@ extern pdf_obj *copy_object_continue(fz_context *dest_ctx, pdf_document *dest,
    but if there are any referenced objects those would be copied (and assigned
    a new xref-number in the destination file */
 extern pdf_obj *copy_unassigned_object_continue(fz_context *dest_ctx, pdf_document *dest, 
-	fz_context *src_ctx, pdf_document *src, pdf_obj *src_obj, int **new_ids_ptr);
+	fz_context *src_ctx, pdf_document *src, pdf_obj *src_obj, 
+	struct copy_map **new_ids_ptr);
+
+/* the same as the two functions above, but the data of copied streams stays 
+   in src until dest needs it (see deferred-streams.h); src is kept open 
+   until then. Objects with the same content as one that has been imported 
+   before are not copied again (see copy-dedup.h) */
+extern pdf_obj *copy_object_deferred(juggler_t *dest, juggler_t *src, 
+	pdf_obj *src_obj, struct copy_map **new_ids_ptr);
+
+extern pdf_obj *copy_unassigned_object_deferred(juggler_t *dest, juggler_t *src, 
+	pdf_obj *src_obj, struct copy_map **new_ids_ptr);
+
+/* copies the raw data of the stream src_num into the existing object 
+   dest_num; returns ErrorStreamCopy and leaves dest_num as it is if the data 
+   can't be read */
+extern ErrorCode copy_stream_data(fz_context *src_ctx, pdf_document *src, 
+	int src_num, int src_gen, fz_context *dest_ctx, pdf_document *dest, 
+	int dest_num);
 
 #endif /* _COPY_HELPER_H_ */
@@ -0,0 +1,172 @@
+/*
+  copy-map.c - map object numbers of a source file to those of its copies
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "copy-map.h"
+
+#include <stdlib.h>
+
+/* if more than 1/COPY_MAP_DENSE_RATIO of all objects are copied an array
+   needs less memory than the hash table (which is at most half full and 
+   stores two ints per entry) */
+#define COPY_MAP_DENSE_RATIO 4
+#define COPY_MAP_MIN_CAP 64
+
+struct copy_map_slot
+{
+	int src_num; // 0 if unused, there is no object 0 to copy
+	int dest_num;
+};
+
+struct copy_map
+{
+	size_t src_len;
+
+	/* either dense is used, indexed by the source number... */
+	int *dense;
+
+	/* ...or this open-addressing hash table with linear probing */
+	struct copy_map_slot *slots;
+	size_t cap; // always a power of two
+	size_t used;
+};
+
+static inline size_t hash_num(int num)
+{
+	/* object numbers are mostly sequential, spread them over the table */
+	return((size_t) ((unsigned int) num * 2654435761u));
+}
+
+static void make_dense(struct copy_map *map)
+{
+	map->dense = calloc(map->src_len, sizeof(int));
+
+	size_t i;
+	for(i = 0; i < map->cap; i++) {
+		if(map->slots[i].src_num != 0)
+			map->dense[map->slots[i].src_num] = map->slots[i].dest_num;
+	}
+
+	free(map->slots);
+	map->slots = NULL;
+	map->cap = map->used = 0;
+}
+
+static void hash_put(struct copy_map_slot *slots, size_t cap, 
+	int src_num, int dest_num)
+{
+	size_t i = hash_num(src_num) & (cap - 1);
+	while(slots[i].src_num != 0 && slots[i].src_num != src_num)
+		i = (i + 1) & (cap - 1);
+
+	slots[i].src_num = src_num;
+	slots[i].dest_num = dest_num;
+}
+
+static void grow_hash(struct copy_map *map)
+{
+	size_t new_cap = map->cap * 2;
+	struct copy_map_slot *slots = 
+		calloc(new_cap, sizeof(struct copy_map_slot));
+
+	size_t i;
+	for(i = 0; i < map->cap; i++) {
+		if(map->slots[i].src_num != 0) {
+			hash_put(slots, new_cap, 
+				map->slots[i].src_num, map->slots[i].dest_num);
+		}
+	}
+
+	free(map->slots);
+	map->slots = slots;
+	map->cap = new_cap;
+}
+
+struct copy_map *copy_map_new(size_t src_len, size_t expected_count)
+{
+	struct copy_map *map = calloc(1, sizeof(struct copy_map));
+	map->src_len = src_len;
+
+	if(expected_count * COPY_MAP_DENSE_RATIO >= src_len) {
+		map->dense = calloc(src_len, sizeof(int));
+	} else {
+		map->cap = COPY_MAP_MIN_CAP;
+		while(map->cap < expected_count * 2)
+			map->cap *= 2;
+		map->slots = calloc(map->cap, sizeof(struct copy_map_slot));
+	}
+
+	return(map);
+}
+
+void copy_map_delete(struct copy_map *map)
+{
+	if(map == NULL)
+		return;
+
+	free(map->dense);
+	free(map->slots);
+	free(map);
+}
+
+int copy_map_get(struct copy_map *map, int src_num)
+{
+	if(src_num <= 0 || src_num >= map->src_len)
+		return(0);
+
+	if(map->dense != NULL)
+		return(map->dense[src_num]);
+
+	size_t i = hash_num(src_num) & (map->cap - 1);
+	while(map->slots[i].src_num != 0) {
+		if(map->slots[i].src_num == src_num)
+			return(map->slots[i].dest_num);
+		i = (i + 1) & (map->cap - 1);
+	}
+
+	return(0);
+}
+
+void copy_map_set(struct copy_map *map, int src_num, int dest_num)
+{
+	if(src_num <= 0 || src_num >= map->src_len)
+		return;
+
+	if(map->dense != NULL) {
+		map->dense[src_num] = dest_num;
+		return;
+	}
+
+	/* keep the table at most half full */
+	if((map->used + 1) * 2 > map->cap) {
+		if((map->used + 1) * COPY_MAP_DENSE_RATIO >= map->src_len) {
+			make_dense(map);
+			map->dense[src_num] = dest_num;
+			return;
+		}
+		grow_hash(map);
+	}
+
+	size_t i = hash_num(src_num) & (map->cap - 1);
+	while(map->slots[i].src_num != 0 && map->slots[i].src_num != src_num)
+		i = (i + 1) & (map->cap - 1);
+
+	if(map->slots[i].src_num == 0)
+		map->used++;
+	map->slots[i].src_num = src_num;
+	map->slots[i].dest_num = dest_num;
+}
@@ -0,0 +1,44 @@
+/*
+  copy-map.h - map object numbers of a source file to those of its copies
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JUGGLER_COPY_MAP_H_
+#define _JUGGLER_COPY_MAP_H_
+
+#include <stddef.h>
+
+/* remembers which source object has been copied to which destination object;
+   if only a few objects of a big file are copied, an array with an entry for
+   each source object would be mostly empty, thus those are kept in a hash 
+   table until they get dense enough to be worth an array */
+
+/* pass this as expected count if you don't know how many objects you copy */
+#define COPY_MAP_UNKNOWN 0
+
+struct copy_map;
+
+/* src_len is the xref length of the source file */
+extern struct copy_map *copy_map_new(size_t src_len, size_t expected_count);
+
+extern void copy_map_delete(struct copy_map *map);
+
+/* returns the new number of src_num or 0 if it has not been copied yet */
+extern int copy_map_get(struct copy_map *map, int src_num);
+
+extern void copy_map_set(struct copy_map *map, int src_num, int dest_num);
+
+#endif /* _JUGGLER_COPY_MAP_H_ */
@@ -0,0 +1,366 @@
+/*
+  copy-readers.c - parse the objects of a source file in parallel
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "copy-readers.h"
+
+#include <pthread.h>
+
+struct copy_reader
+{
+	struct copy_readers *readers;
+	fz_context *ctx;
+	pdf_document *doc;
+	pthread_t thread;
+	unsigned int batch; // the last batch this reader has seen
+
+	/* the part of the batch this reader parses, next is the first object
+	   that is not ready yet */
+	size_t first;
+	size_t last;
+	size_t next;
+};
+
+struct copy_readers
+{
+	struct copy_reader *readers;
+	int readers_count;
+
+	/* what has been opened, to find the readers again in the cache */
+	char *filename;
+	file_id_t id;
+	int threads;
+
+	pthread_mutex_t lock;
+	pthread_cond_t work; // a new batch or quit
+	pthread_cond_t ready; // an object is ready or a reader is done
+	int quit;
+	int waiting; // the caller waits for ready
+	int busy; // readers that have not finished the batch yet
+
+	/* the current batch */
+	unsigned int batch;
+	const int *nums;
+	const int *gens;
+	int hash_streams;
+	copy_read_result_t *results;
+	size_t count;
+	size_t cap;
+
+	/* the objects of finished batches, the caller still uses them */
+	copy_read_result_t *held;
+	size_t held_count;
+	size_t held_cap;
+};
+
+/* closed readers of unchanged files are kept here, so importing from the 
+   same file again does not open it once per thread again */
+static struct copy_readers *cached[COPY_READERS_CACHED];
+static int cached_count = 0;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void read_object(struct copy_reader *reader, size_t i)
+{
+	struct copy_readers *readers = reader->readers;
+	fz_context *ctx = reader->ctx;
+
+	copy_read_result_t result;
+	memset(&result, 0, sizeof(copy_read_result_t));
+	fz_var(result);
+
+	int num = readers->nums[i], gen = readers->gens[i];
+	fz_try(ctx) {
+		result.obj = pdf_load_object(ctx, reader->doc, num, gen);
+		result.is_stream = pdf_is_stream(ctx, reader->doc, num, gen);
+	} fz_catch(ctx) {
+		pdf_drop_obj(ctx, result.obj);
+		// the caller tries again in its own document
+		memset(&result, 0, sizeof(copy_read_result_t));
+	}
+
+	if(result.is_stream && readers->hash_streams) {
+		result.data_hashed = copy_dedup_hash_stream(ctx, reader->doc, 
+			num, gen, &result.data_hash, &result.stream_length);
+	}
+
+	/* nobody looks at results[i] before next has passed it */
+	readers->results[i] = result;
+}
+
+static void *reader_main(void *data)
+{
+	struct copy_reader *reader = data;
+	struct copy_readers *readers = reader->readers;
+
+	pthread_mutex_lock(&readers->lock);
+	while(1) {
+		while(reader->batch == readers->batch && !readers->quit)
+			pthread_cond_wait(&readers->work, &readers->lock);
+		if(readers->quit)
+			break;
+		reader->batch = readers->batch;
+
+		while(reader->next < reader->last) {
+			pthread_mutex_unlock(&readers->lock);
+			read_object(reader, reader->next);
+			pthread_mutex_lock(&readers->lock);
+
+			reader->next++;
+			if(readers->waiting)
+				pthread_cond_broadcast(&readers->ready);
+		}
+
+		readers->busy--;
+		pthread_cond_broadcast(&readers->ready);
+	}
+	pthread_mutex_unlock(&readers->lock);
+
+	return(NULL);
+}
+
+static void delete_readers(struct copy_readers *readers)
+{
+	copy_readers_release(readers);
+
+	pthread_mutex_lock(&readers->lock);
+	readers->quit = 1;
+	pthread_cond_broadcast(&readers->work);
+	pthread_mutex_unlock(&readers->lock);
+
+	int i;
+	for(i = 0; i < readers->readers_count; i++) {
+		pthread_join(readers->readers[i].thread, NULL);
+		pdf_close_document(readers->readers[i].ctx, readers->readers[i].doc);
+		fz_drop_context(readers->readers[i].ctx);
+	}
+	free(readers->readers);
+	free(readers->results);
+	free(readers->held);
+	free(readers->filename);
+
+	pthread_cond_destroy(&readers->ready);
+	pthread_cond_destroy(&readers->work);
+	pthread_mutex_destroy(&readers->lock);
+	free(readers);
+}
+
+/* returns readers of the file with the identity id from the cache or NULL */
+static struct copy_readers *take_cached(const char *filename, 
+	const file_id_t *id, int threads)
+{
+	struct copy_readers *readers = NULL;
+
+	pthread_mutex_lock(&cache_lock);
+	int i;
+	for(i = 0; i < cached_count; i++) {
+		if(strcmp(cached[i]->filename, filename) == 0 && 
+			file_id_equal(&cached[i]->id, id) && 
+			cached[i]->threads == threads)
+		{
+			readers = cached[i];
+			memmove(&cached[i], &cached[i + 1], 
+				(cached_count - i - 1) * sizeof(struct copy_readers *));
+			cached_count--;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&cache_lock);
+
+	return(readers);
+}
+
+struct copy_readers *copy_readers_open(fz_context *ctx, 
+	const char *filename, const file_id_t *id, int threads)
+{
+	if(threads > COPY_READERS_MAX_THREADS)
+		threads = COPY_READERS_MAX_THREADS;
+
+	/* the readers must see the same file as the caller's document */
+	if(!file_id_unchanged(filename, id))
+		return(NULL);
+
+	struct copy_readers *readers = take_cached(filename, id, threads);
+	if(readers != NULL)
+		return(readers);
+
+	readers = calloc(1, sizeof(struct copy_readers));
+	readers->filename = strdup(filename);
+	readers->id = *id;
+	readers->threads = threads;
+	pthread_mutex_init(&readers->lock, NULL);
+	pthread_cond_init(&readers->work, NULL);
+	pthread_cond_init(&readers->ready, NULL);
+	readers->readers = calloc(threads, sizeof(struct copy_reader));
+
+	int i;
+	for(i = 0; i < threads; i++) {
+		struct copy_reader *reader = &readers->readers[readers->readers_count];
+		reader->readers = readers;
+
+		/* this fails if the context has been created without locks */
+		if((reader->ctx = fz_clone_context(ctx)) == NULL)
+			break;
+
+		fz_try(reader->ctx) {
+			reader->doc = pdf_open_document(reader->ctx, filename);
+		} fz_catch(reader->ctx) {
+			reader->doc = NULL;
+		}
+		if(reader->doc != NULL && 
+			pthread_create(&reader->thread, NULL, reader_main, reader) != 0)
+		{
+			pdf_close_document(reader->ctx, reader->doc);
+			reader->doc = NULL;
+		}
+		if(reader->doc == NULL) {
+			fz_drop_context(reader->ctx);
+			break;
+		}
+		readers->readers_count++;
+	}
+
+	/* the file may have been replaced while the readers opened it */
+	if(readers->readers_count == 0 || !file_id_unchanged(filename, id)) {
+		delete_readers(readers);
+		return(NULL);
+	}
+
+	return(readers);
+}
+
+void copy_readers_close(struct copy_readers *readers)
+{
+	copy_readers_release(readers);
+
+	struct copy_readers *evicted = NULL;
+
+	pthread_mutex_lock(&cache_lock);
+	if(cached_count == COPY_READERS_CACHED) {
+		evicted = cached[0];
+		memmove(&cached[0], &cached[1], 
+			(cached_count - 1) * sizeof(struct copy_readers *));
+		cached_count--;
+	}
+	cached[cached_count++] = readers;
+	pthread_mutex_unlock(&cache_lock);
+
+	if(evicted != NULL)
+		delete_readers(evicted);
+}
+
+void copy_readers_forget(const char *filename)
+{
+	struct copy_readers *forgotten[COPY_READERS_CACHED];
+	int forgotten_count = 0;
+
+	pthread_mutex_lock(&cache_lock);
+	int i, kept = 0;
+	for(i = 0; i < cached_count; i++) {
+		if(strcmp(cached[i]->filename, filename) == 0)
+			forgotten[forgotten_count++] = cached[i];
+		else
+			cached[kept++] = cached[i];
+	}
+	cached_count = kept;
+	pthread_mutex_unlock(&cache_lock);
+
+	for(i = 0; i < forgotten_count; i++)
+		delete_readers(forgotten[i]);
+}
+
+void copy_readers_start(struct copy_readers *readers, 
+	const int *nums, const int *gens, size_t count, int hash_streams)
+{
+	if(count > readers->cap) {
+		readers->cap = count;
+		readers->results = realloc(readers->results, 
+			count * sizeof(copy_read_result_t));
+	}
+
+	pthread_mutex_lock(&readers->lock);
+	readers->nums = nums;
+	readers->gens = gens;
+	readers->hash_streams = hash_streams;
+	readers->count = count;
+
+	/* neighbours in the batch are neighbours in the file (and often in 
+	   the same object stream), so each reader gets one contiguous part */
+	int i;
+	for(i = 0; i < readers->readers_count; i++) {
+		struct copy_reader *reader = &readers->readers[i];
+		reader->first = reader->next = count * i / readers->readers_count;
+		reader->last = count * (i + 1) / readers->readers_count;
+	}
+	readers->busy = readers->readers_count;
+	readers->batch++;
+	pthread_cond_broadcast(&readers->work);
+	pthread_mutex_unlock(&readers->lock);
+}
+
+size_t copy_readers_wait(struct copy_readers *readers, size_t first, 
+	const copy_read_result_t **results)
+{
+	pthread_mutex_lock(&readers->lock);
+
+	struct copy_reader *reader = readers->readers;
+	while(reader->last <= first)
+		reader++;
+
+	readers->waiting = 1;
+	while(reader->next <= first)
+		pthread_cond_wait(&readers->ready, &readers->lock);
+	readers->waiting = 0;
+	size_t ready = reader->next - first;
+
+	pthread_mutex_unlock(&readers->lock);
+
+	*results = &readers->results[first];
+	return(ready);
+}
+
+void copy_readers_finish(struct copy_readers *readers)
+{
+	pthread_mutex_lock(&readers->lock);
+	while(readers->busy > 0)
+		pthread_cond_wait(&readers->ready, &readers->lock);
+	pthread_mutex_unlock(&readers->lock);
+
+	if(readers->held_count + readers->count > readers->held_cap) {
+		readers->held_cap = readers->held_count + readers->count;
+		readers->held = realloc(readers->held, 
+			readers->held_cap * sizeof(copy_read_result_t));
+	}
+	memcpy(readers->held + readers->held_count, readers->results, 
+		readers->count * sizeof(copy_read_result_t));
+	readers->held_count += readers->count;
+	readers->count = 0;
+}
+
+void copy_readers_release(struct copy_readers *readers)
+{
+	if(readers->held_count == 0)
+		return;
+
+	/* the readers are idle, so any of their contexts will do */
+	fz_context *ctx = readers->readers[0].ctx;
+
+	size_t i;
+	for(i = 0; i < readers->held_count; i++) {
+		pdf_drop_obj(ctx, readers->held[i].obj);
+	}
+	readers->held_count = 0;
+}
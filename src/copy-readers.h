@@ -0,0 +1,83 @@
+/*
+  copy-readers.h - parse the objects of a source file in parallel
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JUGGLER_COPY_READERS_H_
+#define _JUGGLER_COPY_READERS_H_
+
+#include <mupdf/fitz.h>
+#include <mupdf/pdf.h>
+
+#include "copy-dedup.h"
+#include "file-id.h"
+
+/* a pdf_document can only be used by one thread, so each reader opens the 
+   source file on its own and parses a part of a batch of objects while the
+   caller goes through those that are ready in the order of the batch; the
+   threads keep running between the batches */
+
+#define COPY_READERS_MAX_THREADS 8
+
+/* smaller batches are not worth waking the readers */
+#define COPY_READERS_MIN_BATCH 64
+
+/* how many closed readers are kept with their files open */
+#define COPY_READERS_CACHED 4
+
+typedef struct
+{
+	pdf_obj *obj; // belongs to a reader's document, NULL if it failed
+	int is_stream;
+
+	/* only for streams, if they are hashed (see copy_dedup_hash_stream()) */
+	int data_hashed;
+	copy_fingerprint_t data_hash;
+	size_t stream_length;
+} copy_read_result_t;
+
+struct copy_readers;
+
+/* returns the readers of an earlier copy_readers_close() of the file with
+   the identity id, else opens it once per thread; returns NULL if the file 
+   is not the one of id anymore or could not be opened at all */
+extern struct copy_readers *copy_readers_open(fz_context *ctx, 
+	const char *filename, const file_id_t *id, int threads);
+
+/* the readers are kept for the next copy_readers_open() of the file */
+extern void copy_readers_close(struct copy_readers *readers);
+
+/* the file has been written, so the cached readers of it are closed */
+extern void copy_readers_forget(const char *filename);
+
+/* starts to read the objects nums[i] with gens[i], with hash_streams the
+   data of the streams is hashed as well */
+extern void copy_readers_start(struct copy_readers *readers, 
+	const int *nums, const int *gens, size_t count, int hash_streams);
+
+/* waits until the object first of the batch has been read, returns how 
+   many objects from there on are ready and points results to them */
+extern size_t copy_readers_wait(struct copy_readers *readers, size_t first,
+	const copy_read_result_t **results);
+
+/* waits for the readers; the objects of the batch stay valid until 
+   copy_readers_release() */
+extern void copy_readers_finish(struct copy_readers *readers);
+
+/* drops the objects of all finished batches */
+extern void copy_readers_release(struct copy_readers *readers);
+
+#endif /* _JUGGLER_COPY_READERS_H_ */
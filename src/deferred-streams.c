@@ -0,0 +1,227 @@
+/*
+  deferred-streams.c - copy the data of imported streams when it is needed
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "deferred-streams.h"
+
+#include "copy-helper.h"
+#include "copy-map.h"
+#include "page-attrs.h"
+
+#include <limits.h>
+
+struct deferred_stream
+{
+	juggler_t *src; // NULL if already copied
+	int src_num;
+	int src_gen;
+	int dest_num;
+};
+
+struct deferred_streams
+{
+	struct deferred_stream *streams;
+	size_t count;
+	size_t cap;
+	size_t pending;
+
+	/* destination number -> index in streams + 1 */
+	struct copy_map *by_dest;
+};
+
+/* those keys don't change how a page looks, but would lead to other pages */
+static const char *skipped_keys[] = { "Parent", "P", "Dest", "A" };
+
+struct deferred_streams *deferred_streams_new(void)
+{
+	struct deferred_streams *deferred = 
+		calloc(1, sizeof(struct deferred_streams));
+
+	/* destination numbers grow while importing, so it is always a hash */
+	deferred->by_dest = copy_map_new(INT_MAX, COPY_MAP_UNKNOWN);
+
+	return(deferred);
+}
+
+static void release_stream(struct deferred_stream *stream)
+{
+	if(stream->src != NULL) {
+		juggler_close(stream->src);
+		stream->src = NULL;
+	}
+}
+
+static void reset(struct deferred_streams *deferred)
+{
+	size_t i;
+	for(i = 0; i < deferred->count; i++)
+		release_stream(&deferred->streams[i]);
+
+	deferred->count = deferred->pending = 0;
+	copy_map_delete(deferred->by_dest);
+	deferred->by_dest = copy_map_new(INT_MAX, COPY_MAP_UNKNOWN);
+}
+
+void deferred_streams_delete(struct deferred_streams *deferred)
+{
+	reset(deferred);
+	copy_map_delete(deferred->by_dest);
+	free(deferred->streams);
+	free(deferred);
+}
+
+void deferred_streams_add(struct deferred_streams *deferred, 
+	juggler_t *src, int src_num, int src_gen, int dest_num)
+{
+	if(deferred->count == deferred->cap) {
+		deferred->cap = (deferred->cap == 0 ? 64 : deferred->cap * 2);
+		deferred->streams = realloc(deferred->streams, 
+			deferred->cap * sizeof(struct deferred_stream));
+	}
+
+	struct deferred_stream *stream = &deferred->streams[deferred->count++];
+	stream->src = juggler_keep(src);
+	stream->src_num = src_num;
+	stream->src_gen = src_gen;
+	stream->dest_num = dest_num;
+	deferred->pending++;
+
+	copy_map_set(deferred->by_dest, dest_num, deferred->count);
+}
+
+/* a stream that can't be copied keeps its source, so the next flush tries 
+   again instead of leaving the stream empty */
+static ErrorCode flush_stream(juggler_t *juggler, struct deferred_stream *stream)
+{
+	if(stream->src == NULL)
+		return(NoError);
+
+	ErrorCode result = copy_stream_data(stream->src->ctx, stream->src->pdf, 
+		stream->src_num, stream->src_gen, 
+		juggler->ctx, juggler->pdf, stream->dest_num);
+	if(result != NoError)
+		return(result);
+
+	release_stream(stream);
+	juggler->deferred->pending--;
+	return(NoError);
+}
+
+ErrorCode juggler_flush_deferred_streams(juggler_t *juggler)
+{
+	struct deferred_streams *deferred = juggler->deferred;
+	if(deferred->count == 0)
+		return(NoError);
+
+	ErrorCode result = NoError;
+	size_t i;
+	for(i = 0; i < deferred->count; i++) {
+		ErrorCode stream_result = flush_stream(juggler, &deferred->streams[i]);
+		if(result == NoError)
+			result = stream_result;
+	}
+
+	if(result == NoError)
+		reset(deferred);
+	return(result);
+}
+
+static int is_skipped_key(fz_context *ctx, pdf_obj *key)
+{
+	size_t i;
+	for(i = 0; i < sizeof(skipped_keys) / sizeof(skipped_keys[0]); i++) {
+		if(!strcmp(pdf_to_name(ctx, key), skipped_keys[i]))
+			return(1);
+	}
+	return(0);
+}
+
+/* pushes num and gen of all references in obj that have not been seen yet 
+   to to_visit */
+static void collect_refs(fz_context *ctx, pdf_obj *obj, struct copy_map *seen, 
+	int **to_visit, size_t *count, size_t *cap)
+{
+	if(pdf_is_indirect(ctx, obj)) {
+		int num = pdf_to_num(ctx, obj);
+		if(copy_map_get(seen, num) != 0)
+			return;
+		copy_map_set(seen, num, 1);
+
+		if(*count + 2 > *cap) {
+			*cap *= 2;
+			*to_visit = realloc(*to_visit, *cap * sizeof(int));
+		}
+		(*to_visit)[(*count)++] = num;
+		(*to_visit)[(*count)++] = pdf_to_gen(ctx, obj);
+	} else if(pdf_is_array(ctx, obj)) {
+		int i;
+		for(i = 0; i < pdf_array_len(ctx, obj); i++)
+			collect_refs(ctx, pdf_array_get(ctx, obj, i), seen, to_visit, count, cap);
+	} else if(pdf_is_dict(ctx, obj)) {
+		int i;
+		for(i = 0; i < pdf_dict_len(ctx, obj); i++) {
+			if(!is_skipped_key(ctx, pdf_dict_get_key(ctx, obj, i))) {
+				collect_refs(ctx, pdf_dict_get_val(ctx, obj, i), 
+					seen, to_visit, count, cap);
+			}
+		}
+	}
+}
+
+ErrorCode juggler_flush_page_streams(juggler_t *juggler, int pagenum)
+{
+	fz_context *ctx = juggler->ctx;
+	struct deferred_streams *deferred = juggler->deferred;
+	if(deferred->pending == 0)
+		return(NoError);
+
+	/* inherited resources are found through the page's attributes */
+	page_attrs_t attrs;
+	ErrorCode result = 
+		juggler_resolve_page_attrs(ctx, juggler->pdf, pagenum, 1, &attrs);
+	if(result != NoError)
+		return(result);
+
+	size_t count = 0, cap = 64;
+	int *to_visit = malloc(cap * sizeof(int));
+	struct copy_map *seen = 
+		copy_map_new(pdf_xref_len(ctx, juggler->pdf), COPY_MAP_UNKNOWN);
+
+	collect_refs(ctx, attrs.page, seen, &to_visit, &count, &cap);
+	collect_refs(ctx, attrs.resources, seen, &to_visit, &count, &cap);
+
+	while(count > 0 && deferred->pending > 0) {
+		int gen = to_visit[--count];
+		int num = to_visit[--count];
+
+		int index = copy_map_get(deferred->by_dest, num);
+		if(index != 0) {
+			ErrorCode stream_result = 
+				flush_stream(juggler, &deferred->streams[index - 1]);
+			if(result == NoError)
+				result = stream_result;
+		}
+
+		pdf_obj *obj = pdf_load_object(ctx, juggler->pdf, num, gen);
+		collect_refs(ctx, obj, seen, &to_visit, &count, &cap);
+		pdf_drop_obj(ctx, obj);
+	}
+
+	copy_map_delete(seen);
+	free(to_visit);
+	return(result);
+}
@@ -0,0 +1,47 @@
+/*
+  deferred-streams.h - copy the data of imported streams when it is needed
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JUGGLER_DEFERRED_STREAMS_H_
+#define _JUGGLER_DEFERRED_STREAMS_H_
+
+#include "document.h"
+
+/* importing pages copies the dicts of their streams at once, but the data of
+   the streams (images, fonts, ...) stays in the source document until the 
+   page is rendered or the document is saved; until then the source is kept 
+   open */
+
+struct deferred_streams;
+
+extern struct deferred_streams *deferred_streams_new(void);
+
+/* releases the source documents without copying anything */
+extern void deferred_streams_delete(struct deferred_streams *deferred);
+
+/* the data of the stream src_num of src will be copied to dest_num */
+extern void deferred_streams_add(struct deferred_streams *deferred, 
+	juggler_t *src, int src_num, int src_gen, int dest_num);
+
+/* copies all streams that have not been copied yet; streams whose data 
+   can't be read stay deferred and ErrorStreamCopy is returned */
+extern ErrorCode juggler_flush_deferred_streams(juggler_t *juggler);
+
+/* copies only the streams the page needs to be drawn */
+extern ErrorCode juggler_flush_page_streams(juggler_t *juggler, int pagenum);
+
+#endif /* _JUGGLER_DEFERRED_STREAMS_H_ */
@@ -18,13 +18,44 @@
 
 #include "document.h"
 
+#include <pthread.h>
+
 #include "internal.h"
+#include "render-cache.h"
+#include "render-pool.h"
+#include "list-cache.h"
+#include "page-geometry.h"
+#include "deferred-streams.h"
+#include "copy-dedup.h"
+#include "copy-helper.h"
+#include "copy-readers.h"
+
+/* MuPDF needs those to let the render-threads share the context's 
+   resources */
+static pthread_mutex_t context_mutexes[FZ_LOCK_MAX];
+
+static void lock_context(void *user, int lock)
+{
+	pthread_mutex_lock(&((pthread_mutex_t *) user)[lock]);
+}
+
+static void unlock_context(void *user, int lock)
+{
+	pthread_mutex_unlock(&((pthread_mutex_t *) user)[lock]);
+}
+
+static fz_locks_context context_locks = 
+	{ context_mutexes, lock_context, unlock_context };
 
 ErrorCode juggler_init(fz_context **init_data)
 {
 	fz_context *ctx;
 
-	if((ctx = fz_new_context(NULL, NULL, FZ_STORE_UNLIMITED)) == NULL) {
+	int i;
+	for(i = 0; i < FZ_LOCK_MAX; i++)
+		pthread_mutex_init(&context_mutexes[i], NULL);
+
+	if((ctx = fz_new_context(NULL, &context_locks, FZ_STORE_UNLIMITED)) == NULL) {
 	  fprintf(stderr, "fz_new_context() failed\n");
 	  return(ErrorNewContext);
 	}
@@ -35,7 +66,12 @@ ErrorCode juggler_init(fz_context **init_data)
 
 ErrorCode juggler_open(fz_context *ctx, char *filename, juggler_t **juggler)
 {
+	file_id_t file_id;
+	file_id_get(filename, &file_id);
 	pdf_document *doc = pdf_open_document(ctx, filename);
+	/* replaced in between? then nobody knows which one MuPDF has got */
+	if(!file_id_unchanged(filename, &file_id))
+		file_id.valid = 0;
 
 	if(pdf_needs_password(ctx, doc)) {
 		fprintf(stderr, "pdf_needs_password(): Cannot handle password-protected files\n");
@@ -45,22 +81,50 @@ ErrorCode juggler_open(fz_context *ctx, char *filename, juggler_t **juggler)
 	*juggler = (juggler_t *) malloc(sizeof(juggler_t));
 	(*juggler)->pdf = doc;
 	(*juggler)->ctx = ctx;
+	(*juggler)->geometry = page_geometry_new();
+	(*juggler)->cache = render_cache_new(ctx, RENDER_CACHE_DEFAULT_BUDGET);
+	(*juggler)->pool = NULL;
+	(*juggler)->lists = list_cache_new(ctx, LIST_CACHE_DEFAULT_PAGES);
+	(*juggler)->render_notify = NULL;
+	(*juggler)->render_notify_data = NULL;
+	(*juggler)->deferred = deferred_streams_new();
+	(*juggler)->imported = copy_dedup_new();
+	(*juggler)->refs = 1;
+	(*juggler)->generation = 0;
+	(*juggler)->skipped_num = 0;
+	(*juggler)->import_order = COPY_ORDER_FILE;
+	(*juggler)->import_threads = render_pool_default_threads();
+	(*juggler)->filename = strdup(filename);
+	(*juggler)->file_id = file_id;
+	(*juggler)->readers = NULL;
 	juggler_page_tree_changed(*juggler);
+	(*juggler)->edited = 0;
 
 	return(NoError);
 }
 
+juggler_t *juggler_keep(juggler_t *juggler)
+{
+	juggler->refs++;
+	return(juggler);
+}
+
 ErrorCode juggler_close(juggler_t *juggler)
 {
-	// TODO: Move to render.c
-	free(juggler->sizes);
-	size_t i;
-	for(i = 0; i < RENDER_BUFFER_COUNT; i++) {
-		if(juggler->rendered[i].samples != NULL) {
-			printf("Attempting to drop pixmap #%d: %p\n", i, juggler->rendered[i].pixmap);
-			fz_drop_pixmap(juggler->ctx, juggler->rendered[i].pixmap);
-		}
-	}
+	if(--juggler->refs > 0)
+		return(NoError);
+
+	page_geometry_delete(juggler->geometry);
+	/* the workers may still hold results for the cache */
+	if(juggler->pool != NULL)
+		render_pool_delete(juggler->pool);
+	render_cache_delete(juggler->cache);
+	list_cache_delete(juggler->lists);
+	deferred_streams_delete(juggler->deferred);
+	copy_dedup_delete(juggler->imported);
+	if(juggler->readers != NULL)
+		copy_readers_close(juggler->readers);
+	free(juggler->filename);
 
 	pdf_close_document(juggler->ctx, juggler->pdf);
 	free(juggler);
@@ -79,8 +143,28 @@ ErrorCode juggler_save(juggler_t *juggler, char *filename)
 	write_options.do_linear = 0;
 	write_options.do_clean = 0;
 	write_options.continue_on_error = 0;
+
+	/* MuPDF can only write streams it has got in memory or in this file, 
+	   and a stream without its data must not end up in the file */
+	ErrorCode result = juggler_flush_deferred_streams(juggler);
+	if(result != NoError)
+		return(result);
 	
 	pdf_write_document(juggler->ctx, juggler->pdf, filename, &write_options);
 
+	/* the garbage collection may have dropped imported objects, so nobody 
+	   must reuse them */
+	copy_dedup_delete(juggler->imported);
+	juggler->imported = copy_dedup_new();
+	juggler->generation++;
+	juggler->skipped_num = 0;
+
+	/* the readers may have opened the file that has just been replaced */
+	if(juggler->readers != NULL) {
+		copy_readers_close(juggler->readers);
+		juggler->readers = NULL;
+	}
+	copy_readers_forget(filename);
+
 	return(NoError);
 }
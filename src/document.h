@@ -19,26 +19,45 @@
 #ifndef _JUGGLER_DOCUMENT_H_
 #define _JUGGLER_DOCUMENT_H_
 
-#include "document.h"
-#include "render.h"
 #include "error.h"
+#include "file-id.h"
 
 #include <mupdf/fitz.h>
 #include <mupdf/pdf.h>
 
 struct juggler_redo;
+struct page_geometry;
+struct render_cache;
+struct render_pool;
+struct list_cache;
+struct deferred_streams;
+struct copy_dedup;
 
-#define RENDER_BUFFER_COUNT 4
 typedef struct
 {
 	pdf_document *pdf; // MuPDF's data
 	int pagecount;
-	page_size *sizes;
-	render_data_t rendered[RENDER_BUFFER_COUNT]; // already rendered pages/parts of pages
-	size_t recent_rendered;
+	struct page_geometry *geometry; // sizes and positions of all pages
+	struct render_cache *cache; // already rendered pages/parts of pages
+	struct render_pool *pool; // started with the first background render
+	struct list_cache *lists; // recorded pages, replayed for each render
+	void (*render_notify)(int pagenum, void *user_data);
+	void *render_notify_data;
 
 	struct juggler_redo *redo;
 	fz_context *ctx;
+	struct deferred_streams *deferred; // imported streams without data yet
+	struct copy_dedup *imported; // fingerprints of all imported objects
+	int refs;
+	unsigned int generation; // changes when object numbers may be freed
+	int import_order; // COPY_ORDER_* for copies from other documents
+	int import_threads; // to parse the sources of imports, 0 for none
+	int skipped_num; // the null that skipped objects of imports become, or 0
+
+	char *filename;
+	file_id_t file_id; // what filename has been when it was opened
+	int edited; // if not, the file on disk is the same as pdf
+	struct copy_readers *readers; // parse this file for imports from it
 } juggler_t;
 
 /* initialize all components, must be called before anything else */
@@ -53,6 +72,10 @@ extern ErrorCode juggler_save(juggler_t *juggler, char *filename);
 /* close the document and free all additional structures */
 extern ErrorCode juggler_close(juggler_t *juggler);
 
+/* another document still needs juggler (e. g. to copy streams from it), so 
+   it only gets closed after a juggler_close() for each juggler_keep() */
+extern juggler_t *juggler_keep(juggler_t *juggler);
+
 #endif /* _JUGGLER_DOCUMENT_H_ */
 
 
@@ -34,7 +34,12 @@ typedef enum {
 	ErrorNoRoot, 
 	ERROR_NO_PAGES, 
 	ERROR_INVALID_RANGE,
-	ErrorInvalidReference // a reference object seen by the function is invalid
+	ErrorInvalidReference, // a reference object seen by the function is invalid
+	ErrorRenderPending, // the page will be rendered in the background
+	ErrorRenderPreview, // only a fast preview is ready, the real one follows
+	ErrorRenderCancelled, // the render has been aborted with its cookie
+	ErrorRenderFailed, // MuPDF could not render the page
+	ErrorStreamCopy // the data of an imported stream could not be read
 } ErrorCode;
 
 #endif /* _JUGGLER_ERROR_H_ */
@@ -23,6 +23,7 @@
 #include "export-images.h"
 
 #include "internal.h"
+#include "deferred-streams.h"
 
 #define COPY_BUFFERSIZE (64 * 1024)
 
@@ -683,6 +684,8 @@ static int export_page_images(fz_context *ctx, pdf_document *doc,
 ErrorCode juggler_export_images(juggler_t *juggler, const char *path)
 {
 	printf("Starting with exporting images...\n");
+	if(juggler_flush_deferred_streams(juggler) != NoError)
+		return(ErrorStreamCopy);
 	
 	for(int i = 0; i < pdf_count_pages(juggler->ctx, juggler->pdf); i++)
 		export_page_images(juggler->ctx, juggler->pdf, path, i);
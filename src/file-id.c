@@ -0,0 +1,54 @@
+/*
+  file-id.c - tell if a file on disk has been replaced or rewritten
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "file-id.h"
+
+#include <sys/stat.h>
+
+int file_id_get(const char *filename, file_id_t *id)
+{
+	struct stat info;
+	if(stat(filename, &info) != 0) {
+		id->valid = 0;
+		return(0);
+	}
+
+	id->valid = 1;
+	id->dev = info.st_dev;
+	id->ino = info.st_ino;
+	id->size = info.st_size;
+	id->mtime = info.st_mtim;
+
+	return(1);
+}
+
+int file_id_equal(const file_id_t *a, const file_id_t *b)
+{
+	return(a->valid && b->valid && 
+		a->dev == b->dev && a->ino == b->ino && a->size == b->size && 
+		a->mtime.tv_sec == b->mtime.tv_sec && 
+		a->mtime.tv_nsec == b->mtime.tv_nsec);
+}
+
+int file_id_unchanged(const char *filename, const file_id_t *id)
+{
+	file_id_t now;
+	file_id_get(filename, &now);
+	return(file_id_equal(id, &now));
+}
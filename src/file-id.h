@@ -0,0 +1,46 @@
+/*
+  file-id.h - tell if a file on disk has been replaced or rewritten
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _JUGGLER_FILE_ID_H_
+#define _JUGGLER_FILE_ID_H_
+
+#include <sys/types.h>
+#include <time.h>
+
+/* the identity of a file as stat() sees it; renaming another file over it 
+   changes dev/ino, writing it in place changes size and/or mtime */
+typedef struct
+{
+	int valid; // 0 if stat() failed
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+} file_id_t;
+
+/* fills id with the current identity of the file, id->valid is 0 if the 
+   file cannot be stat'ed; returns id->valid */
+extern int file_id_get(const char *filename, file_id_t *id);
+
+/* is the file still the one of id? never if id is not valid */
+extern int file_id_unchanged(const char *filename, const file_id_t *id);
+
+extern int file_id_equal(const file_id_t *a, const file_id_t *b);
+
+#endif /* _JUGGLER_FILE_ID_H_ */
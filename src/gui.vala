@@ -34,38 +34,81 @@ public struct RenderData {
 	public void *pixmap; // out -> unused here
 	public double zoom; // in
 	public int pagenum; // in
+	public int rotation; // in
 	public int x; // in/out
 	public int y; // in/out
 	public int width; // in/out
 	public int height; // in/out
-}
-
-public struct PageSize {
-	public int x;
-	public int width;
-	public int height;
+	public int quality; // in, 0 = full, 1 = preview
 }
 
 public struct JugglerCDoc {
 	public void *pdf_doc;
 	public int pageCount;
-	public PageSize *pageSizes;
-	public RenderData rendered[5];
+	public void *pageGeometry;
+	public void *renderCache;
+}
+
+public struct RenderCacheStats {
+	public size_t hits;
+	public size_t misses;
+	public size_t evictions;
+	public size_t entries;
+	public size_t bytesUsed;
+	public size_t bytesBudget;
+}
+
+public struct ImportStats {
+	public size_t lookups;
+	public size_t hits;
+	public size_t unhashable;
+	public size_t bytesSaved;
+	public size_t objectsRead;
+	public size_t seeks;
+	public size_t bytesSpanned;
 }
 
 public enum JugglerErrorCode { NoError, ErrorUsage, ErrorNewContext, ErrorPasswordProtected,
 			   ErrorTrailerNoDict, ErrorCatalogNoDict, ErrorCacheObject,
 			   ErrorEntryNoObject, ErrorNoInfo, NoMemoryError, 
 			   NoDfocumentInfoExists, ErrorNoRoot, ErrorNoPages, 
-			   ErrorInvalidRange }
+			   ErrorInvalidRange, ErrorInvalidReference, ErrorRenderPending,
+			   ErrorRenderPreview, ErrorRenderCancelled,
+			   ErrorRenderFailed, ErrorStreamCopy }
+
+// must be the same as RENDER_PRIORITY_* in render.h
+public enum RenderPriority { Visible, Neighbour }
+
+[CCode (has_target = true)]
+public delegate void RenderReadyFunc(int pagenum);
 
 
 extern int juggler_init(void **init_data);
 extern int juggler_open(void *init_data, string filename, JugglerCDoc **document);
-extern int juggler_save(JugglerCDoc *document, string filename);
+extern JugglerErrorCode juggler_save(JugglerCDoc *document, string filename);
+extern JugglerErrorCode juggler_rebuild_page_tree(JugglerCDoc *document, int fanout);
+extern JugglerErrorCode juggler_balance_page_tree(JugglerCDoc *document, int fanout);
 extern int juggler_close(JugglerCDoc *document);
-extern int render_page(JugglerCDoc *document, RenderData *data);
+extern int render_page(JugglerCDoc *document, RenderData *data, void *cookie);
+extern JugglerErrorCode render_page_async(JugglerCDoc *document, RenderData *data, 
+										  RenderPriority priority);
+extern JugglerErrorCode juggler_set_render_notify(JugglerCDoc *document, RenderReadyFunc notify);
+extern JugglerErrorCode juggler_cancel_queued_renders(JugglerCDoc *document);
+extern JugglerErrorCode juggler_cancel_renders_outside(JugglerCDoc *document, int first, int last);
 extern void free_rendered_data(JugglerCDoc *document, RenderData *data);
+extern JugglerErrorCode juggler_set_render_cache_budget(JugglerCDoc *document, size_t budget);
+extern JugglerErrorCode juggler_get_render_cache_stats(JugglerCDoc *document, RenderCacheStats *stats);
+
+extern int juggler_get_page_x(JugglerCDoc *document, int index);
+extern int juggler_get_page_width(JugglerCDoc *document, int index);
+extern int juggler_get_page_height(JugglerCDoc *document, int index);
+extern double juggler_get_page_offset(JugglerCDoc *document, int index, double zoom);
+extern double juggler_get_pages_extent(JugglerCDoc *document, double zoom);
+extern int juggler_find_page(JugglerCDoc *document, double offset, double zoom);
+extern JugglerErrorCode juggler_ensure_page_sizes(JugglerCDoc *document, int index, int count, 
+												  int *measured);
+extern JugglerErrorCode juggler_refine_page_sizes(JugglerCDoc *document, int maxPages, 
+												  int *remaining);
 
 extern int juggler_get_info_obj_num(JugglerCDoc *juggler, int *num, int *gen);
 extern int juggler_get_root_obj_num(JugglerCDoc *juggler, int *num, int *gen);
@@ -77,11 +120,29 @@ extern JugglerErrorCode juggler_remove_page(JugglerCDoc *juggler, int pagenum);
 extern JugglerErrorCode juggler_remove_pages(JugglerCDoc *juggler, 
 										int firstIndex, int lastIndex);
 extern int juggler_add_pages_from_file(JugglerCDoc *dest, JugglerCDoc *src, int posIndex);
+extern JugglerErrorCode juggler_import_session_open(JugglerCDoc *dest, JugglerCDoc *src, 
+													void **session);
+extern void juggler_import_session_close(void *session);
+extern JugglerCDoc *juggler_import_session_source(void *session);
+extern bool juggler_import_session_is_current(void *session);
+extern JugglerErrorCode juggler_import_pages(void *session, void *pageSet, int posIndex);
+extern JugglerErrorCode juggler_get_import_stats(JugglerCDoc *document, ImportStats *stats);
 
 extern JugglerErrorCode juggler_get_page_rotation(JugglerCDoc *juggler, int index, int *rotation);
 extern JugglerErrorCode juggler_set_page_rotation(JugglerCDoc *juggler, int index, int rotation);
+extern JugglerErrorCode juggler_rotate_page_set(JugglerCDoc *juggler, void *pageSet, 
+												int angle, bool relative);
+extern JugglerErrorCode juggler_permute_pages(JugglerCDoc *juggler, int[] newOrder);
+extern JugglerErrorCode juggler_move_pages(JugglerCDoc *juggler, int first, int last, int destIndex);
+
+extern void *page_set_new(int pageCount);
+extern void page_set_delete(void *pageSet);
+extern void page_set_add_range(void *pageSet, int first, int last);
 
-extern JugglerErrorCode juggler_put_page_contents(JugglerCDoc *juggler, string filename);
+// must be the same as PUT_MODE_* in put-content.h
+public enum PutMode { Rewrite, Forms }
+
+extern JugglerErrorCode juggler_put_page_contents(JugglerCDoc *juggler, string filename, PutMode mode);
 
 extern JugglerErrorCode juggler_export_images(JugglerCDoc *juggler, string path);
 
@@ -138,6 +199,7 @@ public class Juggler : Window {
 	Gtk.MenuItem documentAddPages;
 	Gtk.MenuItem documentRotatePages;
 	Gtk.MenuItem documentPutPageContents;
+	Gtk.MenuItem documentPutPageForms;
 
 	void *initData;
 
@@ -202,6 +264,10 @@ public class Juggler : Window {
 		documentPutPageContents.activate.connect(OnDocumentPutPageContents);
 		documentMenu.add(documentPutPageContents);
 
+		documentPutPageForms = new Gtk.MenuItem.with_label("Impose two-on-one (as forms)");
+		documentPutPageForms.activate.connect(OnDocumentPutPageForms);
+		documentMenu.add(documentPutPageForms);
+
 		toolbar = new Toolbar();
 		toolbar.get_style_context().add_class(STYLE_CLASS_PRIMARY_TOOLBAR);
 
@@ -276,7 +342,8 @@ add_events(Gdk.EventMask.SCROLL_MASK);
 		if(filename == null)
 			return;
 		
-		doc.Save(filename);
+		if(!doc.Save(filename, true))
+			StockDialogs.Error(this, "The document could not be saved");
 	}
 	
 	void OnFileExportImages() {
@@ -373,13 +440,22 @@ add_events(Gdk.EventMask.SCROLL_MASK);
 		if(!dlg.Run())
 			return;
 
-		for(int i = dlg.fromIndex; i <= dlg.toIndex; i++) {
-			int newRotation = (doc.GetPageRotation(i) + dlg.degrees) % 360;
-			doc.SetPageRotation(i, newRotation);
+		try {
+			doc.RotatePages(dlg.fromIndex, dlg.toIndex, dlg.degrees);
+		} catch(JugglerError e) {
+			StockDialogs.Error(this, e.message);
 		}
 	}
 
 	void OnDocumentPutPageContents() {
+		PutPageContents(PutMode.Rewrite);
+	}
+
+	void OnDocumentPutPageForms() {
+		PutPageContents(PutMode.Forms);
+	}
+
+	void PutPageContents(PutMode mode) {
 		if(doc == null)
 			return;
 
@@ -387,7 +463,7 @@ add_events(Gdk.EventMask.SCROLL_MASK);
 		if(filename == null)
 			return;
 			
-		doc.PutPageContents(filename);
+		doc.PutPageContents(filename, mode);
 	}
 }
 
@@ -399,6 +475,9 @@ public class JugglerDocument {
 	JugglerCDoc *juggler;
 	void *initData;
 	RenderData *lastRendered;
+	RenderReadyFunc renderNotify; // keeps the target alive while it is set
+	// one per source file, so its fonts and images are only copied once
+	HashTable<string, void *> importSessions;
 
 	public int pageCount {
 		get { return(juggler->pageCount); }
@@ -413,22 +492,20 @@ public class JugglerDocument {
 	public JugglerDocument(void *initData, string filename) {
 		this.initData = initData;
 		lastRendered = null;
+		importSessions = new HashTable<string, void *>(str_hash, str_equal);
 
 		juggler_open(initData, filename, &juggler);
 
 		stdout.printf("Vala Code: I know the pagenum: %d\n", juggler->pageCount);
 
-		for(int i = 0; i < juggler->pageCount; i++) {
-			stdout.printf("[V] Display Box of page %d [ %d %d %d ]\n", i + 1, 
-						  juggler->pageSizes[i].x, 
-						  juggler->pageSizes[i].width, 
-						  juggler->pageSizes[i].height);
-		}
-
 		path = filename;
 	}
 
 	~JugglerDocument() {
+		// the sessions keep this document open
+		importSessions.foreach((file, session) => {
+				juggler_import_session_close(session);
+			});
 		juggler_close(juggler);
 	}
 
@@ -443,35 +520,105 @@ public class JugglerDocument {
 			}
 	}
 
-	public bool Save(string filename) {
-		return(juggler_save(juggler, filename) == 0);
+	// balancePageTree rebuilds the page tree before saving if edits made it
+	// deep and lopsided; a tree that can't be balanced is broken, so nothing
+	// is saved then
+	public bool Save(string filename, bool balancePageTree = false) {
+		if(balancePageTree && 
+		   juggler_balance_page_tree(juggler, 0) != JugglerErrorCode.NoError)
+			return(false);
+		return(juggler_save(juggler, filename) == JugglerErrorCode.NoError);
 	}
 
 	public void Render(RenderData *data) {
-		render_page(juggler, data);
+		render_page(juggler, data, null);
+	}
+
+	// returns false if the page will be rendered in the background, if only
+	// a preview is ready, it is returned and the real one will follow
+	public bool RenderAsync(RenderData *data, RenderPriority priority) {
+		JugglerErrorCode result = render_page_async(juggler, data, priority);
+		return(result == JugglerErrorCode.NoError || 
+			   result == JugglerErrorCode.ErrorRenderPreview);
+	}
+
+	// notify will be called from another thread!
+	public void SetRenderNotify(owned RenderReadyFunc notify) {
+		renderNotify = (owned) notify;
+		juggler_set_render_notify(juggler, renderNotify);
+	}
+
+	public void CancelQueuedRenders() {
+		juggler_cancel_queued_renders(juggler);
+	}
+
+	// also aborts those pages that are currently rendered
+	public void CancelRendersOutside(int first, int last) {
+		juggler_cancel_renders_outside(juggler, first, last);
 	}
 
 	public void FreeRenderData(RenderData *data) {
 		free_rendered_data(juggler, data);
 	}
 
+	public void SetRenderCacheBudget(size_t budget) {
+		juggler_set_render_cache_budget(juggler, budget);
+	}
+
+	public ImportStats GetImportStats() {
+		ImportStats stats = ImportStats();
+		juggler_get_import_stats(juggler, &stats);
+
+		return(stats);
+	}
+
+	public RenderCacheStats GetRenderCacheStats() {
+		RenderCacheStats stats = RenderCacheStats();
+		juggler_get_render_cache_stats(juggler, &stats);
+
+		return(stats);
+	}
+
 	public int GetPageX(int pagenum) {
-		if(pagenum < 0 || pagenum > pageCount)
-			return(-1);
-		return(juggler->pageSizes[pagenum].x);
+		return(juggler_get_page_x(juggler, pagenum));
 	}
 
 
 	public int GetPageHeight(int pagenum) {
-		if(pagenum < 0 || pagenum > pageCount)
-			return(-1);
-		return(juggler->pageSizes[pagenum].height);
+		return(juggler_get_page_height(juggler, pagenum));
 	}
 
 	public int GetPageWidth(int pagenum) {
-		if(pagenum < 0 || pagenum > pageCount)
-			return(-1);
-		return(juggler->pageSizes[pagenum].width);
+		return(juggler_get_page_width(juggler, pagenum));
+	}
+
+	// where the page starts if all pages are zoomed, the gaps between them 
+	// are not
+	public double GetPageOffset(int pagenum, double zoom) {
+		return(juggler_get_page_offset(juggler, pagenum, zoom));
+	}
+
+	public double GetPagesExtent(double zoom) {
+		return(juggler_get_pages_extent(juggler, zoom));
+	}
+
+	public int FindPage(double offset, double zoom) {
+		return(juggler_find_page(juggler, offset, zoom));
+	}
+
+	// the sizes of the pages are only estimated after opening or adding pages,
+	// returns true if one of the pages got another size
+	public bool EnsurePageSizes(int first, int count) {
+		int measured = 0;
+		juggler_ensure_page_sizes(juggler, first, count, &measured);
+		return(measured > 0);
+	}
+
+	// returns true if there are still pages with an estimated size
+	public bool RefinePageSizes(int maxPages) {
+		int remaining = 0;
+		juggler_refine_page_sizes(juggler, maxPages, &remaining);
+		return(remaining != 0);
 	}
 
 	public void GetRootNum(out int num, out int gen) {
@@ -518,10 +665,43 @@ public class JugglerDocument {
 		DocumentChanged();
 	}
 
+	void *GetImportSession(string srcFile) {
+		void *session = importSessions.lookup(srcFile);
+		// the file has been saved over (maybe by another document), so the
+		// session would import from the old one
+		if(session != null && !juggler_import_session_is_current(session)) {
+			importSessions.remove(srcFile);
+			juggler_import_session_close(session);
+			session = null;
+		}
+		if(session == null) {
+			JugglerDocument doc = new JugglerDocument(initData, srcFile);
+			juggler_import_session_open(juggler, doc.juggler, &session);
+			importSessions.insert(srcFile, session);
+		}
+
+		return(session);
+	}
+
 	public void AddPages(string srcFile, int posIndex) throws JugglerError {
-		JugglerDocument doc = new JugglerDocument(initData, srcFile);
-		juggler_add_pages_from_file(juggler, doc.juggler, posIndex);
+		JugglerErrorCode result = 
+			juggler_import_pages(GetImportSession(srcFile), null, posIndex);
+
+		HandleErrors(result);
+		DocumentChanged();
+	}
+
+	// copies only the pages from firstSrc to lastSrc of srcFile
+	public void AddPageRange(string srcFile, int firstSrc, int lastSrc, 
+		int posIndex) throws JugglerError
+	{
+		void *session = GetImportSession(srcFile);
+		void *pageSet = page_set_new(juggler_import_session_source(session)->pageCount);
+		page_set_add_range(pageSet, firstSrc, lastSrc);
+		JugglerErrorCode result = juggler_import_pages(session, pageSet, posIndex);
+		page_set_delete(pageSet);
 
+		HandleErrors(result);
 		DocumentChanged();
 	}
 
@@ -532,13 +712,40 @@ public class JugglerDocument {
 		return(rotation);
 	}
 
+	// page i will be the page that had the index newOrder[i] before
+	public void PermutePages(int[] newOrder) throws JugglerError {
+		HandleErrors(juggler_permute_pages(juggler, newOrder));
+		DocumentChanged();
+	}
+
+	public void MovePages(int firstIndex, int lastIndex, int destIndex) 
+		throws JugglerError
+	{
+		HandleErrors(juggler_move_pages(juggler, firstIndex, lastIndex, destIndex));
+		DocumentChanged();
+	}
+
+	// adds degrees to the rotation of all pages from firstIndex to lastIndex
+	public void RotatePages(int firstIndex, int lastIndex, int degrees) 
+		throws JugglerError
+	{
+		void *pageSet = page_set_new(pageCount);
+		page_set_add_range(pageSet, firstIndex, lastIndex);
+		JugglerErrorCode result = 
+			juggler_rotate_page_set(juggler, pageSet, degrees, true);
+		page_set_delete(pageSet);
+
+		HandleErrors(result);
+		DocumentChanged();
+	}
+
 	public void SetPageRotation(int index, int rotation) {
 		HandleErrors(juggler_set_page_rotation(juggler, index, rotation));
 		DocumentChanged();
 	}
 
-	public void PutPageContents(string filename) {
-		juggler_put_page_contents(juggler, filename);
+	public void PutPageContents(string filename, PutMode mode) {
+		juggler_put_page_contents(juggler, filename, mode);
 		//DocumentChanged();
 	}
 
@@ -560,6 +767,8 @@ private struct LayoutedPage {
 public class JugglerView : DrawingArea, Scrollable {
 	const int PagePadding = 10; // padding between two subsequent pages
 	const int PerScrollMove = 25; // how much to move on mouse-scrolling
+	const int TileSize = 256; // same as RENDER_TILE_SIZE in render.h
+	const int RefineBatch = 512; // pages measured per idle-call
 
 	JugglerDocument doc;
 
@@ -574,15 +783,21 @@ public class JugglerView : DrawingArea, Scrollable {
 			if(value < 0 || value >= doc.pageCount)
 				return;
 
-			vadjustmentData.value = layoutedPages.index(value).y;
+			vadjustmentData.value = GetLayoutedPage(value).y;
 
 			queue_draw();
 		}
 	}
 
-	private Array<LayoutedPage?> layoutedPages;
 	private bool needsRelayout;
 
+	// what the last call to OnDraw() showed
+	private double drawnScrollY = -1;
+	private double drawnLeft = -1;
+	private double drawnZoom = -1;
+	private uint refineSource; // measures the pages in the background
+	private bool needsRefine; // but only after the visible ones are drawn
+
 	private Allocation currentAllocation;
 
 	private Adjustment hadjustmentData;
@@ -626,7 +841,7 @@ public class JugglerView : DrawingArea, Scrollable {
 	public signal void PageChanged(int newPageIndex);
 	public signal void ZoomChanged(int zoomPercentage);
 
-	const int Padding = 10; // Padding between pages
+	const int Padding = 10; // Padding between pages, same as PAGE_GEOMETRY_GAP in page-geometry.h
 
 	int allocX;
 	int allocY;
@@ -645,7 +860,6 @@ public class JugglerView : DrawingArea, Scrollable {
 		hscroll_policy = ScrollablePolicy.MINIMUM;
 		hadjustmentData = null;
 
-		layoutedPages = new Array<LayoutedPage?>(); // TODO: Create this array item's once for every document, not on every zoom/...
 		needsRelayout = true;
 
 		
@@ -658,13 +872,10 @@ public class JugglerView : DrawingArea, Scrollable {
 
 	public void VAdjustmentChanged() {
 		// find active page
-		// TODO: Make this a bit better... but what is the best way???
-		for(int i = 0; i < doc.pageCount; i++) {
-			if(layoutedPages.index(i).y + layoutedPages.index(i).height > vadjustment.value) {
-				currentPageData = i;
-				PageChanged(i);
-				break;
-			}
+		int page = doc.FindPage(vadjustment.value - Padding, zoom);
+		if(page >= 0) {
+			currentPageData = page;
+			PageChanged(page);
 		}
 
 		queue_draw();
@@ -679,17 +890,59 @@ public class JugglerView : DrawingArea, Scrollable {
 		doc.DocumentChanged.disconnect(OnDocumentChanged);
 		doc = newDoc;
 		newDoc.DocumentChanged.connect(OnDocumentChanged);
+		newDoc.SetRenderNotify(OnPageRendered);
 
 		zoom = 1.0;
 		LayoutPages();
 		currentPage = 0;
+		needsRefine = true;
+
+		queue_draw();
+	}
+
+	// the pages have estimated sizes at first, so measure them while the 
+	// user can already look at the document
+	void StartRefining() {
+		needsRefine = false;
+		if(refineSource != 0)
+			return;
+
+		refineSource = Idle.add(() => {
+				bool more = doc.RefinePageSizes(RefineBatch);
+				RelayoutKeepingPosition();
+				if(!more)
+					refineSource = 0;
+				return(more);
+			});
+	}
 
+	// pages before the current one may have changed their size, but what the
+	// user looks at should stay where it is
+	void RelayoutKeepingPosition() {
+		if(vadjustmentData == null || currentPageData >= doc.pageCount) {
+			LayoutPages();
+			queue_draw();
+			return;
+		}
+
+		double offset = vadjustmentData.value - GetLayoutedPage(currentPageData).y;
+		LayoutPages();
+		vadjustmentData.value = GetLayoutedPage(currentPageData).y + offset;
 		queue_draw();
 	}
 
+	// called by the render threads, so just redraw from the main loop
+	void OnPageRendered(int pagenum) {
+		Idle.add(() => {
+				queue_draw();
+				return(false);
+			});
+	}
+
 	void OnDocumentChanged() {
 		// TODO: Call LayoutPages()
 		needsRelayout = true;
+		needsRefine = true; // e. g. added pages only have estimated sizes
 		queue_draw();
 	}
 
@@ -707,49 +960,65 @@ public class JugglerView : DrawingArea, Scrollable {
 			double maxX = 0;
 
 			// we just use ints to prevent aliasing
+			double visibleLeft;
 			if((hadjustment.upper - hadjustment.lower) <= hadjustment.page_size)
-				context.translate((int) visibleWidth / 2, (int) (- scrollPosY));
+				visibleLeft = - (int) visibleWidth / 2;
 			else
-				context.translate((int) (- hadjustment.value), (int) (- scrollPosY));
+				visibleLeft = (int) hadjustment.value;
+			context.translate((int) (- visibleLeft), (int) (- scrollPosY));
 			
 
 			context.set_source_rgba(0.2, 0.2, 0.2, 1.0); // make a nice background
 			context.paint();
 
-			for(int i = 0; i < doc.pageCount; i++) {
-				if(layoutedPages.index(i).y + layoutedPages.index(i).height < scrollPosY)
+			// the visible pages need their real sizes before they are drawn
+			EnsureVisiblePageSizes(visibleHeight);
+
+			// everything that is not visible anymore may wait, but only if 
+			// something else is visible now: redraws because a tile is ready
+			// must not abort the others
+			if(scrollPosY != drawnScrollY || visibleLeft != drawnLeft || 
+				zoom != drawnZoom)
+			{
+				doc.CancelQueuedRenders();
+				drawnScrollY = scrollPosY;
+				drawnLeft = visibleLeft;
+				drawnZoom = zoom;
+			}
+
+			int firstVisible = -1;
+			int lastVisible = -1;
+			for(int i = FirstVisiblePage(); i >= 0 && i < doc.pageCount; i++) {
+				LayoutedPage page = GetLayoutedPage(i);
+				if(page.y + page.height < scrollPosY)
 					continue;
-				if(layoutedPages.index(i).y > scrollPosY + visibleHeight)
+				if(page.y > scrollPosY + visibleHeight)
 				  break;
 
-				if(layoutedPages.index(i).x - Padding < minX)
-					minX = layoutedPages.index(i).x - Padding;
-				if(layoutedPages.index(i).x + layoutedPages.index(i).width + Padding * 2 > maxX)
-					maxX = layoutedPages.index(i).x + layoutedPages.index(i).width + Padding;
+				if(page.x - Padding < minX)
+					minX = page.x - Padding;
+				if(page.x + page.width + Padding * 2 > maxX)
+					maxX = page.x + page.width + Padding;
 
-				stdout.printf("Drawing page %d\n", i);
+				DrawPageTiles(context, i, visibleLeft, visibleWidth, visibleHeight);
 
-				RenderData data = RenderData();
-				data.pagenum = i;
-				data.zoom = zoom;
-				data.x = 0;
-				data.y = 0;
-				data.width = 1;
-				data.height = 1;
-				doc.Render(&data);
-
-				context.set_antialias(Antialias.NONE);
-				ImageSurface surface = new ImageSurface.for_data(
-					(uchar []) data.samples, Cairo.Format.ARGB32, 
-					data.width, data.height, data.width * 4);
+				if(firstVisible < 0)
+					firstVisible = i;
+				lastVisible = i;
+			}
 
-				context.set_source_surface(surface, (int) layoutedPages.index(i).x, 
-										   (int) layoutedPages.index(i).y);
-				context.paint();
+			// pages that have been scrolled away don't need to be finished
+			doc.CancelRendersOutside(firstVisible - 1, lastVisible + 1);
 
-				doc.FreeRenderData(&data);
-			}
+			// render the pages around the visible ones in advance
+			if(firstVisible > 0)
+				QueuePageTiles(firstVisible - 1, visibleLeft, visibleWidth, visibleHeight);
+			if(lastVisible >= 0 && lastVisible + 1 < doc.pageCount)
+				QueuePageTiles(lastVisible + 1, visibleLeft, visibleWidth, visibleHeight);
 
+			// the first paint only measures the visible pages
+			if(needsRefine)
+				StartRefining();
 
 			if(hadjustmentData != null) {
 
@@ -767,6 +1036,106 @@ public class JugglerView : DrawingArea, Scrollable {
 		return true;
     }
 
+	// the pages before it are all above the visible area
+	int FirstVisiblePage() {
+		return(doc.FindPage(scrollPosY - Padding, zoom));
+	}
+
+	void EnsureVisiblePageSizes(double visibleHeight) {
+		int first = -1;
+		int last = -1;
+		for(int i = FirstVisiblePage(); i >= 0 && i < doc.pageCount; i++) {
+			LayoutedPage page = GetLayoutedPage(i);
+			if(page.y + page.height < scrollPosY)
+				continue;
+			if(page.y > scrollPosY + visibleHeight)
+				break;
+			if(first < 0)
+				first = i;
+			last = i;
+		}
+
+		if(first >= 0 && doc.EnsurePageSizes(first, last - first + 1))
+			RelayoutKeepingPosition();
+	}
+
+	// only render those tiles of the page that are visible, so that high 
+	// zoom levels don't need a pixmap of the whole page
+	void DrawPageTiles(Context context, int pagenum, double visibleLeft, 
+		double visibleWidth, double visibleHeight)
+	{
+		LayoutedPage page = GetLayoutedPage(pagenum);
+
+		// the visible part of the page relative to its upper left corner
+		double left = double.max(0, visibleLeft - page.x);
+		double right = double.min(page.width, visibleLeft + visibleWidth - page.x);
+		double top = double.max(0, scrollPosY - page.y);
+		double bottom = double.min(page.height, scrollPosY + visibleHeight - page.y);
+
+		context.set_antialias(Antialias.NONE);
+		for(int y = (int) top / TileSize * TileSize; y < bottom; y += TileSize) {
+			for(int x = (int) left / TileSize * TileSize; x < right; x += TileSize) {
+				RenderData data = RenderData();
+				data.pagenum = pagenum;
+				data.zoom = zoom;
+				data.x = x;
+				data.y = y;
+				data.width = TileSize;
+				data.height = TileSize;
+				if(!doc.RenderAsync(&data, RenderPriority.Visible)) {
+					// show an empty page until the tile is ready
+					context.set_source_rgb(1.0, 1.0, 1.0);
+					context.rectangle((int) page.x + x, (int) page.y + y, 
+						double.min(TileSize, page.width - x), 
+						double.min(TileSize, page.height - y));
+					context.fill();
+					continue;
+				}
+
+				ImageSurface surface = new ImageSurface.for_data(
+					(uchar []) data.samples, Cairo.Format.ARGB32, 
+					data.width, data.height, data.width * 4);
+
+				context.set_source_surface(surface, (int) page.x + data.x, 
+										   (int) page.y + data.y);
+				context.paint();
+
+				doc.FreeRenderData(&data);
+			}
+		}
+	}
+
+	// the page is not visible, but as we might scroll to it soon, the first
+	// screen of it is rendered in the background
+	void QueuePageTiles(int pagenum, double visibleLeft, double visibleWidth, 
+		double visibleHeight)
+	{
+		LayoutedPage page = GetLayoutedPage(pagenum);
+
+		double left = double.max(0, visibleLeft - page.x);
+		double right = double.min(page.width, visibleLeft + visibleWidth - page.x);
+		double top = 0;
+		double bottom = double.min(page.height, visibleHeight);
+		if(page.y + page.height < scrollPosY) { // the page above, show its end
+			top = double.max(0, page.height - visibleHeight);
+			bottom = page.height;
+		}
+
+		for(int y = (int) top / TileSize * TileSize; y < bottom; y += TileSize) {
+			for(int x = (int) left / TileSize * TileSize; x < right; x += TileSize) {
+				RenderData data = RenderData();
+				data.pagenum = pagenum;
+				data.zoom = zoom;
+				data.x = x;
+				data.y = y;
+				data.width = TileSize;
+				data.height = TileSize;
+				if(doc.RenderAsync(&data, RenderPriority.Neighbour))
+					doc.FreeRenderData(&data);
+			}
+		}
+	}
+
 	public bool OnScroll(Gdk.EventScroll event) {
 		if((event.state & Gdk.ModifierType.CONTROL_MASK) != 0) {
 			if(event.direction == Gdk.ScrollDirection.SMOOTH)
@@ -795,24 +1164,24 @@ public class JugglerView : DrawingArea, Scrollable {
 		needsRelayout = true;
 	}
 
+	// the positions come from the page index of the document, so nothing 
+	// has to be done for pages that are not looked at
+	LayoutedPage GetLayoutedPage(int pagenum) {
+		LayoutedPage page = LayoutedPage();
+		page.width = doc.GetPageWidth(pagenum) * zoom;
+		page.x = - page.width / 2;
+		page.height = doc.GetPageHeight(pagenum) * zoom;
+		page.y = Padding + doc.GetPageOffset(pagenum, zoom); // don't zoom Padding
+
+		return(page);
+	}
+
 	public void LayoutPages() {
 		ViewLayout layout = ViewLayout.SinglePage;
 
-		layoutedPages.remove_range(0, layoutedPages.length);
-
 		double currentY = Padding;
-		if(layout == ViewLayout.SinglePage) {
-			for(int i = 0; i < doc.pageCount; i++) {
-				LayoutedPage page = LayoutedPage();
-				page.width = doc.GetPageWidth(i) * zoom;
-				page.x = - page.width / 2;
-				page.height = doc.GetPageHeight(i) * zoom;
-				page.y = currentY;
-				layoutedPages.append_val(page);
-
-				currentY += page.height + Padding; // don't zoom Padding
-			}
-		}
+		if(layout == ViewLayout.SinglePage)
+			currentY += doc.GetPagesExtent(zoom);
 		if(vadjustmentData != null) {
 			vadjustmentData.page_size = get_allocated_height();
 			vadjustmentData.upper = currentY;
@@ -0,0 +1,87 @@
+/*
+  import-session.c - import pages from the same file several times
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "import-session.h"
+
+#include "copy-map.h"
+#include "page-add.h"
+#include "page-set.h"
+
+struct import_session
+{
+	juggler_t *dest;
+	juggler_t *src;
+
+	struct copy_map *new_ids; // NULL until the first import
+	unsigned int dest_generation; // of the dest that new_ids is valid for
+};
+
+ErrorCode juggler_import_session_open(juggler_t *dest, juggler_t *src, 
+	struct import_session **session)
+{
+	*session = calloc(1, sizeof(struct import_session));
+	(*session)->dest = juggler_keep(dest);
+	(*session)->src = juggler_keep(src);
+
+	return(NoError);
+}
+
+void juggler_import_session_close(struct import_session *session)
+{
+	copy_map_delete(session->new_ids);
+	juggler_close(session->src);
+	juggler_close(session->dest);
+	free(session);
+}
+
+juggler_t *juggler_import_session_source(struct import_session *session)
+{
+	return(session->src);
+}
+
+int juggler_import_session_is_current(struct import_session *session)
+{
+	return(file_id_unchanged(session->src->filename, &session->src->file_id));
+}
+
+ErrorCode juggler_import_pages(struct import_session *session, 
+	struct page_set *set, int dest_index)
+{
+	if(session->new_ids != NULL && 
+		session->dest_generation != session->dest->generation)
+	{
+		copy_map_delete(session->new_ids);
+		session->new_ids = NULL;
+	}
+	session->dest_generation = session->dest->generation;
+
+	struct page_set *all = NULL;
+	if(set == NULL) {
+		all = page_set_new(session->src->pagecount);
+		page_set_add_range(all, 0, session->src->pagecount - 1);
+		set = all;
+	}
+
+	ErrorCode result = juggler_add_page_set_from_file_continue(session->dest, 
+		session->src, set, dest_index, &session->new_ids);
+
+	if(all != NULL)
+		page_set_delete(all);
+
+	return(result);
+}
@@ -0,0 +1,50 @@
+/*
+  import-session.h - import pages from the same file several times
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JUGGLER_IMPORT_SESSION_H_
+#define _JUGGLER_IMPORT_SESSION_H_
+
+#include "document.h"
+
+/* keeps the source open and remembers which of its objects already are in 
+   the destination, so fonts and images that several imports need are only 
+   copied once; after the destination has been saved everything is copied 
+   again as the garbage collection may have dropped those objects */
+
+struct import_session;
+struct page_set;
+
+/* both documents are kept open until the session is closed */
+extern ErrorCode juggler_import_session_open(juggler_t *dest, juggler_t *src, 
+	struct import_session **session);
+
+extern void juggler_import_session_close(struct import_session *session);
+
+/* returns the source document of the session */
+extern juggler_t *juggler_import_session_source(struct import_session *session);
+
+/* is the source file still the one the source document has been loaded 
+   from? if it has been saved over since, the session must be reopened */
+extern int juggler_import_session_is_current(struct import_session *session);
+
+/* inserts the pages of set (or all pages if set is NULL) in front of the 
+   page dest_index */
+extern ErrorCode juggler_import_pages(struct import_session *session, 
+	struct page_set *set, int dest_index);
+
+#endif /* _JUGGLER_IMPORT_SESSION_H_ */
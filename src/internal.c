@@ -18,6 +18,11 @@
 
 #include "internal.h"
 
+#include "render-pool.h"
+#include "list-cache.h"
+#include "page-geometry.h"
+#include "page-set.h"
+
 /* copied from MuPDF */
 pdf_obj *juggler_lookup_inherited_page_item(fz_context *ctx, pdf_document *doc, pdf_obj *node, const char *key)
 {
@@ -59,45 +64,81 @@ pdf_obj *juggler_lookup_inherited_page_item(fz_context *ctx, pdf_document *doc,
 }
 /* end of copied function */
 
+/* nothing that has been requested in the background may get into the cache
+   with an outdated page number */
+static void invalidate_background_renders(juggler_t *juggler)
+{
+	if(juggler->pool != NULL)
+		render_pool_invalidate(juggler->pool);
+}
+
 
 void juggler_page_tree_changed(juggler_t *juggler)
 {
+	juggler->edited = 1;
 	juggler->pagecount = pdf_count_pages(juggler->ctx, juggler->pdf);
-	size_t i;
-	for(i = 0; i < RENDER_BUFFER_COUNT; i++)
-		juggler->rendered[i].samples = NULL;
-	juggler->recent_rendered = 0;
-	juggler->sizes = NULL;
-	get_all_pages_size(juggler);
+	invalidate_background_renders(juggler);
+	render_cache_clear(juggler->cache);
+	list_cache_clear(juggler->lists);
+	juggler_estimate_page_sizes(juggler); // the real ones are measured lazily
 }
 
-void juggler_page_tree_changed_due_to_remove(juggler_t *juggler, int delete_index, int delete_count)
+void juggler_page_tree_changed_due_to_remap(juggler_t *juggler, 
+	const int *new_index, int old_count)
 {
+	juggler->edited = 1;
 	// update juggler information
-	juggler->pagecount--;
-	size_t i;
-	for(i = 0; i < RENDER_BUFFER_COUNT; i++) {
-		if(juggler->rendered[i].samples != NULL) {
-			if(juggler->rendered[i].pagenum >= delete_index + delete_count)
-				juggler->rendered[i].pagenum -= delete_count;
-			// this page does no longer exist
-			else if(juggler->rendered[i].pagenum == delete_index) 
-				juggler->rendered[i].pagenum = -1; // will be delete later
-		}
+	int i;
+	juggler->pagecount = 0;
+	for(i = 0; i < old_count; i++) {
+		if(new_index[i] >= 0)
+			juggler->pagecount++;
 	}
-	juggler->sizes = NULL;
-	get_all_pages_size(juggler);
+
+	invalidate_background_renders(juggler);
+	render_cache_remap_pages(juggler->cache, new_index, old_count);
+	list_cache_remap_pages(juggler->lists, new_index, old_count, 
+		juggler->pagecount);
+	page_geometry_remap(juggler->geometry, new_index, juggler->pagecount);
 }
 
 void juggler_page_tree_changed_due_to_insert(juggler_t *juggler, int index, int count)
 {
-	juggler_page_tree_changed(juggler);
+	juggler->edited = 1;
+	juggler->pagecount = pdf_count_pages(juggler->ctx, juggler->pdf);
+	invalidate_background_renders(juggler);
+	render_cache_insert_pages(juggler->cache, index, count);
+	list_cache_insert_pages(juggler->lists, index, count);
+	page_geometry_insert(juggler->geometry, index, count); // measured lazily
 }
 
 void juggler_page_changed(juggler_t *juggler, int page_index)
 {
-  size_t i;
-	for(i = 0; i < RENDER_BUFFER_COUNT; i++)
-		if(juggler->rendered[i].pagenum == page_index)
-			juggler->rendered[i].pagenum = -1;
+	juggler->edited = 1;
+	invalidate_background_renders(juggler);
+	render_cache_invalidate_page(juggler->cache, page_index);
+	list_cache_invalidate_page(juggler->lists, page_index);
+	juggler_update_page_sizes(juggler, page_index, 1);
+}
+
+void juggler_pages_changed(juggler_t *juggler, struct page_set *set)
+{
+	juggler->edited = 1;
+	invalidate_background_renders(juggler);
+	render_cache_invalidate_pages(juggler->cache, set);
+
+	/* each run of changed pages is measured with one walk */
+	int first = page_set_next(set, 0);
+	while(first >= 0) {
+		int last = first;
+		while(page_set_contains(set, last + 1))
+			last++;
+
+		int i;
+		for(i = first; i <= last; i++)
+			list_cache_invalidate_page(juggler->lists, i);
+		juggler_update_page_sizes(juggler, first, last - first + 1);
+
+		first = page_set_next(set, last + 1);
+	}
 }
@@ -20,6 +20,7 @@
 #define _JUGGLER_INTERNAL_H_
 
 #include "document.h"
+#include "render.h"
 
 extern pdf_obj *juggler_lookup_inherited_page_item(fz_context *ctx, pdf_document *doc, pdf_obj *node, const char *key);
 
@@ -27,12 +28,24 @@ extern pdf_obj *juggler_lookup_inherited_page_item(fz_context *ctx, pdf_document
    page-tree using only the MuPDF-API */
 extern void juggler_page_tree_changed(juggler_t *juggler);
 
-extern void juggler_page_tree_changed_due_to_remove(juggler_t *juggler, 
-	int delete_index, int delete_count);
+/* page i is now page new_index[i], removed pages have a negative index */
+extern void juggler_page_tree_changed_due_to_remap(juggler_t *juggler, 
+	const int *new_index, int old_count);
 
 extern void juggler_page_tree_changed_due_to_insert(juggler_t *juggler, 
 	int index, int count);
 
 extern void juggler_page_changed(juggler_t *juggler, int page_index);
 
+struct page_set;
+
+/* like juggler_page_changed() for all pages of the set, but everything that
+   concerns all pages is only done once */
+extern void juggler_pages_changed(juggler_t *juggler, struct page_set *set);
+
+/* rasterizes the part of the page selected by data, the list must have been
+   recorded without any transformation; returns NULL if the part is empty */
+extern fz_pixmap *render_draw_list(fz_context *ctx, fz_display_list *list, 
+	const fz_rect *page_bounds, render_data_t *data, fz_cookie *cookie);
+
 #endif /* _JUGGLER_INTERNAL_H_ */
@@ -0,0 +1,180 @@
+/*
+  list-cache.c - keep the display lists of pages for later reuse
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "list-cache.h"
+
+struct list_cache_entry
+{
+	fz_display_list *list; // NULL if the page has no list
+	fz_rect bounds;
+	unsigned int last_used;
+};
+
+struct list_cache
+{
+	fz_context *ctx;
+
+	/* indexed by the page number */
+	struct list_cache_entry *entries;
+	size_t entries_count;
+
+	size_t used;
+	size_t max_used;
+	unsigned int clock;
+};
+
+static void drop_entry(struct list_cache *cache, struct list_cache_entry *entry)
+{
+	if(entry->list != NULL) {
+		fz_drop_display_list(cache->ctx, entry->list);
+		entry->list = NULL;
+		cache->used--;
+	}
+}
+
+/* as this is only done if a page had to be recorded, it doesn't matter
+   that all pages need to be searched */
+static void drop_least_recently_used(struct list_cache *cache)
+{
+	struct list_cache_entry *oldest = NULL;
+
+	size_t i;
+	for(i = 0; i < cache->entries_count; i++) {
+		if(cache->entries[i].list != NULL && (oldest == NULL ||
+			cache->clock - cache->entries[i].last_used >
+			cache->clock - oldest->last_used))
+		{
+			oldest = &cache->entries[i];
+		}
+	}
+
+	if(oldest != NULL)
+		drop_entry(cache, oldest);
+}
+
+static void ensure_entries(struct list_cache *cache, size_t count)
+{
+	if(count <= cache->entries_count)
+		return;
+
+	cache->entries = realloc(cache->entries,
+		count * sizeof(struct list_cache_entry));
+	memset(cache->entries + cache->entries_count, 0,
+		(count - cache->entries_count) * sizeof(struct list_cache_entry));
+	cache->entries_count = count;
+}
+
+struct list_cache *list_cache_new(fz_context *ctx, size_t max_lists)
+{
+	struct list_cache *cache = calloc(1, sizeof(struct list_cache));
+	cache->ctx = ctx;
+	cache->max_used = max_lists;
+
+	return(cache);
+}
+
+void list_cache_delete(struct list_cache *cache)
+{
+	list_cache_clear(cache);
+	free(cache->entries);
+	free(cache);
+}
+
+fz_display_list *list_cache_lookup(struct list_cache *cache,
+	int pagenum, fz_rect *bounds)
+{
+	if(pagenum < 0 || pagenum >= cache->entries_count ||
+		cache->entries[pagenum].list == NULL)
+	{
+		return(NULL);
+	}
+
+	struct list_cache_entry *entry = &cache->entries[pagenum];
+	entry->last_used = ++cache->clock;
+	*bounds = entry->bounds;
+
+	return(fz_keep_display_list(cache->ctx, entry->list));
+}
+
+void list_cache_insert(struct list_cache *cache, int pagenum,
+	fz_display_list *list, const fz_rect *bounds)
+{
+	if(pagenum < 0 || cache->max_used == 0)
+		return;
+
+	ensure_entries(cache, pagenum + 1);
+
+	struct list_cache_entry *entry = &cache->entries[pagenum];
+	drop_entry(cache, entry);
+	while(cache->used >= cache->max_used)
+		drop_least_recently_used(cache);
+
+	entry->list = fz_keep_display_list(cache->ctx, list);
+	entry->bounds = *bounds;
+	entry->last_used = ++cache->clock;
+	cache->used++;
+}
+
+void list_cache_clear(struct list_cache *cache)
+{
+	size_t i;
+	for(i = 0; i < cache->entries_count; i++)
+		drop_entry(cache, &cache->entries[i]);
+}
+
+void list_cache_invalidate_page(struct list_cache *cache, int pagenum)
+{
+	if(pagenum >= 0 && pagenum < cache->entries_count)
+		drop_entry(cache, &cache->entries[pagenum]);
+}
+
+void list_cache_remap_pages(struct list_cache *cache, 
+	const int *new_index, int old_count, int new_count)
+{
+	struct list_cache_entry *entries = 
+		calloc(new_count, sizeof(struct list_cache_entry));
+
+	size_t i;
+	for(i = 0; i < cache->entries_count; i++) {
+		if(cache->entries[i].list == NULL)
+			continue;
+
+		int target = (i < old_count ? new_index[i] : -1);
+		if(target < 0 || target >= new_count)
+			drop_entry(cache, &cache->entries[i]);
+		else
+			entries[target] = cache->entries[i];
+	}
+
+	free(cache->entries);
+	cache->entries = entries;
+	cache->entries_count = new_count;
+}
+
+void list_cache_insert_pages(struct list_cache *cache, int index, int count)
+{
+	if(index < 0 || index >= cache->entries_count)
+		return; // nothing behind index has been recorded
+
+	size_t old_count = cache->entries_count;
+	ensure_entries(cache, old_count + count);
+
+	memmove(cache->entries + index + count, cache->entries + index,
+		(old_count - index) * sizeof(struct list_cache_entry));
+	memset(cache->entries + index, 0, count * sizeof(struct list_cache_entry));
+}
@@ -0,0 +1,60 @@
+/*
+  list-cache.h - keep the display lists of pages for later reuse
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JUGGLER_LIST_CACHE_H_
+#define _JUGGLER_LIST_CACHE_H_
+
+#include <mupdf/fitz.h>
+
+/* a display list can be replayed for any zoom and any tile, so the content
+   streams of a page only need to be interpreted again after it has been
+   changed */
+
+/* how many pages keep their display list if nobody says something else */
+#define LIST_CACHE_DEFAULT_PAGES 64
+
+struct list_cache;
+
+extern struct list_cache *list_cache_new(fz_context *ctx, size_t max_lists);
+
+extern void list_cache_delete(struct list_cache *cache);
+
+/* returns the list of the page (you need to drop it) and its unscaled
+   bounds or NULL if the page has not been recorded yet */
+extern fz_display_list *list_cache_lookup(struct list_cache *cache,
+	int pagenum, fz_rect *bounds);
+
+/* the cache takes its own reference to list; if there are too many lists,
+   the least recently used one is dropped */
+extern void list_cache_insert(struct list_cache *cache, int pagenum,
+	fz_display_list *list, const fz_rect *bounds);
+
+/* those need to be called if the page tree has changed */
+extern void list_cache_clear(struct list_cache *cache);
+
+extern void list_cache_invalidate_page(struct list_cache *cache, int pagenum);
+
+/* page i becomes page new_index[i], pages with a negative new index are
+   dropped */
+extern void list_cache_remap_pages(struct list_cache *cache,
+	const int *new_index, int old_count, int new_count);
+
+extern void list_cache_insert_pages(struct list_cache *cache,
+	int index, int count);
+
+#endif /* _JUGGLER_LIST_CACHE_H_ */
@@ -106,6 +106,7 @@ static ErrorCode juggler_create_document_info(juggler_t *juggler, pdf_obj **newI
 ErrorCode juggler_set_meta_data(juggler_t *juggler, meta_data *data)
 {
 	ErrorCode errorCode;
+	juggler->edited = 1;
 	pdf_obj *info = pdf_dict_gets(juggler->ctx, 
 		pdf_trailer(juggler->ctx, juggler->pdf), "Info");
 
@@ -20,67 +20,42 @@
 
 #include "copy-helper.h"
 #include "internal.h"
+#include "page-tree.h"
+#include "page-attrs.h"
+#include "page-set.h"
+#include "deferred-streams.h"
 
-static int find_destination_pages(fz_context *ctx, pdf_obj *current, int page_num, pdf_obj **dest_pages, int *index)
+/* inserts the /Pages-node new_pages_ref with its count pages in front of 
+   the page dest_index of dest and updates everything */
+static ErrorCode insert_pages_node(juggler_t *dest, pdf_obj *new_pages_ref, 
+	int count, int dest_index)
 {
-	if(!strcmp(pdf_to_name(ctx, pdf_dict_gets(ctx, current, "Type")), "Page")) {
-		return(--page_num);
-	} if(!strcmp(pdf_to_name(ctx, pdf_dict_gets(ctx, current, "Type")), "Pages")) {
-		pdf_obj *kids = pdf_dict_gets(ctx, current, "Kids");
-		pdf_obj *count_obj = pdf_dict_gets(ctx, current, "Count");
-		if(!pdf_is_array(ctx, kids) || !pdf_is_int(ctx, count_obj))
-			return(-2);
-
-		int count = pdf_to_int(ctx, count_obj);
-		int i;
-		for(i = 0; i < count; i++) {
-			pdf_obj *current_kid = pdf_array_get(ctx, kids, i);
-
-			page_num = find_destination_pages(ctx, current_kid, page_num, dest_pages, index);
-			if(page_num == -1) {
-				*index = i;
-				*dest_pages = current;
-				return(-2);
-			} else if(page_num == -2) {
-				return(-2); // just return, preserve index and dest_pages
-			}
-		}
+	/* an index behind the last page appends the pages */
+	if(dest_index < 0 || dest_index > dest->pagecount)
+		dest_index = dest->pagecount;
 
-		return(page_num);
+	page_location_t location;
+	page_location_init(&location);
+	ErrorCode result = 
+		page_tree_locate(dest->ctx, dest->pdf, dest_index, &location);
+	if(result != NoError) {
+		page_location_release(dest->ctx, &location);
+		return(result);
 	}
 
-	return(page_num);
-}
-
-ErrorCode juggler_add_pages_from_file(juggler_t *dest, juggler_t *src, int dest_index)
-{
-	pdf_obj *dest_pages = pdf_dict_getp(dest->ctx, 
-		pdf_trailer(dest->ctx, dest->pdf), "Root/Pages");
-	int dest_pages_index = pdf_array_len(dest->ctx, 
-		pdf_dict_gets(dest->ctx, dest_pages, "Kids"));
-		
-	/* be aware that this function does not change the two variables if the page
-	   index is greater than the number of pages */
-	find_destination_pages(dest->ctx, 
-		dest_pages, dest_index, &dest_pages, &dest_pages_index);
+	pdf_obj *dest_pages = location.path[location.depth - 1];
+	int dest_pages_index = location.kid_index[location.depth - 1];
 
 	pdf_obj *dest_kids = pdf_dict_gets(dest->ctx, dest_pages, "Kids");
 	if(!pdf_is_indirect(dest->ctx, dest_pages) || 
 		!pdf_is_dict(dest->ctx, dest_pages) || !pdf_is_array(dest->ctx, dest_kids))
 	{
+		page_location_release(dest->ctx, &location);
 		return(ERROR_INVALID_RANGE);
 	}
-	
-	pdf_obj *pages_root = pdf_dict_getp(src->ctx, pdf_trailer(src->ctx, src->pdf), "Root/Pages");
-	if(!pdf_is_indirect(src->ctx, pages_root) || !pdf_is_dict(src->ctx, pages_root))
-		return(ERROR_NO_PAGES);
-
-	/* if we copy the root pages-node and it's referenced objects, we will copy 
-	   all pages and all objects those pages need */
-	pdf_obj *new_pages_ref = copy_object_single(dest->ctx, dest->pdf, src->ctx, src->pdf, pages_root);
 
 	/* insert new pages-node */
-	pdf_array_insert_drop(dest->ctx, dest_kids, new_pages_ref, dest_pages_index);
+	pdf_array_insert(dest->ctx, dest_kids, new_pages_ref, dest_pages_index);
 
 	/* update the parent */
 	pdf_obj *new_pages_parent = pdf_new_indirect(dest->ctx, dest->pdf, 
@@ -90,18 +65,210 @@ ErrorCode juggler_add_pages_from_file(juggler_t *dest, juggler_t *src, int dest_
 	/* TODO: If dest_pages contains anything inheritable but not the new node
 	         we need to insert empty items to prevent this inerhitance */
 
-	/* update count */
-	int new_count = pdf_to_int(dest->ctx, 
-		pdf_dict_gets(dest->ctx, dest_pages, "Count")) + src->pagecount;
-	pdf_dict_puts_drop(dest->ctx, dest_pages, "Count", 
-		pdf_new_int(dest->ctx, dest->pdf, new_count));
+	/* update count of all nodes above the new one */
+	page_tree_adjust_counts(dest->ctx, dest->pdf, &location, count);
+	page_location_release(dest->ctx, &location);
+	int new_count = dest->pagecount + count;
 
 	/* let MuPDF rebuild the page tree */
 	pdf_finish_edit(dest->ctx, dest->pdf);
 	dest->pdf->page_count = new_count;
 
 	/* update juggler's state */
-	juggler_page_tree_changed_due_to_insert(dest, dest_index, src->pagecount);
+	juggler_page_tree_changed_due_to_insert(dest, dest_index, count);
+
+	return(NoError);
+}
+
+ErrorCode juggler_add_pages_from_file(juggler_t *dest, juggler_t *src, int dest_index)
+{
+	pdf_obj *pages_root = pdf_dict_getp(src->ctx, pdf_trailer(src->ctx, src->pdf), "Root/Pages");
+	if(!pdf_is_indirect(src->ctx, pages_root) || !pdf_is_dict(src->ctx, pages_root))
+		return(ERROR_NO_PAGES);
+
+	/* src must have all its streams before they can be copied again */
+	ErrorCode result = juggler_flush_deferred_streams(src);
+	if(result != NoError)
+		return(result);
+
+	/* if we copy the root pages-node and it's referenced objects, we will copy 
+	   all pages and all objects those pages need */
+	struct copy_map *new_ids = NULL;
+	pdf_obj *new_pages_ref = 
+		copy_object_deferred(dest, src, pages_root, &new_ids);
+	copy_map_delete(new_ids);
+
+	result = insert_pages_node(dest, new_pages_ref, src->pagecount, dest_index);
+	pdf_drop_obj(dest->ctx, new_pages_ref);
+
+	return(result);
+}
+
+/* references to the page tree or to pages that are not copied must not be
+   followed, else all of them would be copied: they point to null instead,
+   which is one object for all imports into dest (until it is saved) */
+static void map_skipped_objects(juggler_t *dest, juggler_t *src, 
+	struct page_set *set, const page_slot_t *slots, struct copy_map *new_ids)
+{
+	if(dest->skipped_num == 0) {
+		dest->skipped_num = pdf_create_object(dest->ctx, dest->pdf);
+		pdf_obj *null_obj = pdf_new_null(dest->ctx, dest->pdf);
+		pdf_update_object(dest->ctx, dest->pdf, dest->skipped_num, null_obj);
+		pdf_drop_obj(dest->ctx, null_obj);
+	}
+	int null_num = dest->skipped_num;
+
+	int i;
+	for(i = 0; i < src->pagecount; i++) {
+		int parent_num = pdf_to_num(src->ctx, slots[i].parent);
+		if(parent_num > 0)
+			copy_map_set(new_ids, parent_num, null_num);
+
+		if(!page_set_contains(set, i)) {
+			pdf_obj *kids = pdf_dict_gets(src->ctx, slots[i].parent, "Kids");
+			int page_num = pdf_to_num(src->ctx, 
+				pdf_array_get(src->ctx, kids, slots[i].kid_index));
+			if(page_num > 0)
+				copy_map_set(new_ids, page_num, null_num);
+		}
+	}
+}
+
+/* each copy of a page needs its own annotations, even if the page has been
+   copied before with the same map */
+static void forget_annotations(fz_context *ctx, pdf_obj *page, 
+	struct copy_map *new_ids)
+{
+	pdf_obj *annots = pdf_dict_gets(ctx, page, "Annots");
+	copy_map_set(new_ids, pdf_to_num(ctx, annots), 0);
+
+	int i;
+	for(i = 0; i < pdf_array_len(ctx, annots); i++)
+		copy_map_set(new_ids, pdf_to_num(ctx, pdf_array_get(ctx, annots, i)), 0);
+}
+
+ErrorCode juggler_add_page_set_from_file(juggler_t *dest, juggler_t *src, 
+	struct page_set *set, int dest_index)
+{
+	struct copy_map *new_ids = NULL;
+	ErrorCode result = juggler_add_page_set_from_file_continue(dest, src, 
+		set, dest_index, &new_ids);
+	copy_map_delete(new_ids);
+
+	return(result);
+}
+
+ErrorCode juggler_add_page_set_from_file_continue(juggler_t *dest, 
+	juggler_t *src, struct page_set *set, int dest_index, 
+	struct copy_map **new_ids_ptr)
+{
+	fz_context *ctx = src->ctx;
+	int count = page_set_size(set);
+
+	if(page_set_pagecount(set) != src->pagecount || count == 0)
+		return(ERROR_INVALID_RANGE);
+
+	ErrorCode result = juggler_flush_deferred_streams(src);
+	if(result != NoError)
+		return(result);
+
+	page_attrs_t *attrs = malloc(sizeof(page_attrs_t) * src->pagecount);
+	page_slot_t *slots = malloc(sizeof(page_slot_t) * src->pagecount);
+	result = juggler_resolve_page_attrs(ctx, src->pdf, 0, 
+		src->pagecount, attrs);
+	if(result == NoError)
+		result = page_tree_collect_slots(ctx, src->pdf, slots, src->pagecount);
+	if(result != NoError) {
+		free(attrs);
+		free(slots);
+		return(result);
+	}
+
+	/* the page tree is mapped to null, so expect at least that much */
+	if(*new_ids_ptr == NULL) {
+		*new_ids_ptr = 
+			copy_map_new(pdf_xref_len(ctx, src->pdf), src->pagecount * 2);
+	}
+	struct copy_map *new_ids = *new_ids_ptr;
+	map_skipped_objects(dest, src, set, slots, new_ids);
+
+	/* the copied pages get their numbers first, so that references to them
+	   (e. g. from their annotations) point to the copies */
+	int *page_nums = malloc(sizeof(int) * count);
+	int i, next = 0;
+	for(i = page_set_next(set, 0); i >= 0; i = page_set_next(set, i + 1)) {
+		page_nums[next] = pdf_create_object(dest->ctx, dest->pdf);
+		copy_map_set(new_ids, pdf_to_num(ctx, attrs[i].page), page_nums[next]);
+		forget_annotations(ctx, attrs[i].page, new_ids);
+		next++;
+	}
+
+	int pages_num = pdf_create_object(dest->ctx, dest->pdf);
+	pdf_obj *pages_ref = pdf_new_indirect(dest->ctx, dest->pdf, pages_num, 0);
+	pdf_obj *kids = pdf_new_array(dest->ctx, dest->pdf, count);
+
+	next = 0;
+	for(i = page_set_next(set, 0); i >= 0; i = page_set_next(set, i + 1)) {
+		/* a page on its own: nothing inherited, no parent */
+		page_attrs_t page_attrs = attrs[i];
+		page_attrs.page = pdf_copy_dict(ctx, attrs[i].page);
+		pdf_dict_dels(ctx, page_attrs.page, "Parent");
+		juggler_materialize_page_attrs(ctx, src->pdf, &page_attrs);
+
+		pdf_obj *new_page = copy_unassigned_object_deferred(dest, src, 
+			page_attrs.page, new_ids_ptr);
+		pdf_drop_obj(ctx, page_attrs.page);
+
+		pdf_dict_puts(dest->ctx, new_page, "Parent", pages_ref);
+		pdf_update_object(dest->ctx, dest->pdf, page_nums[next], new_page);
+		pdf_drop_obj(dest->ctx, new_page);
+
+		pdf_array_push_drop(dest->ctx, kids, 
+			pdf_new_indirect(dest->ctx, dest->pdf, page_nums[next], 0));
+		next++;
+	}
+
+	pdf_obj *pages = pdf_new_dict(dest->ctx, dest->pdf, 4);
+	pdf_dict_puts_drop(dest->ctx, pages, "Type", 
+		pdf_new_name(dest->ctx, dest->pdf, "Pages"));
+	pdf_dict_puts_drop(dest->ctx, pages, "Kids", kids);
+	pdf_dict_puts_drop(dest->ctx, pages, "Count", 
+		pdf_new_int(dest->ctx, dest->pdf, count));
+	pdf_update_object(dest->ctx, dest->pdf, pages_num, pages);
+	pdf_drop_obj(dest->ctx, pages);
+
+	free(page_nums);
+	free(attrs);
+	free(slots);
+
+	result = insert_pages_node(dest, pages_ref, count, dest_index);
+	pdf_drop_obj(dest->ctx, pages_ref);
+
+	return(result);
+}
+
+ErrorCode juggler_set_import_order(juggler_t *juggler, int order)
+{
+	if(order != COPY_ORDER_DISCOVERY && order != COPY_ORDER_FILE)
+		return(ErrorUsage);
+
+	juggler->import_order = order;
+	return(NoError);
+}
+
+ErrorCode juggler_set_import_threads(juggler_t *juggler, int threads)
+{
+	if(threads < 0)
+		return(ErrorUsage);
+
+	juggler->import_threads = threads;
+	return(NoError);
+}
+
+ErrorCode juggler_get_import_stats(juggler_t *juggler, 
+	copy_dedup_stats_t *stats)
+{
+	copy_dedup_get_stats(juggler->imported, stats);
 
 	return(NoError);
 }
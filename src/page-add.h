@@ -20,8 +20,34 @@
 #define _JUGGLER_PAGE_ADD_H_
 
 #include "document.h"
+#include "copy-dedup.h"
 
 extern ErrorCode juggler_add_pages_from_file(
 	juggler_t *dest, juggler_t *src, int dest_index);
 
+struct page_set;
+
+/* like juggler_add_pages_from_file() but only copies the pages of src that
+   are in set and the objects they need; the copies don't inherit anything */
+extern ErrorCode juggler_add_page_set_from_file(juggler_t *dest, 
+	juggler_t *src, struct page_set *set, int dest_index);
+
+/* the same, but objects that have been copied with the same map before are 
+   not copied again (see copy_object_continue()) */
+extern ErrorCode juggler_add_page_set_from_file_continue(juggler_t *dest, 
+	juggler_t *src, struct page_set *set, int dest_index, 
+	struct copy_map **new_ids_ptr);
+
+/* COPY_ORDER_FILE (the default) or COPY_ORDER_DISCOVERY, for comparison */
+extern ErrorCode juggler_set_import_order(juggler_t *juggler, int order);
+
+/* how many threads parse the objects of unchanged sources while they are 
+   imported with COPY_ORDER_FILE, 0 to do everything on the calling thread */
+extern ErrorCode juggler_set_import_threads(juggler_t *juggler, int threads);
+
+/* how many imported objects have been reused instead of copied and how 
+   they have been read */
+extern ErrorCode juggler_get_import_stats(juggler_t *juggler, 
+	copy_dedup_stats_t *stats);
+
 #endif /* _JUGGLER_PAGE_ADD_H_ */
@@ -0,0 +1,172 @@
+/*
+  page-attrs.c - resolve the inheritable attributes of pages
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "page-attrs.h"
+
+struct resolve_state
+{
+	fz_context *ctx;
+	int first;
+	int end;
+	int current; // the number of the next page in the tree
+	page_attrs_t *attrs;
+};
+
+/* the same as MuPDF does for pdf_page's rotate */
+static int normalize_rotation(int rotate)
+{
+	rotate = rotate % 360;
+	if(rotate < 0)
+		rotate += 360;
+	rotate = 90 * ((rotate + 45) / 90);
+	if(rotate >= 360)
+		rotate = 0;
+
+	return(rotate);
+}
+
+/* overwrites everything node sets itself */
+static void pick_attrs(fz_context *ctx, pdf_obj *node, page_attrs_t *attrs)
+{
+	pdf_obj *obj;
+
+	if((obj = pdf_dict_gets(ctx, node, "Resources")) != NULL)
+		attrs->resources = obj;
+	if((obj = pdf_dict_gets(ctx, node, "MediaBox")) != NULL)
+		attrs->media_box = obj;
+	if((obj = pdf_dict_gets(ctx, node, "CropBox")) != NULL)
+		attrs->crop_box = obj;
+	if((obj = pdf_dict_gets(ctx, node, "BleedBox")) != NULL)
+		attrs->bleed_box = obj;
+	if((obj = pdf_dict_gets(ctx, node, "TrimBox")) != NULL)
+		attrs->trim_box = obj;
+	if(pdf_is_int(ctx, obj = pdf_dict_gets(ctx, node, "Rotate")))
+		attrs->rotate = normalize_rotation(pdf_to_int(ctx, obj));
+	if(pdf_is_number(ctx, obj = pdf_dict_gets(ctx, node, "UserUnit")))
+		attrs->user_unit = pdf_to_real(ctx, obj);
+}
+
+static void resolve_node(struct resolve_state *state, pdf_obj *node, 
+	const page_attrs_t *inherited)
+{
+	fz_context *ctx = state->ctx;
+
+	page_attrs_t here = *inherited;
+	pick_attrs(ctx, node, &here);
+
+	pdf_obj *kids = pdf_dict_get(ctx, node, PDF_NAME_Kids);
+	if(!pdf_is_array(ctx, kids)) { // this is a page
+		if(state->current >= state->first) {
+			here.page = node;
+			state->attrs[state->current - state->first] = here;
+		}
+		state->current++;
+		return;
+	}
+
+	if(pdf_mark_obj(ctx, node))
+		fz_throw(ctx, FZ_ERROR_GENERIC, "cycle in page tree");
+
+	fz_try(ctx) {
+		int i;
+		for(i = 0; i < pdf_array_len(ctx, kids) && state->current < state->end; i++) {
+			pdf_obj *kid = pdf_array_get(ctx, kids, i);
+
+			/* nothing in this subtree has been requested */
+			int count = pdf_to_int(ctx, pdf_dict_get(ctx, kid, PDF_NAME_Count));
+			if(pdf_is_array(ctx, pdf_dict_get(ctx, kid, PDF_NAME_Kids)) && 
+				count > 0 && state->current + count <= state->first)
+			{
+				state->current += count;
+				continue;
+			}
+
+			resolve_node(state, kid, &here);
+		}
+	} fz_always(ctx) {
+		pdf_unmark_obj(ctx, node);
+	} fz_catch(ctx) {
+		fz_rethrow(ctx);
+	}
+}
+
+ErrorCode juggler_resolve_page_attrs(fz_context *ctx, pdf_document *doc,
+	int index, int count, page_attrs_t *attrs)
+{
+	if(index < 0 || count < 0)
+		return(ERROR_INVALID_RANGE);
+
+	pdf_obj *pages = pdf_dict_getp(ctx, pdf_trailer(ctx, doc), "Root/Pages");
+	if(pages == NULL)
+		return(ERROR_NO_PAGES);
+
+	page_attrs_t defaults = { NULL, NULL, NULL, NULL, NULL, NULL, 0, 1.0 };
+	struct resolve_state state = { ctx, index, index + count, 0, attrs };
+
+	ErrorCode result = NoError;
+	fz_try(ctx) {
+		resolve_node(&state, pages, &defaults);
+	} fz_catch(ctx) {
+		result = ErrorInvalidReference;
+	}
+
+	if(result == NoError && state.current < state.end)
+		result = ERROR_INVALID_RANGE;
+
+	return(result);
+}
+
+void juggler_materialize_page_attrs(fz_context *ctx, pdf_document *doc, 
+	const page_attrs_t *attrs)
+{
+	pdf_obj *page = attrs->page;
+
+	/* a missing entry would be inherited from the new parent, so even the 
+	   defaults get written */
+	if(pdf_dict_gets(ctx, page, "Resources") == NULL) {
+		if(attrs->resources == NULL)
+			pdf_dict_puts_drop(ctx, page, "Resources", pdf_new_dict(ctx, doc, 0));
+		else if(pdf_is_indirect(ctx, attrs->resources))
+			pdf_dict_puts(ctx, page, "Resources", attrs->resources);
+		else
+			pdf_dict_puts_drop(ctx, page, "Resources", 
+				pdf_copy_dict(ctx, attrs->resources));
+	}
+
+	if(pdf_dict_gets(ctx, page, "MediaBox") == NULL) {
+		if(attrs->media_box != NULL) {
+			pdf_dict_puts_drop(ctx, page, "MediaBox", 
+				pdf_copy_array(ctx, attrs->media_box));
+		} else { // US Letter, like measure_page() assumes
+			fz_rect letter = { 0, 0, 612, 792 };
+			pdf_dict_puts_drop(ctx, page, "MediaBox", 
+				pdf_new_rect(ctx, doc, &letter));
+		}
+	}
+
+	/* without a crop box the media box is used */
+	if(pdf_dict_gets(ctx, page, "CropBox") == NULL) {
+		pdf_obj *crop_box = attrs->crop_box != NULL ? 
+			attrs->crop_box : pdf_dict_gets(ctx, page, "MediaBox");
+		if(pdf_is_array(ctx, crop_box))
+			pdf_dict_puts_drop(ctx, page, "CropBox", 
+				pdf_copy_array(ctx, crop_box));
+	}
+
+	pdf_dict_puts_drop(ctx, page, "Rotate", pdf_new_int(ctx, doc, attrs->rotate));
+}
@@ -0,0 +1,58 @@
+/*
+  page-attrs.h - resolve the inheritable attributes of pages
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JUGGLER_PAGE_ATTRS_H_
+#define _JUGGLER_PAGE_ATTRS_H_
+
+#include <mupdf/fitz.h>
+#include <mupdf/pdf.h>
+
+#include "error.h"
+
+/* everything a page may inherit from its parents in the page tree; the 
+   objects are borrowed from the document, so they are only valid until the 
+   page tree is changed. Boxes that are neither set in the page nor in one of
+   its parents are NULL */
+typedef struct
+{
+	pdf_obj *page;
+	pdf_obj *resources;
+	pdf_obj *media_box;
+	pdf_obj *crop_box;
+	pdf_obj *bleed_box;
+	pdf_obj *trim_box;
+	int rotate; // always 0, 90, 180 or 270
+	float user_unit;
+} page_attrs_t;
+
+/* resolves the attributes of the pages index to index + count - 1 with one
+   walk down the page tree instead of looking up every key of every page 
+   through its parents; subtrees before index are skipped by their /Count.
+   attrs must have space for count entries */
+extern ErrorCode juggler_resolve_page_attrs(fz_context *ctx, pdf_document *doc,
+	int index, int count, page_attrs_t *attrs);
+
+/* a page that gets another parent must not inherit anything else than 
+   before, so this puts all inheritable attributes (Resources, MediaBox, 
+   CropBox and Rotate) the page does not set itself into the page. They are
+   written even if they only have their default values, and Rotate is 
+   always written, so nothing the new parent defines applies to the page */
+extern void juggler_materialize_page_attrs(fz_context *ctx, pdf_document *doc, 
+	const page_attrs_t *attrs);
+
+#endif /* _JUGGLER_PAGE_ATTRS_H_ */
@@ -0,0 +1,191 @@
+/*
+  page-balance.c - rebuild the page tree as a balanced tree
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "page-balance.h"
+
+#include "internal.h"
+#include "page-attrs.h"
+#include "page-tree.h"
+
+static void set_parent(fz_context *ctx, pdf_document *doc, 
+	pdf_obj *kid, pdf_obj *parent)
+{
+	pdf_dict_puts_drop(ctx, kid, "Parent", pdf_new_indirect(ctx, doc, 
+		pdf_to_num(ctx, parent), pdf_to_gen(ctx, parent)));
+}
+
+/* creates a /Pages-node for the kids, the kids are dropped */
+static pdf_obj *new_pages_node(fz_context *ctx, pdf_document *doc, 
+	pdf_obj **kids, const int *counts, int kids_count, int *node_count)
+{
+	int num = pdf_create_object(ctx, doc);
+	pdf_obj *ref = pdf_new_indirect(ctx, doc, num, 0);
+
+	pdf_obj *node = pdf_new_dict(ctx, doc, 4);
+	pdf_obj *kids_array = pdf_new_array(ctx, doc, kids_count);
+	*node_count = 0;
+
+	int i;
+	for(i = 0; i < kids_count; i++) {
+		set_parent(ctx, doc, kids[i], ref);
+		pdf_array_push_drop(ctx, kids_array, kids[i]);
+		*node_count += counts[i];
+	}
+
+	pdf_dict_puts_drop(ctx, node, "Type", pdf_new_name(ctx, doc, "Pages"));
+	pdf_dict_puts_drop(ctx, node, "Kids", kids_array);
+	pdf_dict_puts_drop(ctx, node, "Count", pdf_new_int(ctx, doc, *node_count));
+	pdf_update_object(ctx, doc, num, node);
+	pdf_drop_obj(ctx, node);
+
+	return(ref);
+}
+
+/* is a page below node at a depth greater than limit? */
+static int too_deep(fz_context *ctx, pdf_obj *node, int depth, int limit)
+{
+	pdf_obj *kids = pdf_dict_gets(ctx, node, "Kids");
+	int kids_count = pdf_array_len(ctx, kids);
+	if(kids_count == 0)
+		return(0);
+	if(depth + 1 > limit)
+		return(1);
+
+	/* a node with as many pages as kids has nothing but pages, so they
+	   don't need to be loaded */
+	if(pdf_to_int(ctx, pdf_dict_gets(ctx, node, "Count")) == kids_count)
+		return(0);
+
+	int i;
+	for(i = 0; i < kids_count; i++) {
+		pdf_obj *kid = pdf_array_get(ctx, kids, i);
+		if(pdf_is_array(ctx, pdf_dict_gets(ctx, kid, "Kids")) && 
+			too_deep(ctx, kid, depth + 1, limit))
+		{
+			return(1);
+		}
+	}
+
+	return(0);
+}
+
+ErrorCode juggler_rebuild_page_tree(juggler_t *juggler, int fanout)
+{
+	fz_context *ctx = juggler->ctx;
+	pdf_document *doc = juggler->pdf;
+	int count = juggler->pagecount;
+
+	if(fanout < 2)
+		return(ErrorUsage);
+
+	pdf_obj *root = pdf_dict_getp(ctx, pdf_trailer(ctx, doc), "Root/Pages");
+	if(!pdf_is_indirect(ctx, root) || !pdf_is_dict(ctx, root))
+		return(ERROR_NO_PAGES);
+
+	page_attrs_t *attrs = malloc(sizeof(page_attrs_t) * count);
+	ErrorCode result = juggler_resolve_page_attrs(ctx, doc, 0, count, attrs);
+	if(result != NoError) {
+		free(attrs);
+		return(result);
+	}
+
+	/* the current level of the new tree, it starts with the pages; each 
+	   level keeps its own references */
+	pdf_obj **level = malloc(sizeof(pdf_obj *) * count);
+	int *counts = malloc(sizeof(int) * count);
+	int level_count = count;
+
+	int i;
+	for(i = 0; i < count; i++) {
+		juggler_materialize_page_attrs(ctx, doc, &attrs[i]);
+		level[i] = pdf_keep_obj(ctx, attrs[i].page);
+		counts[i] = 1;
+	}
+	free(attrs);
+
+	/* build the levels bottom up until the root can take all nodes */
+	while(level_count > fanout) {
+		int next_count = 0;
+		for(i = 0; i < level_count; i += fanout) {
+			int kids_count = fz_mini(fanout, level_count - i);
+			int node_count;
+			level[next_count] = new_pages_node(ctx, doc, level + i, 
+				counts + i, kids_count, &node_count);
+			counts[next_count] = node_count;
+			next_count++;
+		}
+		level_count = next_count;
+	}
+
+	/* the root stays the same object, as the catalog references it; the old
+	   nodes below it aren't referenced anymore and get lost on saving */
+	pdf_obj *kids = pdf_new_array(ctx, doc, level_count);
+	for(i = 0; i < level_count; i++) {
+		set_parent(ctx, doc, level[i], root);
+		pdf_array_push_drop(ctx, kids, level[i]);
+	}
+	pdf_dict_puts_drop(ctx, root, "Kids", kids);
+	pdf_dict_puts_drop(ctx, root, "Count", pdf_new_int(ctx, doc, count));
+
+	free(level);
+	free(counts);
+
+	/* let MuPDF rebuild the page tree */
+	pdf_finish_edit(ctx, doc);
+	juggler->edited = 1;
+
+	/* the pages haven't changed their order, so nothing else to do */
+
+	return(NoError);
+}
+
+ErrorCode juggler_balance_page_tree(juggler_t *juggler, int fanout)
+{
+	fz_context *ctx = juggler->ctx;
+
+	if(fanout == 0)
+		fanout = PAGE_TREE_DEFAULT_FANOUT;
+	if(fanout < 2)
+		return(ErrorUsage);
+	if(!juggler->edited)
+		return(NoError);
+
+	pdf_obj *root = pdf_dict_getp(ctx, pdf_trailer(ctx, juggler->pdf), "Root/Pages");
+	if(!pdf_is_dict(ctx, root))
+		return(ERROR_NO_PAGES);
+
+	/* the depth of the pages in a rebuilt tree */
+	int levels = 1;
+	int level_count = juggler->pagecount;
+	while(level_count > fanout) {
+		level_count = (level_count + fanout - 1) / fanout;
+		levels++;
+	}
+
+	int unbalanced = 0;
+	fz_try(ctx) {
+		unbalanced = too_deep(ctx, root, 0, levels);
+	} fz_catch(ctx) {
+		return(ErrorInvalidReference);
+	}
+
+	if(!unbalanced)
+		return(NoError);
+
+	return(juggler_rebuild_page_tree(juggler, fanout));
+}
@@ -0,0 +1,39 @@
+/*
+  page-balance.h - rebuild the page tree as a balanced tree
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JUGGLER_PAGE_BALANCE_H_
+#define _JUGGLER_PAGE_BALANCE_H_
+
+#include "document.h"
+
+/* a good number of kids per /Pages-node if nobody says something else */
+#define PAGE_TREE_DEFAULT_FANOUT 32
+
+/* after adding many documents the page tree consists of one subtree per
+   added document, so it gets deep and lopsided. This replaces all /Pages-
+   nodes below the root with new ones, each having at most fanout kids, so
+   that all pages have the same depth. The inherited attributes are put into
+   the pages before, so nothing looks different afterwards */
+extern ErrorCode juggler_rebuild_page_tree(juggler_t *juggler, int fanout);
+
+/* calls juggler_rebuild_page_tree() only if the document has been edited and
+   a page is deeper in the tree than it would be afterwards, so saving a 
+   balanced tree leaves it as it is; fanout 0 means PAGE_TREE_DEFAULT_FANOUT */
+extern ErrorCode juggler_balance_page_tree(juggler_t *juggler, int fanout);
+
+#endif /* _JUGGLER_PAGE_BALANCE_H_ */
@@ -0,0 +1,573 @@
+/*
+  page-geometry.c - sizes and positions of all pages
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "page-geometry.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* node 0 is the empty tree, so it has no pages and no height */
+struct page_node
+{
+	int left;
+	int right;
+	unsigned int priority; // larger ones are closer to the root
+
+	/* of the whole subtree */
+	int size;
+	int inexact;
+	long sum;
+
+	int width;
+	int height;
+	unsigned char exact;
+};
+
+struct page_geometry
+{
+	struct page_node *nodes;
+	int capacity;
+	int used;
+	int free_list; // linked through left
+
+	int root;
+	unsigned int seed;
+
+	int estimate_width;
+	int estimate_height;
+};
+
+static unsigned int next_priority(struct page_geometry *geometry)
+{
+	/* xorshift, the priorities only need to look random */
+	unsigned int x = geometry->seed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	geometry->seed = x;
+	return(x);
+}
+
+/* might move the nodes, so no pointers to them may be kept across it */
+static int alloc_node(struct page_geometry *geometry)
+{
+	int n = geometry->free_list;
+	if(n != 0) {
+		geometry->free_list = geometry->nodes[n].left;
+	} else {
+		if(geometry->used == geometry->capacity) {
+			geometry->capacity *= 2;
+			geometry->nodes = realloc(geometry->nodes, 
+				geometry->capacity * sizeof(struct page_node));
+		}
+		n = geometry->used++;
+	}
+
+	struct page_node *node = &geometry->nodes[n];
+	node->left = node->right = 0;
+	node->priority = next_priority(geometry);
+	node->width = geometry->estimate_width;
+	node->height = geometry->estimate_height;
+	node->exact = 0;
+	node->size = 1;
+	node->inexact = 1;
+	node->sum = node->height;
+
+	return(n);
+}
+
+static void free_tree(struct page_geometry *geometry, int n)
+{
+	if(n == 0)
+		return;
+
+	free_tree(geometry, geometry->nodes[n].left);
+	free_tree(geometry, geometry->nodes[n].right);
+	geometry->nodes[n].left = geometry->free_list;
+	geometry->free_list = n;
+}
+
+static void update(struct page_geometry *geometry, int n)
+{
+	struct page_node *node = &geometry->nodes[n];
+	struct page_node *left = &geometry->nodes[node->left];
+	struct page_node *right = &geometry->nodes[node->right];
+
+	node->size = 1 + left->size + right->size;
+	node->inexact = !node->exact + left->inexact + right->inexact;
+	node->sum = node->height + left->sum + right->sum;
+}
+
+/* the first count pages of tree go to *first, the others to *second */
+static void split(struct page_geometry *geometry, int tree, int count, 
+	int *first, int *second)
+{
+	if(tree == 0) {
+		*first = *second = 0;
+		return;
+	}
+
+	struct page_node *node = &geometry->nodes[tree];
+	int left_size = geometry->nodes[node->left].size;
+	if(count <= left_size) {
+		split(geometry, node->left, count, first, &node->left);
+		*second = tree;
+	} else {
+		split(geometry, node->right, count - left_size - 1, &node->right, 
+			second);
+		*first = tree;
+	}
+	update(geometry, tree);
+}
+
+/* all pages of first come before those of second */
+static int merge(struct page_geometry *geometry, int first, int second)
+{
+	if(first == 0)
+		return(second);
+	if(second == 0)
+		return(first);
+
+	struct page_node *a = &geometry->nodes[first];
+	struct page_node *b = &geometry->nodes[second];
+	if(a->priority > b->priority) {
+		a->right = merge(geometry, a->right, second);
+		update(geometry, first);
+		return(first);
+	}
+
+	b->left = merge(geometry, first, b->left);
+	update(geometry, second);
+	return(second);
+}
+
+/* builds a tree of the nodes in this order in linear time by keeping its 
+   right spine on a stack */
+static int build(struct page_geometry *geometry, const int *order, int count)
+{
+	if(count <= 0)
+		return(0);
+
+	int *spine = malloc(count * sizeof(int));
+	int top = 0;
+
+	int i;
+	for(i = 0; i < count; i++) {
+		int n = order[i];
+		int last = 0;
+		while(top > 0 && geometry->nodes[spine[top - 1]].priority < 
+			geometry->nodes[n].priority)
+		{
+			last = spine[--top];
+			update(geometry, last);
+		}
+
+		geometry->nodes[n].left = last;
+		geometry->nodes[n].right = 0;
+		if(top > 0)
+			geometry->nodes[spine[top - 1]].right = n;
+		spine[top++] = n;
+	}
+
+	int root = spine[0];
+	while(top > 0)
+		update(geometry, spine[--top]);
+
+	free(spine);
+	return(root);
+}
+
+/* a tree of count new pages with the estimated size */
+static int build_estimated(struct page_geometry *geometry, int count)
+{
+	if(count <= 0)
+		return(0);
+
+	int *order = malloc(count * sizeof(int));
+	int i;
+	for(i = 0; i < count; i++)
+		order[i] = alloc_node(geometry);
+
+	int tree = build(geometry, order, count);
+	free(order);
+	return(tree);
+}
+
+/* stores the nodes of the tree in page order */
+static int collect(struct page_geometry *geometry, int n, int *order, int next)
+{
+	if(n == 0)
+		return(next);
+
+	next = collect(geometry, geometry->nodes[n].left, order, next);
+	order[next++] = n;
+	return(collect(geometry, geometry->nodes[n].right, order, next));
+}
+
+static int find_node(struct page_geometry *geometry, int index)
+{
+	if(index < 0 || index >= geometry->nodes[geometry->root].size)
+		return(0);
+
+	int n = geometry->root;
+	while(1) {
+		int left_size = geometry->nodes[geometry->nodes[n].left].size;
+		if(index < left_size) {
+			n = geometry->nodes[n].left;
+		} else if(index == left_size) {
+			return(n);
+		} else {
+			index -= left_size + 1;
+			n = geometry->nodes[n].right;
+		}
+	}
+}
+
+/* the sum of the heights of all pages before index */
+static long heights_before(struct page_geometry *geometry, int index)
+{
+	long sum = 0;
+	int n = geometry->root;
+	while(n != 0) {
+		struct page_node *node = &geometry->nodes[n];
+		int left_size = geometry->nodes[node->left].size;
+		if(index <= left_size) {
+			if(index == left_size)
+				return(sum + geometry->nodes[node->left].sum);
+			n = node->left;
+		} else {
+			sum += geometry->nodes[node->left].sum + node->height;
+			index -= left_size + 1;
+			n = node->right;
+		}
+	}
+	return(sum);
+}
+
+static void apply_estimate(struct page_geometry *geometry, int n)
+{
+	struct page_node *node = &geometry->nodes[n];
+	if(n == 0 || node->inexact == 0)
+		return;
+
+	apply_estimate(geometry, node->left);
+	apply_estimate(geometry, node->right);
+	if(!node->exact) {
+		node->width = geometry->estimate_width;
+		node->height = geometry->estimate_height;
+	}
+	update(geometry, n);
+}
+
+struct page_geometry *page_geometry_new(void)
+{
+	struct page_geometry *geometry = calloc(1, sizeof(struct page_geometry));
+	geometry->capacity = 16;
+	geometry->nodes = calloc(geometry->capacity, sizeof(struct page_node));
+	geometry->used = 1; // the empty node
+	geometry->seed = 2463534242u;
+
+	return(geometry);
+}
+
+void page_geometry_delete(struct page_geometry *geometry)
+{
+	free(geometry->nodes);
+	free(geometry);
+}
+
+void page_geometry_reset(struct page_geometry *geometry, int count)
+{
+	if(count < 0)
+		count = 0;
+
+	geometry->used = 1;
+	geometry->free_list = 0;
+	geometry->root = build_estimated(geometry, count);
+}
+
+void page_geometry_set_estimate(struct page_geometry *geometry, 
+	int width, int height)
+{
+	geometry->estimate_width = width;
+	geometry->estimate_height = height;
+
+	apply_estimate(geometry, geometry->root);
+}
+
+int page_geometry_count(struct page_geometry *geometry)
+{
+	return(geometry->nodes[geometry->root].size);
+}
+
+void page_geometry_set_size(struct page_geometry *geometry, int index, 
+	int width, int height)
+{
+	int target = find_node(geometry, index);
+	if(target == 0)
+		return;
+
+	long delta = (long) height - geometry->nodes[target].height;
+	int inexact = !geometry->nodes[target].exact;
+
+	/* every node on the way down has the page in its subtree */
+	int n = geometry->root;
+	while(1) {
+		struct page_node *node = &geometry->nodes[n];
+		node->sum += delta;
+		node->inexact -= inexact;
+		if(n == target)
+			break;
+
+		int left_size = geometry->nodes[node->left].size;
+		if(index < left_size) {
+			n = node->left;
+		} else {
+			index -= left_size + 1;
+			n = node->right;
+		}
+	}
+
+	geometry->nodes[target].width = width;
+	geometry->nodes[target].height = height;
+	geometry->nodes[target].exact = 1;
+}
+
+int page_geometry_is_exact(struct page_geometry *geometry, int index)
+{
+	return(geometry->nodes[find_node(geometry, index)].exact);
+}
+
+int page_geometry_first_inexact(struct page_geometry *geometry)
+{
+	int n = geometry->root;
+	if(geometry->nodes[n].inexact == 0)
+		return(-1);
+
+	int index = 0;
+	while(1) {
+		struct page_node *node = &geometry->nodes[n];
+		struct page_node *left = &geometry->nodes[node->left];
+		if(left->inexact > 0) {
+			n = node->left;
+		} else if(!node->exact) {
+			return(index + left->size);
+		} else {
+			index += left->size + 1;
+			n = node->right;
+		}
+	}
+}
+
+int page_geometry_get_width(struct page_geometry *geometry, int index)
+{
+	int n = find_node(geometry, index);
+	if(n == 0)
+		return(-1);
+	return(geometry->nodes[n].width);
+}
+
+int page_geometry_get_height(struct page_geometry *geometry, int index)
+{
+	int n = find_node(geometry, index);
+	if(n == 0)
+		return(-1);
+	return(geometry->nodes[n].height);
+}
+
+int page_geometry_get_position(struct page_geometry *geometry, int index)
+{
+	if(index < 0 || index >= page_geometry_count(geometry))
+		return(-1);
+	return((int) (heights_before(geometry, index) + 
+		(long) index * PAGE_GEOMETRY_GAP));
+}
+
+double page_geometry_get_offset(struct page_geometry *geometry, 
+	int index, double zoom)
+{
+	if(index < 0 || index >= page_geometry_count(geometry))
+		return(-1);
+	return(heights_before(geometry, index) * zoom + 
+		(double) index * PAGE_GEOMETRY_GAP);
+}
+
+double page_geometry_get_extent(struct page_geometry *geometry, double zoom)
+{
+	struct page_node *root = &geometry->nodes[geometry->root];
+	return(root->sum * zoom + (double) root->size * PAGE_GEOMETRY_GAP);
+}
+
+int page_geometry_find(struct page_geometry *geometry, double offset, 
+	double zoom)
+{
+	int count = page_geometry_count(geometry);
+	if(count == 0)
+		return(-1);
+	if(offset < 0)
+		return(0);
+
+	int index = 0;
+	int n = geometry->root;
+	while(n != 0) {
+		struct page_node *node = &geometry->nodes[n];
+		struct page_node *left = &geometry->nodes[node->left];
+		double left_extent = left->sum * zoom + 
+			(double) left->size * PAGE_GEOMETRY_GAP;
+		if(offset < left_extent) {
+			n = node->left;
+			continue;
+		}
+
+		offset -= left_extent;
+		index += left->size;
+		double extent = node->height * zoom + PAGE_GEOMETRY_GAP;
+		if(offset < extent)
+			return(index);
+
+		offset -= extent;
+		index++;
+		n = node->right;
+	}
+
+	return(count - 1);
+}
+
+void page_geometry_insert(struct page_geometry *geometry, int index, int count)
+{
+	if(index < 0 || index > page_geometry_count(geometry) || count <= 0)
+		return;
+
+	int pages = build_estimated(geometry, count);
+
+	int before, behind;
+	split(geometry, geometry->root, index, &before, &behind);
+	geometry->root = merge(geometry, merge(geometry, before, pages), behind);
+}
+
+void page_geometry_remove(struct page_geometry *geometry, int index, int count)
+{
+	if(index < 0 || count <= 0 || 
+		index + count > page_geometry_count(geometry))
+	{
+		return;
+	}
+
+	int before, rest, removed, behind;
+	split(geometry, geometry->root, index, &before, &rest);
+	split(geometry, rest, count, &removed, &behind);
+	free_tree(geometry, removed);
+	geometry->root = merge(geometry, before, behind);
+}
+
+/* pages [first, first + count) go behind the pages up to last */
+static void rotate(struct page_geometry *geometry, int first, int count, 
+	int last)
+{
+	int before, block, between, behind, rest;
+	split(geometry, geometry->root, first, &before, &rest);
+	split(geometry, rest, count, &block, &rest);
+	split(geometry, rest, last + 1 - first - count, &between, &behind);
+	geometry->root = merge(geometry, merge(geometry, before, between), 
+		merge(geometry, block, behind));
+}
+
+/* handles the remaps that remove one run of pages or move one block, 
+   returns 0 for all others */
+static int remap_cheaply(struct page_geometry *geometry, 
+	const int *new_index, int new_count)
+{
+	int old_count = page_geometry_count(geometry);
+
+	int first = 0;
+	while(first < old_count && new_index[first] == first)
+		first++;
+	if(first == old_count)
+		return(old_count == new_count);
+
+	int last = old_count - 1;
+	int shift = old_count - new_count;
+	while(last > first && new_index[last] >= 0 && 
+		new_index[last] == last - shift)
+	{
+		last--;
+	}
+
+	int i;
+	if(shift > 0) { // just pages [first, last] removed?
+		if(last - first + 1 != shift)
+			return(0);
+		for(i = first; i <= last; i++) {
+			if(new_index[i] >= 0)
+				return(0);
+		}
+		page_geometry_remove(geometry, first, shift);
+		return(1);
+	}
+	if(shift < 0)
+		return(0);
+
+	/* the pages [first, last] have to be rotated: the block at first goes
+	   to new_index[first] and everything between moves up */
+	int count = last + 1 - new_index[first];
+	if(count <= 0 || count > last - first)
+		return(0);
+	for(i = first; i <= last; i++) {
+		int expected = (i < first + count) ? 
+			i + (last + 1 - first - count) : i - count;
+		if(new_index[i] != expected)
+			return(0);
+	}
+	rotate(geometry, first, count, last);
+	return(1);
+}
+
+void page_geometry_remap(struct page_geometry *geometry, 
+	const int *new_index, int new_count)
+{
+	if(remap_cheaply(geometry, new_index, new_count))
+		return;
+
+	int old_count = page_geometry_count(geometry);
+	int *old_order = malloc((old_count + 1) * sizeof(int));
+	int *new_order = calloc(new_count + 1, sizeof(int));
+	collect(geometry, geometry->root, old_order, 0);
+
+	int i;
+	for(i = 0; i < old_count; i++) {
+		int target = new_index[i];
+		if(target < 0 || target >= new_count) {
+			geometry->nodes[old_order[i]].left = 0;
+			geometry->nodes[old_order[i]].right = 0;
+			free_tree(geometry, old_order[i]);
+			continue;
+		}
+		new_order[target] = old_order[i];
+	}
+
+	/* pages without an old one get the estimated size */
+	for(i = 0; i < new_count; i++) {
+		if(new_order[i] == 0)
+			new_order[i] = alloc_node(geometry);
+	}
+
+	geometry->root = build(geometry, new_order, new_count);
+
+	free(old_order);
+	free(new_order);
+}
@@ -0,0 +1,97 @@
+/*
+  page-geometry.h - sizes and positions of all pages
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JUGGLER_PAGE_GEOMETRY_H_
+#define _JUGGLER_PAGE_GEOMETRY_H_
+
+/* the pages are placed one below the other, so the position of a page is 
+   the sum of the heights of all pages before it plus a gap after each one.
+   The pages are the nodes of a treap ordered by page index, every node 
+   knows the number and the summed heights of the pages below it. So 
+   changing the size of a page, looking up a position and inserting, 
+   removing or moving a single page all take logarithmic time.
+   Measuring all pages of a big document takes long, so until a page has got
+   its real size, it has an estimated one (e. g. the size of the first page)
+   and is marked as not exact */
+
+/* the space between two pages */
+#define PAGE_GEOMETRY_GAP 10
+
+struct page_geometry;
+
+extern struct page_geometry *page_geometry_new(void);
+
+extern void page_geometry_delete(struct page_geometry *geometry);
+
+/* forgets all sizes, afterwards there are count pages with the estimated 
+   size */
+extern void page_geometry_reset(struct page_geometry *geometry, int count);
+
+/* changes the size of all pages that are not exact and of those that will be
+   inserted later */
+extern void page_geometry_set_estimate(struct page_geometry *geometry, 
+	int width, int height);
+
+extern int page_geometry_count(struct page_geometry *geometry);
+
+/* the page is exact afterwards */
+extern void page_geometry_set_size(struct page_geometry *geometry, int index, 
+	int width, int height);
+
+extern int page_geometry_is_exact(struct page_geometry *geometry, int index);
+
+/* returns -1 if all pages are exact */
+extern int page_geometry_first_inexact(struct page_geometry *geometry);
+
+/* all those return -1 if index is out of range */
+extern int page_geometry_get_width(struct page_geometry *geometry, int index);
+
+extern int page_geometry_get_height(struct page_geometry *geometry, int index);
+
+extern int page_geometry_get_position(struct page_geometry *geometry, int index);
+
+/* like page_geometry_get_position(), but all heights are scaled by zoom
+   while the gaps are not */
+extern double page_geometry_get_offset(struct page_geometry *geometry, 
+	int index, double zoom);
+
+/* the offset behind the gap of the last page */
+extern double page_geometry_get_extent(struct page_geometry *geometry, 
+	double zoom);
+
+/* the page whose area (including the gap behind it) contains offset; offsets
+   before the first page give 0, those behind the last one the last page and
+   an empty document -1 */
+extern int page_geometry_find(struct page_geometry *geometry, double offset, 
+	double zoom);
+
+/* the new pages have the estimated size until page_geometry_set_size() is 
+   called */
+extern void page_geometry_insert(struct page_geometry *geometry, 
+	int index, int count);
+
+extern void page_geometry_remove(struct page_geometry *geometry, 
+	int index, int count);
+
+/* page i becomes page new_index[i], pages with a negative new index are
+   dropped; each new index may only be used once. Removing one run of pages
+   and moving one block of pages are done without building the tree again */
+extern void page_geometry_remap(struct page_geometry *geometry, 
+	const int *new_index, int new_count);
+
+#endif /* _JUGGLER_PAGE_GEOMETRY_H_ */
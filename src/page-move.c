@@ -0,0 +1,127 @@
+/*
+  page-move.c - change the order of pages
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "page-move.h"
+
+#include "internal.h"
+#include "page-attrs.h"
+#include "page-tree.h"
+
+ErrorCode juggler_permute_pages(juggler_t *juggler, 
+	const int *new_order, int count)
+{
+	fz_context *ctx = juggler->ctx;
+	pdf_document *doc = juggler->pdf;
+
+	if(count != juggler->pagecount)
+		return(ERROR_INVALID_RANGE);
+
+	/* new_index is the inverse of new_order, if that's not possible it's no
+	   permutation */
+	int *new_index = malloc(sizeof(int) * count);
+	int i;
+	for(i = 0; i < count; i++)
+		new_index[i] = -1;
+	for(i = 0; i < count; i++) {
+		if(new_order[i] < 0 || new_order[i] >= count || 
+			new_index[new_order[i]] >= 0)
+		{
+			free(new_index);
+			return(ERROR_INVALID_RANGE);
+		}
+		new_index[new_order[i]] = i;
+	}
+
+	page_attrs_t *attrs = malloc(sizeof(page_attrs_t) * count);
+	page_slot_t *slots = malloc(sizeof(page_slot_t) * count);
+	ErrorCode result = juggler_resolve_page_attrs(ctx, doc, 0, count, attrs);
+	if(result == NoError)
+		result = page_tree_collect_slots(ctx, doc, slots, count);
+	if(result != NoError) {
+		free(new_index);
+		free(attrs);
+		free(slots);
+		return(result);
+	}
+
+	/* the references are borrowed from the /Kids-arrays that are going to 
+	   be overwritten */
+	for(i = 0; i < count; i++)
+		pdf_keep_obj(ctx, attrs[i].page);
+
+	for(i = 0; i < count; i++) {
+		const page_attrs_t *page = &attrs[new_order[i]];
+		page_slot_t *old_slot = &slots[new_order[i]];
+		page_slot_t *new_slot = &slots[i];
+
+		if(new_order[i] == i)
+			continue;
+
+		if(old_slot->parent != new_slot->parent) {
+			juggler_materialize_page_attrs(ctx, doc, page);
+			pdf_dict_puts_drop(ctx, page->page, "Parent", pdf_new_indirect(ctx, 
+				doc, pdf_to_num(ctx, new_slot->parent), 
+				pdf_to_gen(ctx, new_slot->parent)));
+		}
+
+		pdf_array_put(ctx, pdf_dict_gets(ctx, new_slot->parent, "Kids"), 
+			new_slot->kid_index, page->page);
+	}
+
+	for(i = 0; i < count; i++)
+		pdf_drop_obj(ctx, attrs[i].page);
+	free(attrs);
+	free(slots);
+
+	/* nothing has been added or removed, the pages just got other numbers */
+	juggler_page_tree_changed_due_to_remap(juggler, new_index, count);
+	free(new_index);
+
+	return(NoError);
+}
+
+ErrorCode juggler_move_pages(juggler_t *juggler, 
+	int first, int last, int dest_index)
+{
+	int count = juggler->pagecount;
+	if(first < 0 || last >= count || first > last || 
+		dest_index < 0 || dest_index > count)
+	{
+		return(ERROR_INVALID_RANGE);
+	}
+
+	/* the pages before dest_index that are not moved, then the moved ones, 
+	   then the rest */
+	int *new_order = malloc(sizeof(int) * count);
+	int i, next = 0;
+	for(i = 0; i < dest_index; i++) {
+		if(i < first || i > last)
+			new_order[next++] = i;
+	}
+	for(i = first; i <= last; i++)
+		new_order[next++] = i;
+	for(i = dest_index; i < count; i++) {
+		if(i < first || i > last)
+			new_order[next++] = i;
+	}
+
+	ErrorCode result = juggler_permute_pages(juggler, new_order, count);
+	free(new_order);
+
+	return(result);
+}
@@ -0,0 +1,36 @@
+/*
+  page-move.h - change the order of pages
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JUGGLER_PAGE_MOVE_H_
+#define _JUGGLER_PAGE_MOVE_H_
+
+#include "document.h"
+
+/* rearranges the pages so that page i is the page that had the index 
+   new_order[i] before; new_order must contain each index of the document 
+   exactly once. No page is copied, just the references in the page tree
+   are exchanged */
+extern ErrorCode juggler_permute_pages(juggler_t *juggler, 
+	const int *new_order, int count);
+
+/* moves the pages first to last in front of the page dest_index, which is 
+   an index before the move (the page count to move them to the end) */
+extern ErrorCode juggler_move_pages(juggler_t *juggler, 
+	int first, int last, int dest_index);
+
+#endif /* _JUGGLER_PAGE_MOVE_H_ */
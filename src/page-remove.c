@@ -19,82 +19,117 @@
 #include "page-remove.h"
 
 #include "internal.h"
+#include "page-tree.h"
+#include "page-set.h"
 
-// Be aware that page_num needs to be the index of the page to delete + 1
-// Return values:
-//  -2: an error occured
-//  -1: do count-- on current
-//   0: delete the object that is current
-//  >0: continue to next node
-static int remove_from_page_tree(juggler_t *juggler, int page_num, pdf_obj *current)
+struct prune_state
 {
-	if(!strcmp(pdf_to_name(juggler->ctx, pdf_dict_gets(juggler->ctx, current, "Type")), "Page")) {
-		return(--page_num); // returns -1 if this is the right page, else a higher number
-	} if(!strcmp(pdf_to_name(juggler->ctx, pdf_dict_gets(juggler->ctx, current, "Type")), "Pages")) {
-		pdf_obj *kids = pdf_dict_gets(juggler->ctx, current, "Kids");
-		pdf_obj *count_obj = pdf_dict_gets(juggler->ctx, current, "Count");
-		if(!pdf_is_array(juggler->ctx, kids) || !pdf_is_int(juggler->ctx, count_obj))
-			return(-2);
-
-		int count = pdf_to_int(juggler->ctx, count_obj);
-		int i;
-		for(i = 0; i < count; i++) {
-			pdf_obj *current_kid = pdf_array_get(juggler->ctx, kids, i);
-
-			page_num = remove_from_page_tree(juggler, page_num, current_kid);
-			if(page_num == 0) {
-				printf("Deleting object: %d %d obj\n", 
-					pdf_to_num(juggler->ctx, current_kid), 
-					pdf_to_gen(juggler->ctx, current_kid));
-				pdf_array_delete(juggler->ctx, kids, i);
-
-                // update count value
-				count--;
-				pdf_obj *new_count = pdf_new_int(juggler->ctx, juggler->pdf, count);
-				pdf_dict_puts_drop(juggler->ctx, current, "Count", new_count);
-				
-				if(count < 1) // if this was the only kid...
-					return(0); // ...delete this pages-object too
-				else
-					return(-1); // everything is done
-			} else if(page_num == -1) {
-				count--;
-				pdf_obj *new_count = pdf_new_int(juggler->ctx, juggler->pdf, count);
-				pdf_dict_puts_drop(juggler->ctx, current, "Count", new_count);
-
-				return(-1);
-			} else if(page_num < -1) {
-				return(page_num);
+	fz_context *ctx;
+	pdf_document *doc;
+	struct page_set *set;
+	int next_page; // the index of the next page in the tree
+	page_location_t path; // the nodes above, to find cycles
+};
+
+/* removes all pages of the set below node and returns how many they were;
+   each /Count is only written once, after all kids have been visited */
+static int prune_node(struct prune_state *state, pdf_obj *node)
+{
+	fz_context *ctx = state->ctx;
+
+	if(!page_location_enter(ctx, &state->path, node))
+		fz_throw(ctx, FZ_ERROR_GENERIC, "cycle in page tree");
+
+	pdf_obj *kids = pdf_dict_gets(ctx, node, "Kids");
+	int count = pdf_to_int(ctx, pdf_dict_gets(ctx, node, "Count"));
+	int removed = 0;
+
+	int i = 0;
+	while(i < pdf_array_len(ctx, kids)) {
+		pdf_obj *kid = pdf_array_get(ctx, kids, i);
+
+		if(!pdf_is_array(ctx, pdf_dict_gets(ctx, kid, "Kids"))) { // a page
+			int page = state->next_page++;
+			if(page_set_contains(state->set, page)) {
+				pdf_array_delete(ctx, kids, i);
+				removed++;
+				continue;
 			}
+			i++;
+			continue;
+		}
+
+		/* don't descend into subtrees that keep all their pages */
+		int kid_count = pdf_to_int(ctx, pdf_dict_gets(ctx, kid, "Count"));
+		if(!page_set_any_in_range(state->set, state->next_page, kid_count)) {
+			state->next_page += kid_count;
+			i++;
+			continue;
+		}
+
+		int kid_removed = prune_node(state, kid);
+		removed += kid_removed;
+		if(kid_removed == kid_count) { // nothing left in there
+			pdf_array_delete(ctx, kids, i);
+			continue;
 		}
+		i++;
+	}
 
-		return(page_num);
+	if(removed > 0) {
+		pdf_dict_puts_drop(ctx, node, "Count", 
+			pdf_new_int(ctx, state->doc, count - removed));
 	}
 
-	return(-2);
+	page_location_leave(ctx, &state->path);
+	return(removed);
 }
 
-ErrorCode juggler_remove_page(juggler_t *juggler, int page_index)
+ErrorCode juggler_remove_page_set(juggler_t *juggler, struct page_set *set)
 {
-	if(page_index >= juggler->pagecount)
+	int old_count = juggler->pagecount;
+	if(page_set_pagecount(set) != old_count)
+		return(ErrorUsage);
+	if(page_set_size(set) == 0)
+		return(NoError);
+	if(page_set_size(set) == old_count) // a document needs at least one page
 		return(ERROR_INVALID_RANGE);
 
 	pdf_obj *pages = pdf_dict_getp(juggler->ctx, pdf_trailer(juggler->ctx, juggler->pdf), "Root/Pages");
 	if(!pdf_is_indirect(juggler->ctx, pages) || !pdf_is_dict(juggler->ctx, pages))
 		return(ERROR_NO_PAGES);
 
-	remove_from_page_tree(juggler, page_index + 1, pages);
+	struct prune_state state = { juggler->ctx, juggler->pdf, set, 0 };
+	page_location_init(&state.path);
+	fz_try(juggler->ctx) {
+		prune_node(&state, pages);
+	} fz_always(juggler->ctx) {
+		page_location_release(juggler->ctx, &state.path);
+	} fz_catch(juggler->ctx) {
+		/* nobody knows which pages are gone, so start from scratch */
+		juggler_page_tree_changed(juggler);
+		return(ErrorInvalidReference);
+	}
 
-	juggler_page_tree_changed_due_to_remove(juggler, page_index, 1);
+	/* where did the remaining pages go? */
+	int *new_index = malloc(sizeof(int) * old_count);
+	int i, next = 0;
+	for(i = 0; i < old_count; i++)
+		new_index[i] = page_set_contains(set, i) ? -1 : next++;
+
+	juggler_page_tree_changed_due_to_remap(juggler, new_index, old_count);
+	free(new_index);
 
 	// TODO: Additional things: names, outlines, ...
 
 	return(NoError);
 }
 
+ErrorCode juggler_remove_page(juggler_t *juggler, int page_index)
+{
+	return(juggler_remove_pages(juggler, page_index, page_index));
+}
 
-/* Be aware that this function could only delete some of the pages of the
-   supplied range if there is a problem with just one page! */
 ErrorCode juggler_remove_pages(juggler_t *juggler, 
 	int firstIndex, int lastIndex)
 {
@@ -106,11 +141,11 @@ ErrorCode juggler_remove_pages(juggler_t *juggler,
 		return(ERROR_INVALID_RANGE);
 	}
 
-	ErrorCode lastError;
-	int i;
-	for(i = lastIndex; i >= firstIndex; i--)
-		if((lastError = juggler_remove_page(juggler, i)) != NoError)
-			return(lastError);
+	struct page_set *set = page_set_new(juggler->pagecount);
+	page_set_add_range(set, firstIndex, lastIndex);
 
-	return(NoError);
+	ErrorCode result = juggler_remove_page_set(juggler, set);
+	page_set_delete(set);
+
+	return(result);
 }
@@ -21,6 +21,14 @@
 
 #include "document.h"
 
+struct page_set;
+
+/* removes all pages of the set with one walk through the page tree, empty
+   /Pages-nodes are removed too; the set must have been created with the 
+   current number of pages and must not contain all of them */
+extern ErrorCode juggler_remove_page_set(juggler_t *juggler, 
+	struct page_set *set);
+
 extern ErrorCode juggler_remove_page(juggler_t *juggler, int pageIndex);
 
 extern ErrorCode  juggler_remove_pages(juggler_t *juggler, 
@@ -19,16 +19,18 @@
 #include "page-rotate.h"
 
 #include "internal.h"
+#include "page-attrs.h"
+#include "page-set.h"
 
 ErrorCode juggler_get_page_rotation(juggler_t *juggler, int index, int *rotation)
 {
-	pdf_obj *pageobj = pdf_lookup_page_obj(juggler->ctx, juggler->pdf, index);
-	pdf_obj *rotate = juggler_lookup_inherited_page_item(juggler->ctx, juggler->pdf, pageobj, "Rotate");
-	
-	if(pdf_is_int(juggler->ctx, rotate))
-		*rotation = pdf_to_int(juggler->ctx, rotate);
-	else
-		*rotation = 0;
+	page_attrs_t attrs;
+	ErrorCode result = 
+		juggler_resolve_page_attrs(juggler->ctx, juggler->pdf, index, 1, &attrs);
+	if(result != NoError)
+		return(result);
+
+	*rotation = attrs.rotate;
 
 	return(NoError);
 }
@@ -43,7 +45,47 @@ ErrorCode juggler_set_page_rotation(juggler_t *juggler, int index, int rotation)
 
 	pdf_dict_puts_drop(juggler->ctx, pageobj, "Rotate", new_rotate);
 
-	juggler_page_tree_changed(juggler);
+	juggler_page_changed(juggler, index); // nothing but this page moves
 
 	return(NoError);
 }
+
+ErrorCode juggler_rotate_page_set(juggler_t *juggler, struct page_set *set, 
+	int angle, int relative)
+{
+	if(angle % 90 != 0 || (!relative && (angle < 0 || angle >= 360)))
+		return(ERROR_INVALID_RANGE);
+	if(page_set_pagecount(set) != juggler->pagecount)
+		return(ErrorUsage);
+
+	int first = page_set_next(set, 0);
+	if(first < 0)
+		return(NoError);
+	int last = first;
+	int i;
+	for(i = first; i >= 0; i = page_set_next(set, i + 1))
+		last = i;
+
+	/* all page objects and their current rotation with one walk */
+	int count = last - first + 1;
+	page_attrs_t *attrs = malloc(sizeof(page_attrs_t) * count);
+	ErrorCode result = juggler_resolve_page_attrs(juggler->ctx, juggler->pdf, 
+		first, count, attrs);
+
+	for(i = first; i >= 0 && result == NoError; i = page_set_next(set, i + 1)) {
+		page_attrs_t *page = &attrs[i - first];
+		int rotation = (relative ? page->rotate + angle : angle) % 360;
+		if(rotation < 0)
+			rotation += 360;
+
+		pdf_dict_puts_drop(juggler->ctx, page->page, "Rotate", 
+			pdf_new_int(juggler->ctx, juggler->pdf, rotation));
+	}
+
+	free(attrs);
+
+	if(result == NoError)
+		juggler_pages_changed(juggler, set);
+
+	return(result);
+}
@@ -25,4 +25,11 @@ extern ErrorCode juggler_get_page_rotation(juggler_t *juggler, int index, int *r
 
 extern ErrorCode juggler_set_page_rotation(juggler_t *juggler, int index, int rotation);
 
+struct page_set;
+
+/* sets the rotation of all pages in set to angle or, if relative is not 0, 
+   adds angle to their current rotation; angle must be a multiple of 90 */
+extern ErrorCode juggler_rotate_page_set(juggler_t *juggler, 
+	struct page_set *set, int angle, int relative);
+
 #endif /* _JUGGLER_PAGE_ROTATE_H_ */
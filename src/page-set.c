@@ -0,0 +1,141 @@
+/*
+  page-set.c - an arbitrary selection of pages
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "page-set.h"
+
+#include <limits.h>
+#include <stdlib.h>
+
+#define BITS_PER_WORD (sizeof(unsigned long) * CHAR_BIT)
+
+struct page_set
+{
+	int pagecount;
+	int size;
+	unsigned long *bits;
+};
+
+struct page_set *page_set_new(int pagecount)
+{
+	if(pagecount < 0)
+		pagecount = 0;
+
+	struct page_set *set = malloc(sizeof(struct page_set));
+	set->pagecount = pagecount;
+	set->size = 0;
+	set->bits = calloc(pagecount / BITS_PER_WORD + 1, sizeof(unsigned long));
+
+	return(set);
+}
+
+void page_set_delete(struct page_set *set)
+{
+	free(set->bits);
+	free(set);
+}
+
+int page_set_pagecount(struct page_set *set)
+{
+	return(set->pagecount);
+}
+
+int page_set_size(struct page_set *set)
+{
+	return(set->size);
+}
+
+void page_set_add(struct page_set *set, int index)
+{
+	if(index < 0 || index >= set->pagecount || page_set_contains(set, index))
+		return;
+
+	set->bits[index / BITS_PER_WORD] |= 1UL << (index % BITS_PER_WORD);
+	set->size++;
+}
+
+void page_set_add_range(struct page_set *set, int first, int last)
+{
+	int i;
+	for(i = first; i <= last; i++)
+		page_set_add(set, i);
+}
+
+void page_set_remove(struct page_set *set, int index)
+{
+	if(!page_set_contains(set, index))
+		return;
+
+	set->bits[index / BITS_PER_WORD] &= ~(1UL << (index % BITS_PER_WORD));
+	set->size--;
+}
+
+int page_set_contains(struct page_set *set, int index)
+{
+	if(index < 0 || index >= set->pagecount)
+		return(0);
+
+	return((set->bits[index / BITS_PER_WORD] >> (index % BITS_PER_WORD)) & 1);
+}
+
+int page_set_next(struct page_set *set, int index)
+{
+	if(index < 0)
+		index = 0;
+
+	while(index < set->pagecount) {
+		unsigned long word = set->bits[index / BITS_PER_WORD] >> (index % BITS_PER_WORD);
+		if(word == 0) { // skip the rest of the word
+			index += BITS_PER_WORD - index % BITS_PER_WORD;
+			continue;
+		}
+		while(!(word & 1)) {
+			word >>= 1;
+			index++;
+		}
+		return(index < set->pagecount ? index : -1);
+	}
+
+	return(-1);
+}
+
+int page_set_any_in_range(struct page_set *set, int first, int count)
+{
+	if(first < 0) {
+		count += first;
+		first = 0;
+	}
+	if(first + count > set->pagecount)
+		count = set->pagecount - first;
+
+	int i = first;
+	int end = first + count;
+	while(i < end) {
+		/* whole words can be tested at once */
+		if(i % BITS_PER_WORD == 0 && end - i >= BITS_PER_WORD) {
+			if(set->bits[i / BITS_PER_WORD] != 0)
+				return(1);
+			i += BITS_PER_WORD;
+		} else {
+			if(page_set_contains(set, i))
+				return(1);
+			i++;
+		}
+	}
+
+	return(0);
+}
@@ -0,0 +1,57 @@
+/*
+  page-set.h - an arbitrary selection of pages
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JUGGLER_PAGE_SET_H_
+#define _JUGGLER_PAGE_SET_H_
+
+/* a bitmap with one bit for each page of a document, so that functions can
+   work on any selection of pages in one go instead of being called for each
+   single page */
+
+struct page_set;
+
+extern struct page_set *page_set_new(int pagecount);
+
+extern void page_set_delete(struct page_set *set);
+
+/* the number of pages of the document the set has been created for */
+extern int page_set_pagecount(struct page_set *set);
+
+/* the number of selected pages */
+extern int page_set_size(struct page_set *set);
+
+extern void page_set_add(struct page_set *set, int index);
+
+/* adds the pages first to last (both included), indexes outside of the 
+   document are ignored */
+extern void page_set_add_range(struct page_set *set, int first, int last);
+
+extern void page_set_remove(struct page_set *set, int index);
+
+extern int page_set_contains(struct page_set *set, int index);
+
+/* returns the first selected page that is not before index or -1 if there
+   is none, so that all pages of a set can be visited with
+   for(i = page_set_next(set, 0); i >= 0; i = page_set_next(set, i + 1)) */
+extern int page_set_next(struct page_set *set, int index);
+
+/* returns 1 if at least one of the pages first to first + count - 1 has been
+   selected */
+extern int page_set_any_in_range(struct page_set *set, int first, int count);
+
+#endif /* _JUGGLER_PAGE_SET_H_ */
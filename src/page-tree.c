@@ -0,0 +1,196 @@
+/*
+  page-tree.c - find pages in the page tree by their index
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "page-tree.h"
+
+/* a node is a /Pages-node if it has kids, everything else is a page */
+static int is_pages_node(fz_context *ctx, pdf_obj *node)
+{
+	return(pdf_is_array(ctx, pdf_dict_gets(ctx, node, "Kids")));
+}
+
+static int subtree_count(fz_context *ctx, pdf_obj *node)
+{
+	if(!is_pages_node(ctx, node))
+		return(1);
+	return(pdf_to_int(ctx, pdf_dict_gets(ctx, node, "Count")));
+}
+
+void page_location_init(page_location_t *location)
+{
+	location->depth = 0;
+	location->cap = 0;
+	location->path = NULL;
+	location->kid_index = NULL;
+}
+
+int page_location_enter(fz_context *ctx, page_location_t *location, 
+	pdf_obj *node)
+{
+	if(pdf_mark_obj(ctx, node))
+		return(0);
+
+	if(location->depth == location->cap) {
+		location->cap = (location->cap == 0 ? 16 : location->cap * 2);
+		location->path = 
+			realloc(location->path, location->cap * sizeof(pdf_obj *));
+		location->kid_index = 
+			realloc(location->kid_index, location->cap * sizeof(int));
+	}
+	location->path[location->depth] = node;
+	location->kid_index[location->depth] = 0;
+	location->depth++;
+
+	return(1);
+}
+
+void page_location_leave(fz_context *ctx, page_location_t *location)
+{
+	pdf_unmark_obj(ctx, location->path[--location->depth]);
+}
+
+void page_location_release(fz_context *ctx, page_location_t *location)
+{
+	while(location->depth > 0)
+		page_location_leave(ctx, location);
+
+	free(location->path);
+	free(location->kid_index);
+	page_location_init(location);
+}
+
+static void unmark_path(fz_context *ctx, page_location_t *location)
+{
+	int i;
+	for(i = 0; i < location->depth; i++)
+		pdf_unmark_obj(ctx, location->path[i]);
+}
+
+static ErrorCode descend(fz_context *ctx, pdf_obj *node, int index, 
+	page_location_t *location)
+{
+	while(1) {
+		if(!page_location_enter(ctx, location, node))
+			return(ErrorInvalidReference); // a cycle
+
+		pdf_obj *kids = pdf_dict_gets(ctx, node, "Kids");
+		int kids_count = pdf_array_len(ctx, kids);
+		location->kid_index[location->depth - 1] = kids_count; // the end
+
+		pdf_obj *next = NULL;
+		int i;
+		for(i = 0; i < kids_count; i++) {
+			pdf_obj *kid = pdf_array_get(ctx, kids, i);
+			int count = subtree_count(ctx, kid);
+			if(index < count) {
+				location->kid_index[location->depth - 1] = i;
+				next = kid;
+				break;
+			}
+			index -= count;
+		}
+
+		if(next == NULL) {
+			/* only the end of the page tree may be behind all kids */
+			if(index != 0)
+				return(ERROR_INVALID_RANGE);
+			return(NoError);
+		}
+		if(!is_pages_node(ctx, next))
+			return(NoError); // that's the page
+
+		node = next;
+	}
+}
+
+ErrorCode page_tree_locate(fz_context *ctx, pdf_document *doc, 
+	int index, page_location_t *location)
+{
+	pdf_obj *node = pdf_dict_getp(ctx, pdf_trailer(ctx, doc), "Root/Pages");
+	if(!pdf_is_dict(ctx, node) || !is_pages_node(ctx, node))
+		return(ERROR_NO_PAGES);
+	if(index < 0 || index > subtree_count(ctx, node))
+		return(ERROR_INVALID_RANGE);
+
+	location->depth = 0;
+	ErrorCode result = ErrorInvalidReference;
+	fz_try(ctx) {
+		result = descend(ctx, node, index, location);
+	} fz_always(ctx) {
+		/* MuPDF uses the marks itself, e. g. when it loads the page tree */
+		unmark_path(ctx, location);
+	} fz_catch(ctx) {
+		return(ErrorInvalidReference);
+	}
+
+	return(result);
+}
+
+void page_tree_adjust_counts(fz_context *ctx, pdf_document *doc, 
+	const page_location_t *location, int delta)
+{
+	int i;
+	for(i = 0; i < location->depth; i++) {
+		pdf_obj *node = location->path[i];
+		int count = pdf_to_int(ctx, pdf_dict_gets(ctx, node, "Count")) + delta;
+		pdf_dict_puts_drop(ctx, node, "Count", pdf_new_int(ctx, doc, count));
+	}
+}
+
+static void collect_slots(fz_context *ctx, pdf_obj *node, 
+	page_location_t *path, page_slot_t *slots, int count, int *next)
+{
+	if(!page_location_enter(ctx, path, node))
+		fz_throw(ctx, FZ_ERROR_GENERIC, "cycle in page tree");
+
+	pdf_obj *kids = pdf_dict_gets(ctx, node, "Kids");
+	int i;
+	for(i = 0; i < pdf_array_len(ctx, kids) && *next < count; i++) {
+		pdf_obj *kid = pdf_array_get(ctx, kids, i);
+		if(is_pages_node(ctx, kid)) {
+			collect_slots(ctx, kid, path, slots, count, next);
+		} else {
+			slots[*next].parent = node;
+			slots[*next].kid_index = i;
+			(*next)++;
+		}
+	}
+
+	page_location_leave(ctx, path);
+}
+
+ErrorCode page_tree_collect_slots(fz_context *ctx, pdf_document *doc, 
+	page_slot_t *slots, int count)
+{
+	pdf_obj *root = pdf_dict_getp(ctx, pdf_trailer(ctx, doc), "Root/Pages");
+	if(!pdf_is_dict(ctx, root) || !is_pages_node(ctx, root))
+		return(ERROR_NO_PAGES);
+
+	int next = 0;
+	page_location_t path;
+	page_location_init(&path);
+	fz_try(ctx) {
+		collect_slots(ctx, root, &path, slots, count, &next);
+	} fz_always(ctx) {
+		page_location_release(ctx, &path);
+	} fz_catch(ctx) {
+		return(ErrorInvalidReference);
+	}
+
+	return(next == count ? NoError : ERROR_INVALID_RANGE);
+}
@@ -0,0 +1,78 @@
+/*
+  page-tree.h - find pages in the page tree by their index
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JUGGLER_PAGE_TREE_H_
+#define _JUGGLER_PAGE_TREE_H_
+
+#include <mupdf/fitz.h>
+#include <mupdf/pdf.h>
+
+#include "error.h"
+
+/* the way from the root of the page tree down to a page: path[0] is the root,
+   path[depth - 1] is the /Pages node that contains the page and kid_index[i]
+   is the position of the next node (or of the page) in the /Kids of path[i].
+   The nodes are borrowed from the document, the arrays grow with the depth */
+typedef struct
+{
+	int depth;
+	int cap;
+	pdf_obj **path;
+	int *kid_index;
+} page_location_t;
+
+extern void page_location_init(page_location_t *location);
+
+/* appends node to the path and marks it; returns 0 and does nothing if node
+   already is on the path, as the page tree contains a cycle then. Any depth
+   is fine otherwise */
+extern int page_location_enter(fz_context *ctx, page_location_t *location, 
+	pdf_obj *node);
+
+/* removes the last node from the path and unmarks it */
+extern void page_location_leave(fz_context *ctx, page_location_t *location);
+
+/* unmarks all nodes that are still on the path (e. g. after an exception) 
+   and frees the arrays */
+extern void page_location_release(fz_context *ctx, page_location_t *location);
+
+/* descends from the root to the page, choosing the kid by the /Count of the
+   subtrees, so it only looks at the nodes on the way (and their kids). An
+   index equal to the number of pages locates the end of the root's /Kids.
+   The nodes are not marked anymore when it returns, but the location has
+   to be released */
+extern ErrorCode page_tree_locate(fz_context *ctx, pdf_document *doc, 
+	int index, page_location_t *location);
+
+/* adds delta to the /Count of every node on the path */
+extern void page_tree_adjust_counts(fz_context *ctx, pdf_document *doc, 
+	const page_location_t *location, int delta);
+
+/* where a page is referenced: its position in the /Kids of parent */
+typedef struct
+{
+	pdf_obj *parent;
+	int kid_index;
+} page_slot_t;
+
+/* collects the slots of all pages in the order of the page tree, slots must
+   have space for count entries */
+extern ErrorCode page_tree_collect_slots(fz_context *ctx, pdf_document *doc, 
+	page_slot_t *slots, int count);
+
+#endif /* _JUGGLER_PAGE_TREE_H_ */
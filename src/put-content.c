@@ -19,124 +19,206 @@
 
 #include "copy-helper.h"
 #include "internal.h"
-#include "rename-lexer.h"
+#include "content-scan.h"
+#include "page-attrs.h"
+#include "deferred-streams.h"
+
+static char *RESOURCE_TYPES[] = 
+	{ "ExtGState", "ColorSpace", "Pattern", "Shading", "XObject", 
+	  "Font", "Properties" };
+static char *RESOURCE_PREFIXES[] =
+	{ "E_", "C_", "P_", "S_", "X_", "F_", "T_" };
+#define RESOURCE_TYPES_COUNT (sizeof(RESOURCE_TYPES) / sizeof(RESOURCE_TYPES[0]))
+
+/* one entry of a source resource dict and its name on the sheets */
+struct resource_entry
+{
+	int type; // index into RESOURCE_TYPES
+	pdf_obj *src_val; // borrowed from the source
+	char dest_name[64]; /* this buffer is big enough up to hold all digits for two 16-bit numbers */
+};
+
+/* everything that is needed to put a page with this resource dict onto a 
+   sheet; this is built once for each resource dict of the source, so 
+   pages that share their resources share it on all sheets */
+struct resource_renames
+{
+	pdf_obj *resources; // borrowed from the source
+	struct rename_table *table;
+	struct resource_entry *entries;
+	size_t entries_count;
+};
 
 struct put_info
 {
 	pdf_document *dest_doc;
 	pdf_document *src_doc;
-	pdf_obj *rename_dict;
-	int *new_ids;
+	struct rename_table *renames; // of the current source page
+	struct copy_map *new_ids;
 	int next_inline_id;
+
+	/* only for PUT_MODE_FORMS: the form of each source page or 0 */
+	int *form_nums;
+
+	struct resource_renames **resource_renames;
+	size_t resource_renames_count;
+	struct copy_map *renames_by_num; // indirect resource dicts -> index + 1
 };
 
-// just copy one of the resource sub-entries (e.g. /Font)
-static int copy_and_rename_resource(fz_context *dest_ctx, pdf_obj *dest, 
-	fz_context *src_ctx, pdf_obj *src, char *prefix, struct put_info *info)
+// just collect the new names of one of the resource sub-entries (e.g. /Font)
+static int collect_resource_names(fz_context *src_ctx, pdf_obj *src, int type, 
+	struct resource_renames *renames, struct put_info *info)
 {
-	char new_name[64]; /* this buffer is big enough up to hold all digits for two 16-bit numbers */
+	int len = pdf_dict_len(src_ctx, src);
+	renames->entries = realloc(renames->entries, 
+		(renames->entries_count + len) * sizeof(struct resource_entry));
 
-    int i;
-    for(i = 0; i < pdf_dict_len(src_ctx, src); i++) {
-        pdf_obj *src_key = pdf_dict_get_key(src_ctx, src, i);
+	int i;
+	for(i = 0; i < len; i++) {
+		pdf_obj *src_key = pdf_dict_get_key(src_ctx, src, i);
 		pdf_obj *src_val = pdf_dict_get_val(src_ctx, src, i);
 
 		if(!pdf_is_name(src_ctx, src_key)) {
 			return(2);
 		}
-		
-		/* if this is an inline resource, just copy this object into the new
-		    resource dict */	
+
+		struct resource_entry *entry = &renames->entries[renames->entries_count];
+		entry->type = type;
+		entry->src_val = src_val;
+
+		/* The new name of resource objects is always the num/gen of the 
+		   referenced object in the src-file. Thus we can check by that name
+		   if the object was already referenced by another page of this sheet.
+		   Inline resources get a number of their own. */
+		int written;
 		if(!pdf_is_indirect(src_ctx, src_val)) {
-			if(snprintf(new_name, sizeof(new_name) / sizeof(new_name[0]), 
-					"%sinline_%d", prefix, info->next_inline_id++) >= sizeof(new_name) / sizeof(new_name[0]))
-				return(1); // not enough space
-		
-			pdf_obj *new_res = copy_unassigned_object_continue(dest_ctx, 
-				info->dest_doc, src_ctx, info->src_doc, src_val, &info->new_ids);
-				
-			//pdf_obj *new_res = pdf_new_dict(dest_ctx, info->dest_doc, 10);
-			printf("dump it...\n");
-			pdf_fprint_obj(dest_ctx, stdout, new_res, 0);
-				
-			/* now reference this new object in the resource object of this sheet */
-			pdf_obj *dest_key = pdf_new_name(dest_ctx, info->dest_doc, new_name);
-
-			pdf_dict_put(dest_ctx, dest, dest_key, new_res);
-			pdf_drop_obj(dest_ctx, dest_key);
-			pdf_drop_obj(dest_ctx, new_res);
+			written = snprintf(entry->dest_name, sizeof(entry->dest_name), 
+				"%sinline_%d", RESOURCE_PREFIXES[type], info->next_inline_id++);
 		} else {
-			/* The new name of resource objects is always the num/gen of the 
-			   referenced object in the src-file. Thus we can check by that name
-			   if the object was already referenced by another page of this sheet. */
-			if(snprintf(new_name, sizeof(new_name) / sizeof(new_name[0]), 
-					"%s%d_%d", prefix, pdf_to_num(dest_ctx, src_val), pdf_to_gen(dest_ctx, src_val)) >= 
-					sizeof(new_name) / sizeof(new_name[0]))
-				return(1); // not enough space
-						
-			if(pdf_dict_gets(dest_ctx, dest, new_name) == NULL) {
-			   /* if this resource is not inlined and not already in the resource-dict 
-				  of the current sheet... */
-			
-				/* ...copy the referenced resource to the new document!
-				   If this object has copied already (for another sheet in dest_doc),
-				   copy_object_continue() will do nothing */
-				pdf_obj *new_res = copy_object_continue(dest_ctx, info->dest_doc, 
-					src_ctx, info->src_doc, src_val, &info->new_ids);
-
-				/* now reference this new object in the resource object of this sheet */
-				pdf_obj *dest_key = pdf_new_name(dest_ctx, info->dest_doc, new_name);
-
-				pdf_dict_put(dest_ctx, dest, dest_key, new_res);
-				pdf_drop_obj(dest_ctx, dest_key);
-				pdf_drop_obj(dest_ctx, new_res);	
-			}
+			written = snprintf(entry->dest_name, sizeof(entry->dest_name), 
+				"%s%d_%d", RESOURCE_PREFIXES[type], pdf_to_num(src_ctx, src_val), 
+				pdf_to_gen(src_ctx, src_val));
 		}
+		if(written >= sizeof(entry->dest_name))
+			return(1); // not enough space
 
-		/* even if it was used on another sheet or on this sheet, add it to the 
-		   rename-dict for this sheet! Because it could have different names
-		   on different source-pages */
-		pdf_obj *rename_key = pdf_new_name(dest_ctx, info->dest_doc, pdf_to_name(dest_ctx, src_key));
-		pdf_obj *rename_val = pdf_new_name(dest_ctx, info->dest_doc, new_name);
-		pdf_dict_put(dest_ctx, info->rename_dict, rename_key, rename_val);
-		pdf_drop_obj(dest_ctx, rename_key);
-		pdf_drop_obj(dest_ctx, rename_val);
+		/* it could have different names on different source-pages */
+		rename_table_add(renames->table, pdf_to_name(src_ctx, src_key), 
+			entry->dest_name);
+		renames->entries_count++;
 	}
 
 	return(0);
 }
 
-static int copy_and_rename_resources(fz_context *dest_ctx, pdf_obj *dest, 
-	fz_context *src_ctx, pdf_obj *src, struct put_info *info)
+static struct resource_renames *collect_resource_renames(fz_context *src_ctx, 
+	pdf_obj *src, struct put_info *info)
 {
-    static char *RESOURCE_TYPES[] = 
-		{ "ExtGState", "ColorSpace", "Pattern", "Shading", "XObject", 
-		  "Font", "Properties" };
-	static char *RESOURCE_PREFIXES[] =
-		{ "E_", "C_", "P_", "S_", "X_", "F_", "T_" };
-    static const size_t RESOURCE_TYPES_COUNT = 
-		sizeof(RESOURCE_TYPES) / sizeof(RESOURCE_TYPES[0]);
-
-    size_t i;
-    for(i = 0; i < RESOURCE_TYPES_COUNT; i++) {
-        pdf_obj *src_type = pdf_dict_gets(src_ctx, src, RESOURCE_TYPES[i]);
-        pdf_obj *dest_type = pdf_dict_gets(dest_ctx, dest, RESOURCE_TYPES[i]);
+	struct resource_renames *renames = calloc(1, sizeof(struct resource_renames));
+	renames->resources = src;
+	renames->table = rename_table_new(32);
+
+	size_t i;
+	for(i = 0; i < RESOURCE_TYPES_COUNT; i++) {
+		pdf_obj *src_type = pdf_dict_gets(src_ctx, src, RESOURCE_TYPES[i]);
 
 		/* we only copy resource-dicts that exist in the source-page ;) */
-		if(pdf_is_dict(src_ctx, src_type)) {printf("TODO: REMOVEME: Copying and renaming resources of type %s!!!\n", RESOURCE_TYPES[i]);
-			/* if this kind of dict does not exists in the dest resources, 
-			   we must create it */
-			if(!pdf_is_dict(dest_ctx, dest_type)) {
-				dest_type = pdf_new_dict(dest_ctx, info->dest_doc, 8);
-				pdf_dict_puts_drop(dest_ctx, dest, RESOURCE_TYPES[i], dest_type);
-			}
+		if(pdf_is_dict(src_ctx, src_type) && 
+			collect_resource_names(src_ctx, src_type, i, renames, info))
+		{
+			rename_table_delete(renames->table);
+			free(renames->entries);
+			free(renames);
+			return(NULL);
+		}
+	}
 
-			if(copy_and_rename_resource(dest_ctx, dest_type, 
-				src_ctx, src_type, RESOURCE_PREFIXES[i], info))
-			{
-				return(2);
-			}
+	return(renames);
+}
+
+static void delete_resource_renames(struct put_info *info)
+{
+	size_t i;
+	for(i = 0; i < info->resource_renames_count; i++) {
+		rename_table_delete(info->resource_renames[i]->table);
+		free(info->resource_renames[i]->entries);
+		free(info->resource_renames[i]);
+	}
+
+	free(info->resource_renames);
+	copy_map_delete(info->renames_by_num);
+}
+
+/* returns the renames of the resource dict src, which are only collected
+   the first time src is seen */
+static struct resource_renames *get_resource_renames(fz_context *src_ctx, 
+	pdf_obj *src, struct put_info *info)
+{
+	int num = pdf_to_num(src_ctx, src);
+	size_t i;
+
+	if(pdf_is_indirect(src_ctx, src)) {
+		int index = copy_map_get(info->renames_by_num, num);
+		if(index > 0)
+			return(info->resource_renames[index - 1]);
+	} else {
+		/* inline resource dicts are only shared by inheriting them */
+		for(i = 0; i < info->resource_renames_count; i++) {
+			if(info->resource_renames[i]->resources == src)
+				return(info->resource_renames[i]);
+		}
+	}
+
+	struct resource_renames *renames = 
+		collect_resource_renames(src_ctx, src, info);
+	if(renames == NULL)
+		return(NULL);
+
+	info->resource_renames = realloc(info->resource_renames, 
+		(info->resource_renames_count + 1) * sizeof(struct resource_renames *));
+	info->resource_renames[info->resource_renames_count++] = renames;
+	if(pdf_is_indirect(src_ctx, src))
+		copy_map_set(info->renames_by_num, num, info->resource_renames_count);
+
+	return(renames);
+}
+
+/* copies the resources the sheet does not have yet */
+static int copy_resources(fz_context *dest_ctx, pdf_obj *dest, 
+	fz_context *src_ctx, const struct resource_renames *renames, 
+	struct put_info *info)
+{
+	size_t i;
+	for(i = 0; i < renames->entries_count; i++) {
+		const struct resource_entry *entry = &renames->entries[i];
+		pdf_obj *dest_type = pdf_dict_gets(dest_ctx, dest, RESOURCE_TYPES[entry->type]);
+
+		/* if this kind of dict does not exists in the dest resources, 
+		   we must create it */
+		if(!pdf_is_dict(dest_ctx, dest_type)) {
+			dest_type = pdf_new_dict(dest_ctx, info->dest_doc, 8);
+			pdf_dict_puts_drop(dest_ctx, dest, RESOURCE_TYPES[entry->type], dest_type);
 		}
+
+		/* if it was used on this sheet before, it's already there */
+		if(pdf_dict_gets(dest_ctx, dest_type, entry->dest_name) != NULL)
+			continue;
+
+		/* ...copy the referenced resource to the new document!
+		   If this object has copied already (for another sheet in dest_doc),
+		   copy_object_continue() will do nothing; inline resources are copied
+		   once for each sheet */
+		pdf_obj *new_res;
+		if(!pdf_is_indirect(src_ctx, entry->src_val)) {
+			new_res = copy_unassigned_object_continue(dest_ctx, info->dest_doc, 
+				src_ctx, info->src_doc, entry->src_val, &info->new_ids);
+		} else {
+			new_res = copy_object_continue(dest_ctx, info->dest_doc, 
+				src_ctx, info->src_doc, entry->src_val, &info->new_ids);
+		}
+
+		/* now reference this new object in the resource object of this sheet */
+		pdf_dict_puts_drop(dest_ctx, dest_type, entry->dest_name, new_res);
 	}
 
     // TODO: Merge Procedure-Sets (although they are obsolete)
@@ -175,15 +257,11 @@ struct pos_info
 };
 
 
-/* dest points to the new pages content-streams-dict, src is a reference to 
-   one source content-stream */
-int copy_content_stream_of_page(fz_context *dest_ctx, pdf_obj *dest, 
-	fz_context *src_ctx, pdf_obj *src, 
-	struct put_info *info, struct pos_info *pos)
+/* starts the content of one page on the sheet: clips it to its area and 
+   moves it to its position */
+static void put_page_position(fz_context *dest_ctx, fz_output *output, 
+	const struct pos_info *pos)
 {
-	if(!pdf_is_array(dest_ctx, dest) && !pdf_is_indirect(src_ctx, src))
-		return(-1);
-
 	/*
 	  translation:  1     0    0    1     diff_x diff_y
 	  scale:        scale 0    0    scale 0      0
@@ -195,9 +273,6 @@ int copy_content_stream_of_page(fz_context *dest_ctx, pdf_obj *dest,
 	  rotation 270: 0     -1   1    0     0      0 
 	*/
 
-	fz_buffer *buffer = fz_new_buffer(dest_ctx, 1024);
-	fz_output *output = fz_new_output_with_buffer(dest_ctx, buffer);
-
 	fz_printf(dest_ctx, output, "q\n");
 
 	/* set the outer clip region */
@@ -225,44 +300,199 @@ int copy_content_stream_of_page(fz_context *dest_ctx, pdf_obj *dest,
 		fz_printf(dest_ctx, output, "%f %f %f %f re W n\n", 
 			pos->bleed_clip_x, pos->bleed_clip_y, pos->bleed_clip_width, pos->bleed_clip_height);
 	}
+}
+
+/* adds buffer as a new content stream to the content-streams-array dest */
+static void append_content_stream(fz_context *dest_ctx, pdf_document *dest_doc, 
+	pdf_obj *dest, fz_buffer *buffer)
+{
+	int new_num = pdf_create_object(dest_ctx, dest_doc);
+	pdf_obj *new_ref = pdf_new_indirect(dest_ctx, dest_doc, new_num, 0);
+
+	/* each stream has a dict containing at least its length... */
+	pdf_obj *stream_info_dict = pdf_new_dict(dest_ctx, dest_doc, 1);
+	pdf_dict_puts_drop(dest_ctx, stream_info_dict, "Length", pdf_new_int(dest_ctx, dest_doc, buffer->len));
+	pdf_update_object(dest_ctx, dest_doc, new_num, stream_info_dict);
+	pdf_drop_obj(dest_ctx, stream_info_dict);
+
+	pdf_update_stream(dest_ctx, dest_doc, new_ref, buffer, 0);
+
+	pdf_array_push(dest_ctx, dest, new_ref);
+	pdf_drop_obj(dest_ctx, new_ref);
+}
+
+/* dest points to the new pages content-streams-dict, src is a reference to 
+   one source content-stream */
+int copy_content_stream_of_page(fz_context *dest_ctx, pdf_obj *dest, 
+	fz_context *src_ctx, pdf_obj *src, 
+	struct put_info *info, struct pos_info *pos)
+{
+	if(!pdf_is_array(dest_ctx, dest) && !pdf_is_indirect(src_ctx, src))
+		return(-1);
+
+	fz_buffer *buffer = fz_new_buffer(dest_ctx, 1024);
+	fz_output *output = fz_new_output_with_buffer(dest_ctx, buffer);
+
+	put_page_position(dest_ctx, output, pos);
 
  	int src_num = pdf_to_num(src_ctx, src);
 	int src_gen = pdf_to_gen(src_ctx, src);
 	fz_stream *input = pdf_open_stream(src_ctx, info->src_doc, src_num, src_gen);
 
-	rename_res_in_content_stream(src_ctx, input, dest_ctx, output, info->rename_dict);
+	content_scan_rename_res(src_ctx, input, dest_ctx, output, info->renames);
 
 	fz_printf(dest_ctx, output, "Q");
 
 	fz_drop_output(dest_ctx, output);
 	fz_drop_stream(dest_ctx, input);
 	
-	int new_num = pdf_create_object(dest_ctx, info->dest_doc);
-	pdf_obj *new_ref = pdf_new_indirect(dest_ctx, info->dest_doc, new_num, 0);
+	append_content_stream(dest_ctx, info->dest_doc, dest, buffer);
+	fz_drop_buffer(dest_ctx, buffer);
 
-	/* each stream has a dict containing at least its length... */
-	pdf_obj *stream_info_dict = pdf_new_dict(dest_ctx, info->dest_doc, 1);
-	pdf_dict_puts_drop(dest_ctx, stream_info_dict, "Length", pdf_new_int(dest_ctx, info->dest_doc, buffer->len));
-	pdf_update_object(dest_ctx, info->dest_doc, new_num, stream_info_dict);
-	pdf_drop_obj(dest_ctx, stream_info_dict);
+	return(0);
+}
 
-	pdf_update_stream(dest_ctx, info->dest_doc, new_ref, buffer, 0);
-	fz_drop_buffer(dest_ctx, buffer);
+/* returns a copy of src in dest_doc, which is an indirect reference if src 
+   is one */
+static pdf_obj *copy_value(fz_context *dest_ctx, fz_context *src_ctx, 
+	pdf_obj *src, struct put_info *info)
+{
+	if(pdf_is_indirect(src_ctx, src)) {
+		return(copy_object_continue(dest_ctx, info->dest_doc, 
+			src_ctx, info->src_doc, src, &info->new_ids));
+	} else {
+		return(copy_unassigned_object_continue(dest_ctx, info->dest_doc, 
+			src_ctx, info->src_doc, src, &info->new_ids));
+	}
+}
 
-	pdf_array_push(dest_ctx, dest, new_ref);
-	pdf_drop_obj(dest_ctx, new_ref);
+/* the page becomes a Form XObject that keeps its own resources and its 
+   content stream as it is (still compressed), so nothing needs to be 
+   renamed; the number of the form is put into form_num */
+static ErrorCode make_page_form(fz_context *dest_ctx, fz_context *src_ctx, 
+	pdf_page *src_page, const page_attrs_t *attrs, struct put_info *info,
+	int *form_num)
+{
+	ErrorCode result = NoError;
+	pdf_obj *form = NULL;
+	fz_buffer *buffer = NULL;
+	fz_var(result);
+	fz_var(form);
+	fz_var(buffer);
+
+	fz_try(dest_ctx) {
+		form = pdf_new_dict(dest_ctx, info->dest_doc, 8);
+		pdf_dict_puts_drop(dest_ctx, form, "Type", 
+			pdf_new_name(dest_ctx, info->dest_doc, "XObject"));
+		pdf_dict_puts_drop(dest_ctx, form, "Subtype", 
+			pdf_new_name(dest_ctx, info->dest_doc, "Form"));
+		pdf_dict_puts_drop(dest_ctx, form, "BBox", 
+			copy_value(dest_ctx, src_ctx, attrs->media_box, info));
+		if(attrs->resources != NULL) {
+			pdf_dict_puts_drop(dest_ctx, form, "Resources", 
+				copy_value(dest_ctx, src_ctx, attrs->resources, info));
+		}
 
-	return(0);
+		*form_num = pdf_create_object(dest_ctx, info->dest_doc);
+
+		pdf_obj *contents = src_page->contents;
+		if(pdf_is_array(src_ctx, contents) && pdf_array_len(src_ctx, contents) == 1)
+			contents = pdf_array_get(src_ctx, contents, 0);
+
+		if(!pdf_is_array(src_ctx, contents) && pdf_is_indirect(src_ctx, contents)) {
+			/* one stream is copied raw, so it keeps its filters */
+			pdf_obj *filter = pdf_dict_gets(src_ctx, contents, "Filter");
+			pdf_obj *params = pdf_dict_gets(src_ctx, contents, "DecodeParms");
+			if(filter != NULL) {
+				pdf_dict_puts_drop(dest_ctx, form, "Filter", 
+					copy_value(dest_ctx, src_ctx, filter, info));
+			}
+			if(params != NULL) {
+				pdf_dict_puts_drop(dest_ctx, form, "DecodeParms", 
+					copy_value(dest_ctx, src_ctx, params, info));
+			}
+			pdf_update_object(dest_ctx, info->dest_doc, *form_num, form);
+
+			result = copy_stream_data(src_ctx, info->src_doc, 
+				pdf_to_num(src_ctx, contents), pdf_to_gen(src_ctx, contents), 
+				dest_ctx, info->dest_doc, *form_num);
+		} else {
+			/* several streams can only be joined decoded */
+			buffer = fz_new_buffer(dest_ctx, 1024);
+
+			int i;
+			for(i = 0; i < pdf_array_len(src_ctx, contents); i++) {
+				pdf_obj *part_ref = pdf_array_get(src_ctx, contents, i);
+				fz_buffer *part = pdf_load_stream(src_ctx, info->src_doc, 
+					pdf_to_num(src_ctx, part_ref), pdf_to_gen(src_ctx, part_ref));
+				fz_write_buffer(dest_ctx, buffer, part->data, part->len);
+				fz_write_buffer(dest_ctx, buffer, "\n", 1);
+				fz_drop_buffer(src_ctx, part);
+			}
+
+			pdf_update_object(dest_ctx, info->dest_doc, *form_num, form);
+			pdf_obj *form_ref = pdf_new_indirect(dest_ctx, info->dest_doc, *form_num, 0);
+			pdf_update_stream(dest_ctx, info->dest_doc, form_ref, buffer, 0);
+			pdf_drop_obj(dest_ctx, form_ref);
+		}
+	} fz_always(dest_ctx) {
+		pdf_drop_obj(dest_ctx, form);
+		fz_drop_buffer(dest_ctx, buffer);
+	} fz_catch(dest_ctx) {
+		return(ErrorInvalidReference);
+	}
+
+	return(result);
+}
+
+/* draws the form of the source page on the sheet, the form is made when the
+   page is placed the first time */
+static ErrorCode put_page_form(fz_context *dest_ctx, pdf_page *sheet, 
+	fz_context *src_ctx, pdf_page *src_page, int src_pagenum, 
+	const page_attrs_t *attrs, struct put_info *info, struct pos_info *pos)
+{
+	if(info->form_nums[src_pagenum] == 0) {
+		int form_num;
+		ErrorCode result = 
+			make_page_form(dest_ctx, src_ctx, src_page, attrs, info, &form_num);
+		if(result != NoError)
+			return(result);
+		info->form_nums[src_pagenum] = form_num;
+	}
+
+	char form_name[32];
+	snprintf(form_name, sizeof(form_name), "X_page_%d", src_pagenum);
+
+	pdf_obj *xobjects = pdf_dict_gets(dest_ctx, sheet->resources, "XObject");
+	if(!pdf_is_dict(dest_ctx, xobjects)) {
+		xobjects = pdf_new_dict(dest_ctx, info->dest_doc, 8);
+		pdf_dict_puts_drop(dest_ctx, sheet->resources, "XObject", xobjects);
+	}
+	if(pdf_dict_gets(dest_ctx, xobjects, form_name) == NULL) {
+		pdf_dict_puts_drop(dest_ctx, xobjects, form_name, pdf_new_indirect(
+			dest_ctx, info->dest_doc, info->form_nums[src_pagenum], 0));
+	}
+
+	fz_buffer *buffer = fz_new_buffer(dest_ctx, 256);
+	fz_output *output = fz_new_output_with_buffer(dest_ctx, buffer);
+
+	put_page_position(dest_ctx, output, pos);
+	fz_printf(dest_ctx, output, "/%s Do\nQ", form_name);
+	fz_drop_output(dest_ctx, output);
+
+	append_content_stream(dest_ctx, info->dest_doc, sheet->contents, buffer);
+	fz_drop_buffer(dest_ctx, buffer);
+
+	return(NoError);
 }
 
-int adjust_bleed_clipping(fz_context *ctx, pdf_document *doc, pdf_page *page, struct pos_info *pos)
+int adjust_bleed_clipping(fz_context *ctx, const page_attrs_t *attrs, struct pos_info *pos)
 {
 	/* We clip each page two times... The first clipping rectangle just 
 	   prevents the page from drawing outside of its area on the sheet.
 	   The second clipping is done here and clips out all those things that
 	   are located outside the bleed-box (e. g. printer's marks). */
-	pdf_obj *bleed_box = 
-		juggler_lookup_inherited_page_item(ctx, doc, page->me, "BleedBox");
+	pdf_obj *bleed_box = attrs->bleed_box;
 
 	/* if no bleeding-box exists, there is no need for the second clipping */
 	if(bleed_box == NULL) {
@@ -285,15 +515,15 @@ int adjust_bleed_clipping(fz_context *ctx, pdf_document *doc, pdf_page *page, st
 	return(0);
 }
 
-int adjust_page_position(fz_context *ctx, pdf_document *doc, pdf_page *page, struct pos_info *pos)
+int adjust_page_position(fz_context *ctx, const page_attrs_t *attrs, struct pos_info *pos)
 {
 	/* if page is rotated we must add this to the desired rotation of the page */
-	pos->rotate = (pos->rotate + page->rotate) % 360;
+	pos->rotate = (pos->rotate + attrs->rotate) % 360;
 	fz_matrix rotation_mtx; /* tranformation of the user-space due to the rotation */
-	fz_rotate(&rotation_mtx, page->rotate);
+	fz_rotate(&rotation_mtx, attrs->rotate);
 
 	/* get the media-box (with rotation applied) */
-	pdf_obj *media_box = juggler_lookup_inherited_page_item(ctx, doc, page->me, "MediaBox");
+	pdf_obj *media_box = attrs->media_box;
 	if(!pdf_is_array(ctx, media_box) || pdf_array_len(ctx, media_box) != 4) 
 		return(-1); /* the specification forces a valid media-box... */
 
@@ -302,7 +532,7 @@ int adjust_page_position(fz_context *ctx, pdf_document *doc, pdf_page *page, str
 	fz_transform_rect(&media_rect, &rotation_mtx);
 
 	/* get trim-box */
-	pdf_obj *trim_box = juggler_lookup_inherited_page_item(ctx, doc, page->me, "TrimBox");
+	pdf_obj *trim_box = attrs->trim_box;
 	if(trim_box == NULL)
 		trim_box = media_box;
 	if(!pdf_is_array(ctx, trim_box) || pdf_array_len(ctx, trim_box) != 4)
@@ -327,7 +557,7 @@ int adjust_page_position(fz_context *ctx, pdf_document *doc, pdf_page *page, str
 
 	
 	/* if needed, clip the contents to the bleed-box */
-	if(adjust_bleed_clipping(ctx, doc, page, pos) < 0)
+	if(adjust_bleed_clipping(ctx, attrs, pos) < 0)
 		return(-2);
 
 	return(0);
@@ -360,8 +590,9 @@ int copy_content_streams_of_page(fz_context *dest_ctx, pdf_page *dest,
       scale-operations to all others and need to use userunit in the sheet too
   4.  Copy each entry of the resource-dicts of every page of the sheet 
       (if it has not already been copied for a previous sheet)
-  5.  Create a dict that contains src-resource-name to dest-resource-name for 
-      this sheet (this is an n:m relation where n >= m)
+  5.  Create a table that contains src-resource-name to dest-resource-name 
+      (this is an n:m relation where n >= m), once for each resource dict of
+      the source, as the new names don't depend on the sheet
   6.  For each source-page-stream create a new content-stream and change
       scale (if user-unit is needed), translation and rotation... And add a 
       clipping-path around the page
@@ -371,17 +602,32 @@ int copy_content_streams_of_page(fz_context *dest_ctx, pdf_page *dest,
   9.  TODO: Preseparated pages
   10. TODO: Merge procedure sets 
 */
-static int put_pages_on_new_sheet(fz_context *dest_ctx, pdf_document *dest_doc, 
+static ErrorCode put_pages_on_new_sheet(fz_context *dest_ctx, pdf_document *dest_doc, 
 	fz_context *src_ctx, pdf_document *src_doc, 
-	struct pos_info *positions, size_t put_count)
+	struct pos_info *positions, size_t put_count, int mode)
 {
-	/* copy each entry of the resource dict */
-	static const int RENAME_INITIAL_CAP = 128;
-	struct put_info put_info = { dest_doc, src_doc, NULL, NULL, 0 };
+	struct put_info put_info;
+	memset(&put_info, 0, sizeof(struct put_info));
+	put_info.dest_doc = dest_doc;
+	put_info.src_doc = src_doc;
 	
 	/* what destianation page is currently opened? */
 	int sheet_pagenum = -1;
 	pdf_page *sheet = NULL;
+
+	/* the inherited attributes of all source pages in one go */
+	int src_count = pdf_count_pages(src_ctx, src_doc);
+	page_attrs_t *attrs = malloc(sizeof(page_attrs_t) * src_count);
+	ErrorCode result = 
+		juggler_resolve_page_attrs(src_ctx, src_doc, 0, src_count, attrs);
+	if(result != NoError) {
+		free(attrs);
+		return(result);
+	}
+	put_info.renames_by_num = 
+		copy_map_new(pdf_xref_len(src_ctx, src_doc), COPY_MAP_UNKNOWN);
+	if(mode == PUT_MODE_FORMS)
+		put_info.form_nums = calloc(src_count, sizeof(int));
 	
 	size_t i;
 	for(i = 0; i < put_count; i++) {
@@ -398,26 +644,47 @@ static int put_pages_on_new_sheet(fz_context *dest_ctx, pdf_document *dest_doc,
 		
 		/* load the source-page */
 		pdf_page *src_page = pdf_load_page(src_ctx, src_doc, positions[i].src_pagenum);
+		const page_attrs_t *src_attrs = &attrs[positions[i].src_pagenum];
+
+		/* a form needs the media box as its bounding box */
+		if(mode == PUT_MODE_FORMS) {
+			if(adjust_page_position(src_ctx, src_attrs, positions + i) == 0) {
+				result = put_page_form(dest_ctx, sheet, src_ctx, src_page, 
+					positions[i].src_pagenum, src_attrs, &put_info, positions + i);
+			}
+			pdf_drop_page(src_ctx, src_page);
+			if(result != NoError)
+				break;
+			continue;
+		}
 		
-		/* create a rename_dict */
-		put_info.rename_dict = pdf_new_dict(dest_ctx, dest_doc, RENAME_INITIAL_CAP);
+		/* the new names of its resources are the same on all sheets */
+		struct resource_renames *renames = 
+			get_resource_renames(src_ctx, src_attrs->resources, &put_info);
+		if(renames == NULL) {
+			pdf_drop_page(src_ctx, src_page);
+			continue;
+		}
+		put_info.renames = renames->table;
 	
 		/* copy all resources, adjust the page and finally copy the content */
-		copy_and_rename_resources(dest_ctx, sheet->resources, 
-			src_ctx, src_page->resources, &put_info);
-		adjust_page_position(src_ctx, src_doc, src_page, positions + i);
+		copy_resources(dest_ctx, sheet->resources, src_ctx, renames, &put_info);
+		adjust_page_position(src_ctx, src_attrs, positions + i);
 		copy_content_streams_of_page(
 			dest_ctx, sheet, src_ctx, src_page, &put_info, positions + i);
 
 		/* free everything we created for that source-page */
-		pdf_drop_obj(dest_ctx, put_info.rename_dict);
 		pdf_drop_page(src_ctx, src_page);
 	}
 
 	if(sheet != NULL)
 		pdf_drop_page(dest_ctx, sheet);
+	copy_map_delete(put_info.new_ids);
+	delete_resource_renames(&put_info);
+	free(put_info.form_nums);
+	free(attrs);
 
-	return(0);
+	return(result);
 }
 
 static ErrorCode juggler_impose_create_sheet(fz_context *ctx, pdf_document *dest_doc, int width, int height)
@@ -451,8 +718,16 @@ static pdf_document *test_creation(juggler_t *src)
 	return(new_doc);
 }
 
-ErrorCode juggler_put_page_contents(juggler_t *src, const char *filename)
+ErrorCode juggler_put_page_contents(juggler_t *src, char *filename, 
+	int mode)
 {
+	if(mode != PUT_MODE_REWRITE && mode != PUT_MODE_FORMS)
+		return(ErrorUsage);
+
+	ErrorCode result = juggler_flush_deferred_streams(src);
+	if(result != NoError)
+		return(result);
+
 	pdf_document *new_doc = test_creation(src);
 	
 	struct pos_info *pos = calloc(src->pagecount, sizeof(struct pos_info));
@@ -472,7 +747,14 @@ ErrorCode juggler_put_page_contents(juggler_t *src, const char *filename)
 		pos[i].src_pagenum = i;
 	}
 	
-	put_pages_on_new_sheet(src->ctx, new_doc, src->ctx, src->pdf, pos, src->pagecount);
+	result = put_pages_on_new_sheet(src->ctx, new_doc, src->ctx, src->pdf, 
+		pos, src->pagecount, mode);
+	free(pos);
+	if(result != NoError) {
+		/* a half-done document is of no use to anybody */
+		pdf_close_document(src->ctx, new_doc);
+		return(result);
+	}
 
 	/* write the new document to disk */
 	fz_write_options write_options;
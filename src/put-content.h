@@ -33,6 +33,15 @@ struct sheet_info
 	} pages[];
 };
 */
-ErrorCode juggler_put_page_contents(juggler_t *juggler, const char *filename);
+
+/* the content streams of the pages are copied onto the sheets with all 
+   their resources renamed... */
+#define PUT_MODE_REWRITE 0
+/* ...or each page becomes a Form XObject once, with its own resources and 
+   its content still compressed, which is drawn on the sheets */
+#define PUT_MODE_FORMS 1
+
+ErrorCode juggler_put_page_contents(juggler_t *juggler, char *filename, 
+	int mode);
 
 #endif /* _JUGGLER_PUT_CONTENT_H_ */
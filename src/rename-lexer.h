@@ -17,5 +17,6 @@
  */ 
 
 /* this header is manually generated and just exposes this function */
+struct rename_table;
 int rename_res_in_content_stream(fz_context *in_ctx, fz_stream *input, 
-	fz_context *out_ctx, fz_output *output, pdf_obj *rename_dict);
+	fz_context *out_ctx, fz_output *output, const struct rename_table *renames);
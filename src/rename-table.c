@@ -0,0 +1,193 @@
+/*
+  rename-table.c - the new names of the resources of a page
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "rename-table.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RENAME_TABLE_MIN_CAP 16
+#define RENAME_POOL_BLOCK_SIZE 4096
+
+struct rename_slot
+{
+	const char *old_name; // NULL if unused
+	size_t old_len;
+	uint32_t hash;
+
+	const char *output;
+	size_t output_len;
+};
+
+/* all names of a table are interned in blocks that are never moved */
+struct rename_pool_block
+{
+	struct rename_pool_block *next;
+	size_t used;
+	size_t size;
+	char text[];
+};
+
+struct rename_table
+{
+	/* open addressing with linear probing, at most half full */
+	struct rename_slot *slots;
+	size_t cap; // always a power of two
+	size_t used;
+
+	struct rename_pool_block *pool;
+};
+
+static uint32_t hash_name(const char *name, size_t len)
+{
+	/* FNV-1a */
+	uint32_t hash = 2166136261u;
+
+	size_t i;
+	for(i = 0; i < len; i++) {
+		hash ^= (unsigned char) name[i];
+		hash *= 16777619u;
+	}
+
+	return(hash);
+}
+
+static char *reserve(struct rename_table *table, size_t len)
+{
+	struct rename_pool_block *block = table->pool;
+	if(block == NULL || block->used + len > block->size) {
+		size_t size = (len > RENAME_POOL_BLOCK_SIZE ? len : RENAME_POOL_BLOCK_SIZE);
+		block = malloc(sizeof(struct rename_pool_block) + size);
+		block->next = table->pool;
+		block->used = 0;
+		block->size = size;
+		table->pool = block;
+	}
+
+	char *text = block->text + block->used;
+	block->used += len;
+
+	return(text);
+}
+
+static char *intern(struct rename_table *table, const char *text, size_t len)
+{
+	char *interned = reserve(table, len);
+	memcpy(interned, text, len);
+
+	return(interned);
+}
+
+static struct rename_slot *find_slot(struct rename_slot *slots, size_t cap, 
+	const char *name, size_t len, uint32_t hash)
+{
+	size_t i = hash & (cap - 1);
+	while(slots[i].old_name != NULL && (slots[i].hash != hash || 
+		slots[i].old_len != len || memcmp(slots[i].old_name, name, len) != 0))
+	{
+		i = (i + 1) & (cap - 1);
+	}
+
+	return(&slots[i]);
+}
+
+static void grow(struct rename_table *table)
+{
+	size_t new_cap = table->cap * 2;
+	struct rename_slot *new_slots = calloc(new_cap, sizeof(struct rename_slot));
+
+	size_t i;
+	for(i = 0; i < table->cap; i++) {
+		struct rename_slot *slot = &table->slots[i];
+		if(slot->old_name != NULL) {
+			*find_slot(new_slots, new_cap, slot->old_name, slot->old_len, 
+				slot->hash) = *slot;
+		}
+	}
+
+	free(table->slots);
+	table->slots = new_slots;
+	table->cap = new_cap;
+}
+
+struct rename_table *rename_table_new(size_t expected_count)
+{
+	struct rename_table *table = calloc(1, sizeof(struct rename_table));
+
+	table->cap = RENAME_TABLE_MIN_CAP;
+	while(table->cap < expected_count * 2)
+		table->cap *= 2;
+	table->slots = calloc(table->cap, sizeof(struct rename_slot));
+
+	return(table);
+}
+
+void rename_table_delete(struct rename_table *table)
+{
+	if(table == NULL)
+		return;
+
+	while(table->pool != NULL) {
+		struct rename_pool_block *next = table->pool->next;
+		free(table->pool);
+		table->pool = next;
+	}
+
+	free(table->slots);
+	free(table);
+}
+
+void rename_table_add(struct rename_table *table, 
+	const char *old_name, const char *new_name)
+{
+	if((table->used + 1) * 2 > table->cap)
+		grow(table);
+
+	size_t old_len = strlen(old_name);
+	size_t new_len = strlen(new_name);
+	uint32_t hash = hash_name(old_name, old_len);
+
+	struct rename_slot *slot = 
+		find_slot(table->slots, table->cap, old_name, old_len, hash);
+	if(slot->old_name == NULL) {
+		slot->old_name = intern(table, old_name, old_len);
+		slot->old_len = old_len;
+		slot->hash = hash;
+		table->used++;
+	}
+
+	char *output = reserve(table, new_len + 1);
+	output[0] = '/';
+	memcpy(output + 1, new_name, new_len);
+	slot->output = output;
+	slot->output_len = new_len + 1;
+}
+
+const char *rename_table_lookup(const struct rename_table *table, 
+	const char *old_name, size_t len, size_t *output_len)
+{
+	struct rename_slot *slot = find_slot(table->slots, table->cap, 
+		old_name, len, hash_name(old_name, len));
+	if(slot->old_name == NULL)
+		return(NULL);
+
+	*output_len = slot->output_len;
+	return(slot->output);
+}
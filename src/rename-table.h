@@ -0,0 +1,46 @@
+/*
+  rename-table.h - the new names of the resources of a page
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _JUGGLER_RENAME_TABLE_H_
+#define _JUGGLER_RENAME_TABLE_H_
+
+#include <stddef.h>
+
+/* maps the resource names of a content stream to their new names; the 
+   lexers look up every name token here, so the new names are kept as the 
+   bytes that are written (with their /) and the old names are hashed once 
+   when they are added instead of being compared along a MuPDF dict */
+
+struct rename_table;
+
+extern struct rename_table *rename_table_new(size_t expected_count);
+
+extern void rename_table_delete(struct rename_table *table);
+
+/* both names without /; adding an old name again replaces its new name */
+extern void rename_table_add(struct rename_table *table, 
+	const char *old_name, const char *new_name);
+
+/* old_name has len bytes (without /, not terminated); returns the text to 
+   write instead of it and its length in output_len or NULL if old_name is 
+   not renamed */
+extern const char *rename_table_lookup(const struct rename_table *table, 
+	const char *old_name, size_t len, size_t *output_len);
+
+#endif /* _JUGGLER_RENAME_TABLE_H_ */
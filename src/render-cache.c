@@ -0,0 +1,304 @@
+/*
+  render-cache.c - keep rendered pixmaps for later reuse
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "render-cache.h"
+
+#include "page-set.h"
+
+/* must be a power of two */
+#define RENDER_CACHE_BUCKETS 256
+
+struct render_cache_entry
+{
+	/* the lru-list, the head is the most recently used entry */
+	struct render_cache_entry *prev;
+	struct render_cache_entry *next;
+	struct render_cache_entry *hash_next;
+
+	/* the key, this is what has been requested, not what was rendered */
+	render_data_t key;
+
+	fz_pixmap *pixmap;
+	size_t bytes;
+};
+
+struct render_cache
+{
+	fz_context *ctx;
+
+	struct render_cache_entry *buckets[RENDER_CACHE_BUCKETS];
+	struct render_cache_entry *head;
+	struct render_cache_entry *tail;
+
+	render_cache_stats_t stats;
+};
+
+static unsigned int hash_key(const render_data_t *key)
+{
+	unsigned int hash = 2166136261u;
+	int values[] = { key->pagenum, (int) (key->zoom * 1000.0), key->rotation,
+		key->x, key->y, key->width, key->height, key->quality };
+
+	size_t i;
+	for(i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+		hash = (hash ^ (unsigned int) values[i]) * 16777619u;
+
+	return(hash & (RENDER_CACHE_BUCKETS - 1));
+}
+
+static int matches_key(struct render_cache_entry *entry, const render_data_t *key)
+{
+	return(entry->key.pagenum == key->pagenum &&
+		entry->key.zoom == key->zoom &&
+		entry->key.rotation == key->rotation &&
+		entry->key.x == key->x &&
+		entry->key.y == key->y &&
+		entry->key.width == key->width &&
+		entry->key.height == key->height &&
+		entry->key.quality == key->quality);
+}
+
+static struct render_cache_entry *find_entry(struct render_cache *cache, 
+	const render_data_t *key)
+{
+	struct render_cache_entry *entry = cache->buckets[hash_key(key)];
+	for(; entry != NULL; entry = entry->hash_next) {
+		if(matches_key(entry, key))
+			return(entry);
+	}
+
+	return(NULL);
+}
+
+static void lru_unlink(struct render_cache *cache, struct render_cache_entry *entry)
+{
+	if(entry->prev != NULL)
+		entry->prev->next = entry->next;
+	else
+		cache->head = entry->next;
+
+	if(entry->next != NULL)
+		entry->next->prev = entry->prev;
+	else
+		cache->tail = entry->prev;
+}
+
+static void lru_push_front(struct render_cache *cache, struct render_cache_entry *entry)
+{
+	entry->prev = NULL;
+	entry->next = cache->head;
+	if(cache->head != NULL)
+		cache->head->prev = entry;
+	cache->head = entry;
+	if(cache->tail == NULL)
+		cache->tail = entry;
+}
+
+static void hash_unlink(struct render_cache *cache, struct render_cache_entry *entry)
+{
+	struct render_cache_entry **current = &cache->buckets[hash_key(&entry->key)];
+	while(*current != NULL) {
+		if(*current == entry) {
+			*current = entry->hash_next;
+			return;
+		}
+		current = &(*current)->hash_next;
+	}
+}
+
+static void hash_link(struct render_cache *cache, struct render_cache_entry *entry)
+{
+	unsigned int bucket = hash_key(&entry->key);
+	entry->hash_next = cache->buckets[bucket];
+	cache->buckets[bucket] = entry;
+}
+
+static void drop_entry(struct render_cache *cache, struct render_cache_entry *entry)
+{
+	hash_unlink(cache, entry);
+	lru_unlink(cache, entry);
+
+	cache->stats.entries--;
+	cache->stats.bytes_used -= entry->bytes;
+
+	fz_drop_pixmap(cache->ctx, entry->pixmap);
+	free(entry);
+}
+
+/* drop the least recently used entries until bytes more would fit */
+static void make_room(struct render_cache *cache, size_t bytes)
+{
+	while(cache->tail != NULL &&
+		cache->stats.bytes_used + bytes > cache->stats.bytes_budget)
+	{
+		drop_entry(cache, cache->tail);
+		cache->stats.evictions++;
+	}
+}
+
+struct render_cache *render_cache_new(fz_context *ctx, size_t budget)
+{
+	struct render_cache *cache = calloc(1, sizeof(struct render_cache));
+	cache->ctx = ctx;
+	cache->stats.bytes_budget = budget;
+
+	return(cache);
+}
+
+void render_cache_delete(struct render_cache *cache)
+{
+	render_cache_clear(cache);
+	free(cache);
+}
+
+fz_pixmap *render_cache_lookup(struct render_cache *cache, const render_data_t *needle)
+{
+	struct render_cache_entry *entry = cache->buckets[hash_key(needle)];
+	for(; entry != NULL; entry = entry->hash_next) {
+		if(matches_key(entry, needle)) {
+			/* this one is the most recently used now */
+			lru_unlink(cache, entry);
+			lru_push_front(cache, entry);
+
+			cache->stats.hits++;
+			return(fz_keep_pixmap(cache->ctx, entry->pixmap));
+		}
+	}
+
+	cache->stats.misses++;
+	return(NULL);
+}
+
+void render_cache_insert(struct render_cache *cache, const render_data_t *key, fz_pixmap *pixmap)
+{
+	size_t bytes = (size_t) pixmap->w * pixmap->h * pixmap->n;
+
+	/* there is no way to keep something bigger than the whole budget */
+	if(bytes > cache->stats.bytes_budget)
+		return;
+
+	/* if there is an entry for that key, replace it */
+	struct render_cache_entry *entry = find_entry(cache, key);
+	if(entry != NULL)
+		drop_entry(cache, entry);
+
+	/* a preview is only kept until the real render is there, so that the 
+	   tile doesn't use the budget twice */
+	render_data_t other = *key;
+	if(key->quality == RENDER_QUALITY_FULL) {
+		other.quality = RENDER_QUALITY_PREVIEW;
+		if((entry = find_entry(cache, &other)) != NULL)
+			drop_entry(cache, entry);
+	} else if(key->quality == RENDER_QUALITY_PREVIEW) {
+		other.quality = RENDER_QUALITY_FULL;
+		if(find_entry(cache, &other) != NULL)
+			return; // it came too late
+	}
+
+	make_room(cache, bytes);
+
+	entry = malloc(sizeof(struct render_cache_entry));
+	entry->key = *key;
+	entry->key.samples = NULL;
+	entry->key.pixmap = NULL;
+	entry->pixmap = fz_keep_pixmap(cache->ctx, pixmap);
+	entry->bytes = bytes;
+
+	hash_link(cache, entry);
+	lru_push_front(cache, entry);
+
+	cache->stats.entries++;
+	cache->stats.bytes_used += bytes;
+}
+
+void render_cache_set_budget(struct render_cache *cache, size_t budget)
+{
+	cache->stats.bytes_budget = budget;
+	make_room(cache, 0);
+}
+
+void render_cache_get_stats(struct render_cache *cache, render_cache_stats_t *stats)
+{
+	*stats = cache->stats;
+}
+
+void render_cache_clear(struct render_cache *cache)
+{
+	while(cache->head != NULL)
+		drop_entry(cache, cache->head);
+}
+
+void render_cache_invalidate_page(struct render_cache *cache, int pagenum)
+{
+	struct render_cache_entry *entry = cache->head;
+	while(entry != NULL) {
+		struct render_cache_entry *next = entry->next;
+		if(entry->key.pagenum == pagenum)
+			drop_entry(cache, entry);
+		entry = next;
+	}
+}
+
+void render_cache_invalidate_pages(struct render_cache *cache, 
+	struct page_set *set)
+{
+	struct render_cache_entry *entry = cache->head;
+	while(entry != NULL) {
+		struct render_cache_entry *next = entry->next;
+		if(page_set_contains(set, entry->key.pagenum))
+			drop_entry(cache, entry);
+		entry = next;
+	}
+}
+
+/* the page number is part of the key, so all entries behind a changed
+   position need to be rehashed */
+static void renumber_pages(struct render_cache *cache, int first, int delta)
+{
+	struct render_cache_entry *entry;
+	for(entry = cache->head; entry != NULL; entry = entry->next) {
+		if(entry->key.pagenum >= first) {
+			hash_unlink(cache, entry);
+			entry->key.pagenum += delta;
+			hash_link(cache, entry);
+		}
+	}
+}
+
+void render_cache_remap_pages(struct render_cache *cache, 
+	const int *new_index, int old_count)
+{
+	struct render_cache_entry *entry = cache->head;
+	while(entry != NULL) {
+		struct render_cache_entry *next = entry->next;
+		int pagenum = entry->key.pagenum;
+		if(pagenum < 0 || pagenum >= old_count || new_index[pagenum] < 0) {
+			drop_entry(cache, entry);
+		} else if(new_index[pagenum] != pagenum) {
+			hash_unlink(cache, entry);
+			entry->key.pagenum = new_index[pagenum];
+			hash_link(cache, entry);
+		}
+		entry = next;
+	}
+}
+
+void render_cache_insert_pages(struct render_cache *cache, int index, int count)
+{
+	renumber_pages(cache, index, count);
+}
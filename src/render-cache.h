@@ -0,0 +1,83 @@
+/*
+  render-cache.h - keep rendered pixmaps for later reuse
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JUGGLER_RENDER_CACHE_H_
+#define _JUGGLER_RENDER_CACHE_H_
+
+#include <mupdf/fitz.h>
+
+/* how many bytes of pixmaps are kept if nobody says something else */
+#define RENDER_CACHE_DEFAULT_BUDGET (128 * 1024 * 1024)
+
+typedef struct
+{
+	size_t hits;
+	size_t misses;
+	size_t evictions;
+	size_t entries;
+	size_t bytes_used;
+	size_t bytes_budget;
+} render_cache_stats_t;
+
+#include "render.h"
+
+struct render_cache;
+
+extern struct render_cache *render_cache_new(fz_context *ctx, size_t budget);
+
+extern void render_cache_delete(struct render_cache *cache);
+
+/* returns the pixmap that was rendered for the page, zoom, rotation and
+   rect of needle or NULL if there is none. You need to drop the returned
+   pixmap! Each call counts as a hit or a miss */
+extern fz_pixmap *render_cache_lookup(struct render_cache *cache,
+	const render_data_t *needle);
+
+/* the cache keeps its own reference to pixmap, the caller's one remains
+   untouched; the least recently used entries are dropped until everything
+   fits into the budget. A full render replaces the preview of its tile */
+extern void render_cache_insert(struct render_cache *cache,
+	const render_data_t *key, fz_pixmap *pixmap);
+
+/* shrinking the budget evicts entries at once */
+extern void render_cache_set_budget(struct render_cache *cache, size_t budget);
+
+extern void render_cache_get_stats(struct render_cache *cache,
+	render_cache_stats_t *stats);
+
+/* those need to be called if the page tree has changed */
+extern void render_cache_clear(struct render_cache *cache);
+
+extern void render_cache_invalidate_page(struct render_cache *cache,
+	int pagenum);
+
+struct page_set;
+
+/* drops the entries of all pages in set with one pass over the cache */
+extern void render_cache_invalidate_pages(struct render_cache *cache,
+	struct page_set *set);
+
+/* page i becomes page new_index[i], pages with a negative new index are
+   dropped */
+extern void render_cache_remap_pages(struct render_cache *cache,
+	const int *new_index, int old_count);
+
+extern void render_cache_insert_pages(struct render_cache *cache,
+	int index, int count);
+
+#endif /* _JUGGLER_RENDER_CACHE_H_ */
@@ -0,0 +1,430 @@
+/*
+  render-pool.c - render pages in background threads
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "render-pool.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+#define RENDER_POOL_MAX_THREADS 8
+
+/* previews of a priority are started before the full renders of it */
+#define RENDER_POOL_QUEUES (RENDER_PRIORITY_COUNT * 2)
+
+struct render_job
+{
+	struct render_job *next;
+
+	render_data_t key;
+	fz_display_list *list;
+	fz_rect bounds;
+	int priority;
+	unsigned int generation;
+	fz_cookie cookie; // aborted by the ui-thread if not needed anymore
+
+	fz_pixmap *pixmap; // the result
+};
+
+/* a simple fifo for each priority */
+struct render_job_list
+{
+	struct render_job *head;
+	struct render_job *tail;
+};
+
+struct render_worker
+{
+	struct render_pool *pool;
+	fz_context *ctx;
+	pthread_t thread;
+};
+
+struct render_pool
+{
+	fz_context *ctx;
+
+	pthread_mutex_t lock;
+	pthread_cond_t wakeup;
+	int quit;
+
+	/* results of jobs that had been started before the last call to
+	   render_pool_invalidate() must be dropped */
+	unsigned int generation;
+
+	struct render_job_list queued[RENDER_POOL_QUEUES];
+	struct render_job_list running;
+	struct render_job_list done;
+
+	render_ready_fn notify;
+	void *notify_data;
+
+	int workers_count;
+	struct render_worker *workers;
+};
+
+static void job_list_append(struct render_job_list *list, struct render_job *job)
+{
+	job->next = NULL;
+	if(list->tail != NULL)
+		list->tail->next = job;
+	else
+		list->head = job;
+	list->tail = job;
+}
+
+static struct render_job *job_list_pop(struct render_job_list *list)
+{
+	struct render_job *job = list->head;
+	if(job != NULL) {
+		list->head = job->next;
+		if(list->head == NULL)
+			list->tail = NULL;
+	}
+	return(job);
+}
+
+static void job_list_remove(struct render_job_list *list, struct render_job *job)
+{
+	struct render_job *prev = NULL;
+	struct render_job *current = list->head;
+	for(; current != NULL; prev = current, current = current->next) {
+		if(current == job) {
+			if(prev != NULL)
+				prev->next = job->next;
+			else
+				list->head = job->next;
+			if(list->tail == job)
+				list->tail = prev;
+			return;
+		}
+	}
+}
+
+/* jobs that are aborted or from an older generation don't count, as their
+   results are dropped */
+static struct render_job *job_list_find(struct render_pool *pool, 
+	struct render_job_list *list, const render_data_t *key)
+{
+	struct render_job *job;
+	for(job = list->head; job != NULL; job = job->next) {
+		if(job->cookie.abort || job->generation != pool->generation)
+			continue;
+
+		if(job->key.pagenum == key->pagenum &&
+			job->key.zoom == key->zoom &&
+			job->key.rotation == key->rotation &&
+			job->key.x == key->x &&
+			job->key.y == key->y &&
+			job->key.width == key->width &&
+			job->key.height == key->height &&
+			job->key.quality == key->quality)
+		{
+			return(job);
+		}
+	}
+	return(NULL);
+}
+
+static void free_job(fz_context *ctx, struct render_job *job)
+{
+	fz_drop_display_list(ctx, job->list);
+	fz_drop_pixmap(ctx, job->pixmap);
+	free(job);
+}
+
+static void free_job_list(fz_context *ctx, struct render_job_list *list)
+{
+	struct render_job *job;
+	while((job = job_list_pop(list)) != NULL)
+		free_job(ctx, job);
+}
+
+static int queue_index(const render_data_t *key, int priority)
+{
+	return(priority * 2 + (key->quality == RENDER_QUALITY_PREVIEW ? 0 : 1));
+}
+
+/* the pool must be locked */
+static struct render_job *next_job(struct render_pool *pool)
+{
+	size_t i;
+	for(i = 0; i < RENDER_POOL_QUEUES; i++) {
+		struct render_job *job = job_list_pop(&pool->queued[i]);
+		if(job != NULL)
+			return(job);
+	}
+	return(NULL);
+}
+
+static void *worker_main(void *arg)
+{
+	struct render_worker *worker = arg;
+	struct render_pool *pool = worker->pool;
+	fz_context *ctx = worker->ctx;
+
+	pthread_mutex_lock(&pool->lock);
+	while(!pool->quit) {
+		struct render_job *job = next_job(pool);
+		if(job == NULL) {
+			pthread_cond_wait(&pool->wakeup, &pool->lock);
+			continue;
+		}
+		job_list_append(&pool->running, job);
+		pthread_mutex_unlock(&pool->lock);
+
+		/* render_draw_list() cuts the tile, so don't touch the key */
+		render_data_t data = job->key;
+		fz_pixmap *pixmap = NULL;
+		fz_var(pixmap);
+		fz_try(ctx) {
+			pixmap = render_draw_list(ctx, job->list, &job->bounds, &data, 
+				&job->cookie);
+		} fz_catch(ctx) {
+			fz_warn(ctx, "cannot render page %d", job->key.pagenum + 1);
+			pixmap = NULL;
+		}
+
+		fz_drop_display_list(ctx, job->list);
+		job->list = NULL;
+		job->pixmap = pixmap;
+
+		pthread_mutex_lock(&pool->lock);
+		job_list_remove(&pool->running, job);
+		if(job->generation != pool->generation || job->pixmap == NULL || 
+			job->cookie.abort)
+		{
+			free_job(ctx, job);
+			continue;
+		}
+		job_list_append(&pool->done, job);
+
+		render_ready_fn notify = pool->notify;
+		void *notify_data = pool->notify_data;
+		int pagenum = job->key.pagenum;
+		pthread_mutex_unlock(&pool->lock);
+
+		if(notify != NULL)
+			notify(pagenum, notify_data);
+
+		pthread_mutex_lock(&pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return(NULL);
+}
+
+int render_pool_default_threads(void)
+{
+	/* leave one cpu for the ui */
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+	if(cpus < 1)
+		return(1);
+	if(cpus > RENDER_POOL_MAX_THREADS)
+		return(RENDER_POOL_MAX_THREADS);
+	return((int) cpus);
+}
+
+struct render_pool *render_pool_new(fz_context *ctx, int threads)
+{
+	struct render_pool *pool = calloc(1, sizeof(struct render_pool));
+	pool->ctx = ctx;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->wakeup, NULL);
+
+	pool->workers = calloc(threads, sizeof(struct render_worker));
+	int i;
+	for(i = 0; i < threads; i++) {
+		struct render_worker *worker = &pool->workers[pool->workers_count];
+		worker->pool = pool;
+
+		/* this fails if the context has been created without locks */
+		if((worker->ctx = fz_clone_context(ctx)) == NULL) {
+			fprintf(stderr, "fz_clone_context() failed\n");
+			break;
+		}
+		if(pthread_create(&worker->thread, NULL, worker_main, worker) != 0) {
+			fz_drop_context(worker->ctx);
+			break;
+		}
+		pool->workers_count++;
+	}
+
+	if(pool->workers_count == 0) {
+		render_pool_delete(pool);
+		return(NULL);
+	}
+
+	return(pool);
+}
+
+void render_pool_delete(struct render_pool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = 1;
+	pool->notify = NULL;
+	pthread_cond_broadcast(&pool->wakeup);
+	pthread_mutex_unlock(&pool->lock);
+
+	int i;
+	for(i = 0; i < pool->workers_count; i++) {
+		pthread_join(pool->workers[i].thread, NULL);
+		fz_drop_context(pool->workers[i].ctx);
+	}
+	free(pool->workers);
+
+	for(i = 0; i < RENDER_POOL_QUEUES; i++)
+		free_job_list(pool->ctx, &pool->queued[i]);
+	free_job_list(pool->ctx, &pool->done);
+
+	pthread_cond_destroy(&pool->wakeup);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool);
+}
+
+void render_pool_set_notify(struct render_pool *pool,
+	render_ready_fn notify, void *user_data)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->notify = notify;
+	pool->notify_data = user_data;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+int render_pool_is_queued(struct render_pool *pool,
+	const render_data_t *data, int priority)
+{
+	if(priority < 0 || priority >= RENDER_PRIORITY_COUNT)
+		priority = RENDER_PRIORITY_COUNT - 1;
+
+	pthread_mutex_lock(&pool->lock);
+
+	int found = (job_list_find(pool, &pool->running, data) != NULL);
+
+	size_t i;
+	for(i = 0; i < RENDER_POOL_QUEUES && !found; i++) {
+		struct render_job *job = job_list_find(pool, &pool->queued[i], data);
+		if(job != NULL) {
+			found = 1;
+			if(job->priority > priority) { // a lower value is more urgent
+				job_list_remove(&pool->queued[i], job);
+				job->priority = priority;
+				job_list_append(&pool->queued[queue_index(data, priority)], job);
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&pool->lock);
+	return(found);
+}
+
+void render_pool_queue(struct render_pool *pool, const render_data_t *data,
+	fz_display_list *list, const fz_rect *bounds, int priority)
+{
+	if(priority < 0 || priority >= RENDER_PRIORITY_COUNT)
+		priority = RENDER_PRIORITY_COUNT - 1;
+
+	struct render_job *job = calloc(1, sizeof(struct render_job));
+	job->key = *data;
+	job->key.samples = NULL;
+	job->key.pixmap = NULL;
+	job->list = fz_keep_display_list(pool->ctx, list);
+	job->bounds = *bounds;
+	job->priority = priority;
+
+	pthread_mutex_lock(&pool->lock);
+	job->generation = pool->generation;
+	job_list_append(&pool->queued[queue_index(data, priority)], job);
+	pthread_cond_signal(&pool->wakeup);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void render_pool_cancel_queued(struct render_pool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	size_t i;
+	for(i = 0; i < RENDER_POOL_QUEUES; i++)
+		free_job_list(pool->ctx, &pool->queued[i]);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static int is_outside(struct render_job *job, int first, int last)
+{
+	return(job->key.pagenum < first || job->key.pagenum > last);
+}
+
+void render_pool_cancel_outside(struct render_pool *pool, int first, int last)
+{
+	pthread_mutex_lock(&pool->lock);
+
+	size_t i;
+	for(i = 0; i < RENDER_POOL_QUEUES; i++) {
+		struct render_job_list keep = { NULL, NULL };
+		struct render_job *job;
+		while((job = job_list_pop(&pool->queued[i])) != NULL) {
+			if(is_outside(job, first, last))
+				free_job(pool->ctx, job);
+			else
+				job_list_append(&keep, job);
+		}
+		pool->queued[i] = keep;
+	}
+
+	/* the worker drops the result itself */
+	struct render_job *job;
+	for(job = pool->running.head; job != NULL; job = job->next) {
+		if(is_outside(job, first, last))
+			job->cookie.abort = 1;
+	}
+
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void render_pool_invalidate(struct render_pool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->generation++;
+	size_t i;
+	for(i = 0; i < RENDER_POOL_QUEUES; i++)
+		free_job_list(pool->ctx, &pool->queued[i]);
+	free_job_list(pool->ctx, &pool->done);
+
+	/* their results would be dropped anyway */
+	struct render_job *job;
+	for(job = pool->running.head; job != NULL; job = job->next)
+		job->cookie.abort = 1;
+
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void render_pool_collect(struct render_pool *pool, struct render_cache *cache)
+{
+	/* take the whole list, so that the cache is not filled while the pool
+	   is locked */
+	pthread_mutex_lock(&pool->lock);
+	struct render_job_list done = pool->done;
+	pool->done.head = pool->done.tail = NULL;
+	pthread_mutex_unlock(&pool->lock);
+
+	struct render_job *job;
+	while((job = job_list_pop(&done)) != NULL) {
+		render_cache_insert(cache, &job->key, job->pixmap);
+		free_job(pool->ctx, job);
+	}
+}
@@ -0,0 +1,75 @@
+/*
+  render-pool.h - render pages in background threads
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JUGGLER_RENDER_POOL_H_
+#define _JUGGLER_RENDER_POOL_H_
+
+#include <mupdf/fitz.h>
+
+#include "render.h"
+#include "render-cache.h"
+
+/* MuPDF does not allow to use a document from more than one thread, so the
+   pool never touches the document: the ui-thread records a page into a
+   display list and the workers only rasterize those lists with their own
+   clone of the context. Finished pixmaps are kept until the ui-thread
+   collects them into the render-cache. */
+
+struct render_pool;
+
+/* returns NULL if not even one worker could be started */
+extern struct render_pool *render_pool_new(fz_context *ctx, int threads);
+
+/* waits until all workers have finished their current job */
+extern void render_pool_delete(struct render_pool *pool);
+
+/* the number of workers if nobody says something else */
+extern int render_pool_default_threads(void);
+
+/* called from a worker after a job has been finished, so don't do more
+   than scheduling something for the ui-thread in there */
+extern void render_pool_set_notify(struct render_pool *pool,
+	render_ready_fn notify, void *user_data);
+
+/* returns 1 if a job with the key of data is already waiting or running, if
+   it is waiting with a lower priority, it gets the new one */
+extern int render_pool_is_queued(struct render_pool *pool,
+	const render_data_t *data, int priority);
+
+/* the pool takes its own reference to list, bounds are the unscaled bounds
+   of the page */
+extern void render_pool_queue(struct render_pool *pool, const render_data_t *data,
+	fz_display_list *list, const fz_rect *bounds, int priority);
+
+/* forget all jobs that have not yet been started */
+extern void render_pool_cancel_queued(struct render_pool *pool);
+
+/* forgets the waiting jobs of all pages before first or after last and 
+   aborts the running ones */
+extern void render_pool_cancel_outside(struct render_pool *pool, 
+	int first, int last);
+
+/* the page numbers have changed: forget everything that has not yet been
+   started and drop the results of all running or finished jobs */
+extern void render_pool_invalidate(struct render_pool *pool);
+
+/* must be called from the ui-thread, puts all finished pixmaps into cache */
+extern void render_pool_collect(struct render_pool *pool,
+	struct render_cache *cache);
+
+#endif /* _JUGGLER_RENDER_POOL_H_ */
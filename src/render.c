@@ -19,127 +19,430 @@
 #include "render.h"
 
 #include "internal.h"
+#include "render-pool.h"
+#include "list-cache.h"
+#include "page-geometry.h"
+#include "page-attrs.h"
+#include "deferred-streams.h"
 
 /* parts of this function have been copied from MuPDF */
+static void measure_page(fz_context *ctx, const page_attrs_t *attrs, 
+	int *width, int *height)
+{
+	fz_rect mediabox, cropbox;
+
+	float userunit = attrs->user_unit;
+
+	pdf_to_rect(ctx, attrs->media_box, &mediabox);
+	if(fz_is_empty_rect(&mediabox))
+	{
+		//fz_warn(ctx, "cannot find page size for page %d", number + 1);
+		mediabox.x0 = 0;
+		mediabox.y0 = 0;
+		mediabox.x1 = 612;
+		mediabox.y1 = 792;
+	}
+
+	pdf_to_rect(ctx, attrs->crop_box, &cropbox);
+	if(!fz_is_empty_rect(&cropbox))
+		fz_intersect_rect(&mediabox, &cropbox);
+
+	*width = fz_max(mediabox.x0, mediabox.x1) * userunit - fz_min(mediabox.x0, mediabox.x1) * userunit;
+	*height = fz_max(mediabox.y0, mediabox.y1) * userunit - fz_min(mediabox.y0, mediabox.y1) * userunit;
+
+	if(attrs->rotate == 90 || attrs->rotate == 270) {
+		int real_height = *width;
+		*width = *height;
+		*height = real_height;
+	}
+}
+
 ErrorCode get_all_pages_size(juggler_t *juggler)
 {
-	pdf_document *doc = juggler->pdf;
-	fz_context *ctx = juggler->ctx;
+	page_geometry_reset(juggler->geometry, juggler->pagecount);
 
-	int pagecount = juggler->pagecount;
-	juggler->sizes = malloc(sizeof(page_size) * pagecount);
+	return(juggler_update_page_sizes(juggler, 0, juggler->pagecount));
+}
 
-	int i, currentX = 0;
-	for(i = 0; i < pagecount; i++) {
-		pdf_obj *pageobj = pdf_lookup_page_obj(ctx, doc, i);
-		fz_rect mediabox, cropbox;
+ErrorCode juggler_update_page_sizes(juggler_t *juggler, int index, int count)
+{
+	if(index < 0 || index + count > page_geometry_count(juggler->geometry))
+		return(ERROR_INVALID_RANGE);
 
-		float userunit;
-		pdf_obj *obj = pdf_dict_gets(ctx, pageobj, "UserUnit");
-		if (pdf_is_real(ctx, obj))
-			userunit = pdf_to_real(ctx, obj);
-		else
-			userunit = 1;
+	page_attrs_t *attrs = malloc(sizeof(page_attrs_t) * count);
+	ErrorCode result = juggler_resolve_page_attrs(juggler->ctx, juggler->pdf, 
+		index, count, attrs);
 
-		pdf_to_rect(ctx, juggler_lookup_inherited_page_item(ctx, doc, pageobj, 
-			"MediaBox"), &mediabox);
-		if(fz_is_empty_rect(&mediabox))
-		{
-			//fz_warn(ctx, "cannot find page size for page %d", number + 1);
-			mediabox.x0 = 0;
-			mediabox.y0 = 0;
-			mediabox.x1 = 612;
-			mediabox.y1 = 792;
+	int i;
+	for(i = 0; i < count && result == NoError; i++) {
+		int width, height;
+		measure_page(juggler->ctx, &attrs[i], &width, &height);
+		page_geometry_set_size(juggler->geometry, index + i, width, height);
+	}
+
+	free(attrs);
+	return(result);
+}
+
+ErrorCode juggler_estimate_page_sizes(juggler_t *juggler)
+{
+	/* all pages get the size of the first one, so nothing but that page 
+	   needs to be looked at */
+	int width = 0, height = 0;
+	page_attrs_t first;
+	if(juggler->pagecount > 0 && juggler_resolve_page_attrs(juggler->ctx, 
+		juggler->pdf, 0, 1, &first) == NoError)
+	{
+		measure_page(juggler->ctx, &first, &width, &height);
+	}
+
+	page_geometry_set_estimate(juggler->geometry, width, height);
+	page_geometry_reset(juggler->geometry, juggler->pagecount);
+	if(juggler->pagecount > 0)
+		page_geometry_set_size(juggler->geometry, 0, width, height);
+
+	return(NoError);
+}
+
+ErrorCode juggler_ensure_page_sizes(juggler_t *juggler, int index, int count, 
+	int *measured)
+{
+	*measured = 0;
+
+	if(index < 0)
+		index = 0;
+	if(index + count > juggler->pagecount)
+		count = juggler->pagecount - index;
+
+	/* measure each run of inexact pages with one walk */
+	int i = index;
+	while(i < index + count) {
+		if(page_geometry_is_exact(juggler->geometry, i)) {
+			i++;
+			continue;
 		}
 
-		pdf_to_rect(ctx, juggler_lookup_inherited_page_item(ctx, doc, pageobj, 
-            "CropBox"), &cropbox);
-		if(!fz_is_empty_rect(&cropbox))
-			fz_intersect_rect(&mediabox, &cropbox);
-
-		juggler->sizes[i].x = currentX;
-		juggler->sizes[i].width = fz_max(mediabox.x0, mediabox.x1) * userunit - fz_min(mediabox.x0, mediabox.x1) * userunit;
-		juggler->sizes[i].height = fz_max(mediabox.y0, mediabox.y1) * userunit - fz_min(mediabox.y0, mediabox.y1) * userunit;
-
-		int rotate = pdf_to_int(ctx, 
-			juggler_lookup_inherited_page_item(ctx, doc, pageobj, "Rotate"));
-		if(rotate == 90 || rotate == 270) {
-			int real_height = juggler->sizes[i].width;
-			juggler->sizes[i].width = juggler->sizes[i].height;
-			juggler->sizes[i].height = real_height;
+		int run = 1;
+		while(i + run < index + count && 
+			!page_geometry_is_exact(juggler->geometry, i + run))
+		{
+			run++;
 		}
 
-		currentX += juggler->sizes[i].height + 10;
+		ErrorCode result = juggler_update_page_sizes(juggler, i, run);
+		if(result != NoError)
+			return(result);
+
+		*measured += run;
+		i += run;
 	}
-	
+
 	return(NoError);
 }
 
-render_data_t *is_already_rendered(juggler_t *juggler, render_data_t *needle)
+ErrorCode juggler_refine_page_sizes(juggler_t *juggler, int max_pages, 
+	int *remaining)
 {
-	size_t i;
-	for(i = 0; i < RENDER_BUFFER_COUNT; i++) {
-		if(juggler->rendered[i].samples != NULL &&
-		   //juggler->rendered[i].x == needle->x &&
-		   //juggler->rendered[i].y == needle->y &&
-		   //juggler->rendered[i].width == needle->width &&
-		   //juggler->rendered[i].height == needle->height &&
-		   juggler->rendered[i].pagenum == needle->pagenum &&
-		   juggler->rendered[i].zoom == needle->zoom)
-			return(&juggler->rendered[i]);
+	int first = page_geometry_first_inexact(juggler->geometry);
+	if(first >= 0) {
+		int measured;
+		ErrorCode result = 
+			juggler_ensure_page_sizes(juggler, first, max_pages, &measured);
+		if(result != NoError)
+			return(result);
 	}
-	return(NULL);
+
+	*remaining = (page_geometry_first_inexact(juggler->geometry) >= 0);
+
+	return(NoError);
 }
 
-ErrorCode render_page(juggler_t *juggler, render_data_t *data)
+int juggler_get_page_x(juggler_t *juggler, int index)
+{
+	return(page_geometry_get_position(juggler->geometry, index));
+}
+
+int juggler_get_page_width(juggler_t *juggler, int index)
+{
+	return(page_geometry_get_width(juggler->geometry, index));
+}
+
+int juggler_get_page_height(juggler_t *juggler, int index)
+{
+	return(page_geometry_get_height(juggler->geometry, index));
+}
+
+double juggler_get_page_offset(juggler_t *juggler, int index, double zoom)
+{
+	return(page_geometry_get_offset(juggler->geometry, index, zoom));
+}
+
+double juggler_get_pages_extent(juggler_t *juggler, double zoom)
+{
+	return(page_geometry_get_extent(juggler->geometry, zoom));
+}
+
+int juggler_find_page(juggler_t *juggler, double offset, double zoom)
+{
+	return(page_geometry_find(juggler->geometry, offset, zoom));
+}
+
+static void set_rendered_data(render_data_t *data, fz_pixmap *pix)
+{
+	data->pixmap = pix;
+	data->samples = pix->samples;
+	/* x and y stay as they are, tiles only get cut at the right and the 
+	   bottom edge of a page */
+	data->width = pix->w;
+	data->height = pix->h;
+}
+
+/* cuts the requested part out of the bbox of the whole page, returns 0 if 
+   nothing of the page remains */
+static int get_tile_bbox(render_data_t *data, fz_irect *bbox)
+{
+	if(data->width == 0 && data->height == 0) // the whole page
+		return(1);
+
+	if(data->x < 0 || data->y < 0)
+		return(0);
+
+	fz_irect tile;
+	tile.x0 = bbox->x0 + data->x;
+	tile.y0 = bbox->y0 + data->y;
+	tile.x1 = tile.x0 + data->width;
+	tile.y1 = tile.y0 + data->height;
+	fz_intersect_irect(bbox, &tile);
+
+	return(!fz_is_empty_irect(bbox));
+}
+
+/* records the page into a display list, so that it can be rasterized 
+   without the document (e. g. in another thread); the list is recorded only 
+   once and replayed for all zooms and tiles until the page changes */
+static fz_display_list *load_page_list(juggler_t *juggler, int pagenum, 
+	fz_rect *bounds)
 {
-	pdf_document *doc = juggler->pdf;
 	fz_context *ctx = juggler->ctx;
 
-	render_data_t *rendered;
-	if((rendered = is_already_rendered(juggler, data)) != NULL) {
-		*data = *rendered;
-		return(NoError);
-	}
+	fz_display_list *cached = list_cache_lookup(juggler->lists, pagenum, bounds);
+	if(cached != NULL)
+		return(cached);
+
+	/* imported images and fonts may not have been copied yet */
+	if(juggler_flush_page_streams(juggler, pagenum) != NoError)
+		fz_warn(ctx, "page %d misses some of its imported streams", pagenum);
+
+	pdf_page *page = pdf_load_page(ctx, juggler->pdf, pagenum);
+	pdf_bound_page(ctx, page, bounds);
+
+	fz_display_list *list = fz_new_display_list(ctx);
+	fz_device *dev = fz_new_list_device(ctx, list);
+	pdf_run_page(ctx, page, dev, &fz_identity, NULL);
+	fz_drop_device(ctx, dev);
+
+	pdf_drop_page(ctx, page);
 
-	pdf_page *page = pdf_load_page(ctx, doc, data->pagenum);
+	list_cache_insert(juggler->lists, pagenum, list, bounds);
 
-	int rotation = 0;
+	return(list);
+}
 
+fz_pixmap *render_draw_list(fz_context *ctx, fz_display_list *list, 
+	const fz_rect *page_bounds, render_data_t *data, fz_cookie *cookie)
+{
 	fz_matrix transform;
-	fz_rotate(&transform, rotation);
+	fz_rotate(&transform, data->rotation);
 	fz_pre_scale(&transform, data->zoom, data->zoom);
 
-	fz_rect bounds;
-	pdf_bound_page(ctx, page, &bounds);
+	fz_rect bounds = *page_bounds;
 	fz_transform_rect(&bounds, &transform);
 
+	/* only rasterize the requested tile, the pixmap clips everything else */
 	fz_irect bbox;
 	fz_round_rect(&bbox, &bounds);
+	if(!get_tile_bbox(data, &bbox))
+		return(NULL);
+
 	fz_pixmap *pix = fz_new_pixmap_with_bbox(ctx, fz_device_bgr(ctx), &bbox);
 	fz_clear_pixmap_with_value(ctx, pix, 0xff);
 
-	fz_device *dev = fz_new_draw_device(ctx, pix);
-	pdf_run_page(ctx, page, dev, &transform, NULL);
-	fz_drop_device(ctx, dev);
+	fz_rect area;
+	fz_rect_from_irect(&area, &bbox);
 
-	data->samples = pix->samples;
-	data->width = pix->w;
-	data->height = pix->h;
-	data->x = 0;
-	data->y = 0;
+	/* the level belongs to the context, so it has to be restored */
+	int aa_level = fz_aa_level(ctx);
+	if(data->quality == RENDER_QUALITY_PREVIEW)
+		fz_set_aa_level(ctx, 0);
 
-	pdf_drop_page(ctx, page);
+	fz_device *dev = NULL;
+	fz_var(dev);
+	fz_try(ctx) {
+		dev = fz_new_draw_device(ctx, pix);
+		fz_run_display_list(ctx, list, dev, &transform, &area, cookie);
+	} fz_always(ctx) {
+		fz_drop_device(ctx, dev);
+		fz_set_aa_level(ctx, aa_level);
+	} fz_catch(ctx) {
+		fz_drop_pixmap(ctx, pix);
+		fz_rethrow(ctx);
+	}
+
+	return(pix);
+}
+
+/* requests for the whole page all share one key */
+static void normalize_request(render_data_t *data)
+{
+	if(data->width <= 0 || data->height <= 0)
+		data->x = data->y = data->width = data->height = 0;
+}
+
+ErrorCode render_page(juggler_t *juggler, render_data_t *data, 
+	fz_cookie *cookie)
+{
+	fz_context *ctx = juggler->ctx;
+
+	normalize_request(data);
+
+	fz_pixmap *pix;
+	if((pix = render_cache_lookup(juggler->cache, data)) != NULL) {
+		set_rendered_data(data, pix);
+		return(NoError);
+	}
+
+	/* the key is what has been requested, so keep it before data gets 
+	   overwritten */
+	render_data_t key = *data;
+
+	fz_rect bounds;
+	fz_display_list *list = NULL;
+	fz_var(list);
+	pix = NULL;
+	fz_var(pix);
+	fz_try(ctx) {
+		list = load_page_list(juggler, data->pagenum, &bounds);
+		pix = render_draw_list(ctx, list, &bounds, data, cookie);
+	} fz_always(ctx) {
+		fz_drop_display_list(ctx, list);
+	} fz_catch(ctx) {
+		fz_warn(ctx, "cannot render page %d", key.pagenum + 1);
+		*data = key;
+		return(ErrorRenderFailed);
+	}
+
+	if(pix == NULL)
+		return(ERROR_INVALID_RANGE);
+	if(cookie != NULL && cookie->abort) { // it's incomplete, so forget it
+		fz_drop_pixmap(ctx, pix);
+		*data = key;
+		return(ErrorRenderCancelled);
+	}
+
+	render_cache_insert(juggler->cache, &key, pix);
+	set_rendered_data(data, pix);
+
+	return(NoError);
+}
+
+static void queue_render(juggler_t *juggler, const render_data_t *data, 
+	int priority)
+{
+	if(render_pool_is_queued(juggler->pool, data, priority))
+		return;
+
+	fz_rect bounds;
+	fz_display_list *list = load_page_list(juggler, data->pagenum, &bounds);
+	render_pool_queue(juggler->pool, data, list, &bounds, priority);
+	fz_drop_display_list(juggler->ctx, list);
+}
+
+ErrorCode render_page_async(juggler_t *juggler, render_data_t *data, int priority)
+{
+	if(juggler->pool == NULL) {
+		juggler->pool = 
+			render_pool_new(juggler->ctx, render_pool_default_threads());
+		if(juggler->pool == NULL) // there are no threads, do it now
+			return(render_page(juggler, data, NULL));
+		render_pool_set_notify(juggler->pool, 
+			juggler->render_notify, juggler->render_notify_data);
+	}
+
+	render_pool_collect(juggler->pool, juggler->cache);
+
+	normalize_request(data);
+
+	fz_pixmap *pix;
+	if((pix = render_cache_lookup(juggler->cache, data)) != NULL) {
+		set_rendered_data(data, pix);
+		return(NoError);
+	}
+
+	/* only pages the user is looking at are worth a preview */
+	render_data_t preview = *data;
+	preview.quality = RENDER_QUALITY_PREVIEW;
+	int wants_preview = (data->quality == RENDER_QUALITY_FULL && 
+		priority == RENDER_PRIORITY_VISIBLE);
+	if(wants_preview && (pix = render_cache_lookup(juggler->cache, &preview)) != NULL) {
+		queue_render(juggler, data, priority);
+		set_rendered_data(data, pix);
+		return(ErrorRenderPreview);
+	}
+
+	/* the preview is queued first, so that it's started first */
+	if(wants_preview)
+		queue_render(juggler, &preview, priority);
+	queue_render(juggler, data, priority);
+
+	return(ErrorRenderPending);
+}
+
+ErrorCode juggler_set_render_notify(juggler_t *juggler, 
+	render_ready_fn notify, void *user_data)
+{
+	juggler->render_notify = notify;
+	juggler->render_notify_data = user_data;
+	if(juggler->pool != NULL)
+		render_pool_set_notify(juggler->pool, notify, user_data);
+
+	return(NoError);
+}
+
+ErrorCode juggler_cancel_queued_renders(juggler_t *juggler)
+{
+	if(juggler->pool != NULL)
+		render_pool_cancel_queued(juggler->pool);
+
+	return(NoError);
+}
+
+ErrorCode juggler_cancel_renders_outside(juggler_t *juggler, int first, int last)
+{
+	if(juggler->pool != NULL)
+		render_pool_cancel_outside(juggler->pool, first, last);
 
 	return(NoError);
 }
 
 void free_rendered_data(juggler_t *juggler, render_data_t *data)
 {
-	juggler->recent_rendered = (juggler->recent_rendered + 1) % RENDER_BUFFER_COUNT;
+	/* the cache holds its own reference, if it is still there */
+	fz_drop_pixmap(juggler->ctx, data->pixmap);
+	data->pixmap = NULL;
+	data->samples = NULL;
+}
+
+ErrorCode juggler_set_render_cache_budget(juggler_t *juggler, size_t budget)
+{
+	render_cache_set_budget(juggler->cache, budget);
+
+	return(NoError);
+}
 
-	if(juggler->rendered[juggler->recent_rendered].samples != NULL)
-		fz_drop_pixmap(juggler->ctx, juggler->rendered[juggler->recent_rendered].pixmap);
+ErrorCode juggler_get_render_cache_stats(juggler_t *juggler, 
+	render_cache_stats_t *stats)
+{
+	render_cache_get_stats(juggler->cache, stats);
 
-	juggler->rendered[juggler->recent_rendered] = *data;
+	return(NoError);
 }
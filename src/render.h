@@ -21,26 +21,116 @@
 
 #include <mupdf/fitz.h>
 
+/* the edge length of the tiles the gui requests from render_page() */
+#define RENDER_TILE_SIZE 256
+
+/* x, y, width and height select the part of the page (in pixels at the 
+   given zoom, relative to the page's upper left corner) that is rendered;
+   a width or height of 0 requests the whole page. quality is one of 
+   RENDER_QUALITY_* */
 typedef struct
 {
 	unsigned char *samples;
 	fz_pixmap *pixmap;
 	double zoom;
 	int pagenum;
+	int rotation;
 	int x;
 	int y;
 	int width;
 	int height;
+	int quality;
 } render_data_t;
 
-typedef struct
-{
-	int x;
-	int width;
-	int height;
-} page_size;
+/* a preview has the same size as the real render but is drawn without
+   anti-aliasing, which is a lot faster for complex pages */
+#define RENDER_QUALITY_FULL 0
+#define RENDER_QUALITY_PREVIEW 1
+
+/* the priorities of render_page_async(), a lower value is more urgent */
+#define RENDER_PRIORITY_VISIBLE 0
+#define RENDER_PRIORITY_NEIGHBOUR 1
+#define RENDER_PRIORITY_COUNT 2
+
+/* will be called from another thread if a page has been rendered in the
+   background */
+typedef void (*render_ready_fn)(int pagenum, void *user_data);
 
 #include "document.h"
+#include "render-cache.h"
+
+/* measures all pages again */
+extern ErrorCode get_all_pages_size(juggler_t *juggler);
+
+/* only measures the pages index to index + count - 1 */
+extern ErrorCode juggler_update_page_sizes(juggler_t *juggler, 
+	int index, int count);
+
+/* gives all pages the size of the first one without looking at them, the
+   real sizes are filled in later by the two functions below */
+extern ErrorCode juggler_estimate_page_sizes(juggler_t *juggler);
+
+/* measures those pages of the range that have only an estimated size, 
+   measured tells how many pages got their real size */
+extern ErrorCode juggler_ensure_page_sizes(juggler_t *juggler, int index, 
+	int count, int *measured);
+
+/* measures up to max_pages pages with estimated sizes, remaining is 0 if all
+   pages have their real size afterwards */
+extern ErrorCode juggler_refine_page_sizes(juggler_t *juggler, int max_pages, 
+	int *remaining);
+
+/* the size of a page as it is shown (so rotation is applied) and its 
+   position from the top of the first page; -1 if index is invalid */
+extern int juggler_get_page_x(juggler_t *juggler, int index);
+
+extern int juggler_get_page_width(juggler_t *juggler, int index);
+
+extern int juggler_get_page_height(juggler_t *juggler, int index);
+
+/* the same for a zoomed view: heights are scaled, but the gaps between the 
+   pages are not; -1 if index is invalid */
+extern double juggler_get_page_offset(juggler_t *juggler, int index, 
+	double zoom);
+
+/* the height of all pages with their gaps */
+extern double juggler_get_pages_extent(juggler_t *juggler, double zoom);
+
+/* the page shown at offset (measured like juggler_get_page_offset()), 
+   -1 if there are no pages */
+extern int juggler_find_page(juggler_t *juggler, double offset, double zoom);
+
+/* renders the page or takes it from the cache, call free_rendered_data()
+   if you don't need the samples any longer; cookie may be NULL, if it is
+   aborted from another thread ErrorRenderCancelled is returned */
+extern ErrorCode render_page(juggler_t *juggler, render_data_t *data, 
+	fz_cookie *cookie);
+
+/* like render_page() but never waits for MuPDF: if the requested part is not
+   in the cache, it is rendered by a background thread and 
+   ErrorRenderPending is returned; the notify-callback tells when it's done.
+   Visible full quality requests get a preview first, as long as only that 
+   one is ready, it is returned with ErrorRenderPreview */
+extern ErrorCode render_page_async(juggler_t *juggler, render_data_t *data, 
+	int priority);
+
+extern ErrorCode juggler_set_render_notify(juggler_t *juggler, 
+	render_ready_fn notify, void *user_data);
+
+/* forget all requests of render_page_async() that have not yet been started */
+extern ErrorCode juggler_cancel_queued_renders(juggler_t *juggler);
+
+/* forget and abort all background renders of pages before first or after 
+   last, e. g. because they have been scrolled out of view */
+extern ErrorCode juggler_cancel_renders_outside(juggler_t *juggler, 
+	int first, int last);
+
+extern void free_rendered_data(juggler_t *juggler, render_data_t *data);
+
+/* how many bytes of rendered pages are kept for reuse */
+extern ErrorCode juggler_set_render_cache_budget(juggler_t *juggler, size_t budget);
 
+extern ErrorCode juggler_get_render_cache_stats(juggler_t *juggler,
+	render_cache_stats_t *stats);
 
 #endif /* _JUGGLER_RENDER_H_ */
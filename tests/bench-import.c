@@ -0,0 +1,115 @@
+/*
+  bench-import.c - time imports with and without reader threads
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "document.h"
+#include "page-add.h"
+
+/* imports all pages of a file into a copy of itself with 0, 1, 2, 4 and 8 
+   reader threads; the first round of each opens the readers, the others 
+   find them in the cache. All rounds must create the same objects */
+
+static double now(void)
+{
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return(time.tv_sec + time.tv_nsec / 1e9);
+}
+
+/* returns the seconds of the import, and how many objects dest has then */
+static double import_once(fz_context *ctx, char *filename, int threads, 
+	int *objects, copy_dedup_stats_t *stats)
+{
+	juggler_t *dest, *src;
+	if(juggler_open(ctx, filename, &dest) != NoError || 
+		juggler_open(ctx, filename, &src) != NoError)
+	{
+		fprintf(stderr, "cannot open %s\n", filename);
+		exit(1);
+	}
+	juggler_set_import_threads(dest, threads);
+
+	double start = now();
+	ErrorCode result = juggler_add_pages_from_file(dest, src, dest->pagecount);
+	double seconds = now() - start;
+	if(result != NoError) {
+		fprintf(stderr, "import failed: %d\n", result);
+		exit(1);
+	}
+
+	*objects = pdf_xref_len(ctx, dest->pdf);
+	juggler_get_import_stats(dest, stats);
+
+	juggler_close(src);
+	juggler_close(dest);
+	return(seconds);
+}
+
+int main(int argc, char **argv)
+{
+	if(argc < 2) {
+		fprintf(stderr, "usage: %s file.pdf [rounds]\n", argv[0]);
+		return(1);
+	}
+	int rounds = (argc > 2 ? atoi(argv[2]) : 5);
+	if(rounds < 2)
+		rounds = 2;
+
+	fz_context *ctx;
+	if(juggler_init(&ctx) != NoError)
+		return(1);
+
+	static const int threads[] = { 0, 1, 2, 4, 8 };
+	int expected_objects = -1;
+
+	printf("threads  first [s]   best [s]   objects read  seeks\n");
+	size_t i;
+	for(i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+		double first = 0, best = 0;
+		copy_dedup_stats_t stats;
+
+		int round;
+		for(round = 0; round < rounds; round++) {
+			int objects;
+			double seconds = 
+				import_once(ctx, argv[1], threads[i], &objects, &stats);
+
+			if(expected_objects < 0)
+				expected_objects = objects;
+			if(objects != expected_objects) {
+				fprintf(stderr, "%d threads created %d objects instead of %d\n",
+					threads[i], objects, expected_objects);
+				return(1);
+			}
+
+			if(round == 0)
+				first = seconds;
+			else if(round == 1 || seconds < best)
+				best = seconds;
+		}
+
+		printf("%7d  %9.4f  %9.4f  %12zu  %5zu\n", threads[i], first, best, 
+			stats.objects_read, stats.seeks);
+	}
+
+	fz_drop_context(ctx);
+	return(0);
+}
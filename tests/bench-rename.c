@@ -0,0 +1,162 @@
+/*
+  bench-rename.c - how fast content streams are renamed
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "document.h"
+#include "content-scan.h"
+#include "rename-table.h"
+
+/* renames a generated content stream of text, paths, strings and inline 
+   images with every backend and prints the throughput in MB/s */
+
+#define BENCH_DEFAULT_MB 40
+
+/* every this many operators an inline image of this size is added */
+#define BENCH_IMAGE_EVERY 64
+#define BENCH_IMAGE_BYTES 4096
+
+static double now(void)
+{
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return(time.tv_sec + time.tv_nsec / 1e9);
+}
+
+static void append(fz_context *ctx, fz_buffer *buffer, const char *text, size_t len)
+{
+	while(buffer->cap - buffer->len < (int) len)
+		fz_resize_buffer(ctx, buffer, buffer->cap * 2);
+	memcpy(buffer->data + buffer->len, text, len);
+	buffer->len += len;
+}
+
+static fz_buffer *generate_content(fz_context *ctx, size_t size)
+{
+	static const char *operators[] = {
+		"BT /F1 12 Tf 72 700 Td (Hello /F1 \\(world\\) \\223) Tj ET\n", 
+		"q 1 0 0 1 20.5 30 cm /Im0 Do Q\n", 
+		"/GS1 gs 0.5 g 10 20 m 30 40 l 50 60 70 80 90 100 c S\n", 
+		"BT /F2 9 Tf [<48656c6c6f> -250 (again)] TJ ET\n", 
+		"/OC <</MCID 3 /Props [/GS1 1]>> BDC 0 0 100 100 re f EMC\n", 
+	};
+	size_t operators_count = sizeof(operators) / sizeof(operators[0]);
+
+	char image[BENCH_IMAGE_BYTES];
+	char header[64];
+	int header_len = snprintf(header, sizeof(header), 
+		"BI /W 64 /H 64 /BPC 8 /CS /G /L %d ID ", BENCH_IMAGE_BYTES);
+
+	fz_buffer *buffer = fz_new_buffer(ctx, size + 64 * 1024);
+	unsigned int seed = 1;
+	size_t i;
+	for(i = 0; (size_t) buffer->len < size; i++) {
+		const char *op = operators[i % operators_count];
+		append(ctx, buffer, op, strlen(op));
+
+		if(i % BENCH_IMAGE_EVERY == BENCH_IMAGE_EVERY - 1) {
+			size_t j;
+			for(j = 0; j < BENCH_IMAGE_BYTES; j++) {
+				seed = seed * 1103515245 + 12345;
+				image[j] = seed >> 16;
+			}
+			append(ctx, buffer, header, header_len);
+			append(ctx, buffer, image, BENCH_IMAGE_BYTES);
+			append(ctx, buffer, "\nEI\n", 4);
+		}
+	}
+
+	return(buffer);
+}
+
+/* returns the seconds of one rename */
+static double rename_once(fz_context *ctx, fz_buffer *content, 
+	const struct rename_table *renames)
+{
+	fz_buffer *result = fz_new_buffer(ctx, content->len + 1024);
+	fz_output *output = fz_new_output_with_buffer(ctx, result);
+	fz_stream *input = fz_open_buffer(ctx, content);
+
+	double start = now();
+	content_scan_rename_res(ctx, input, ctx, output, renames);
+	double seconds = now() - start;
+
+	fz_drop_stream(ctx, input);
+	fz_drop_output(ctx, output);
+	fz_drop_buffer(ctx, result);
+	return(seconds);
+}
+
+int main(int argc, char **argv)
+{
+	int megabytes = (argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_MB);
+	int rounds = (argc > 2 ? atoi(argv[2]) : 3);
+	if(megabytes <= 0 || rounds <= 0) {
+		fprintf(stderr, "usage: %s [megabytes] [rounds]\n", argv[0]);
+		return(1);
+	}
+
+	fz_context *ctx;
+	if(juggler_init(&ctx) != NoError)
+		return(1);
+
+	struct rename_table *renames = rename_table_new(4);
+	rename_table_add(renames, "F1", "R1");
+	rename_table_add(renames, "F2", "R2");
+	rename_table_add(renames, "Im0", "Im7");
+	rename_table_add(renames, "GS1", "G2");
+	rename_table_add(renames, "OC", "OC");
+
+	fz_buffer *content = generate_content(ctx, (size_t) megabytes << 20);
+	double size = content->len / (1024.0 * 1024.0);
+
+	static const struct {
+		int backend;
+		const char *name;
+	} backends[] = {
+		{ CONTENT_SCAN_FLEX, "flex" }, 
+		{ CONTENT_SCAN_SCALAR, "scalar" }, 
+		{ CONTENT_SCAN_SSE2, "sse2" }, 
+		{ CONTENT_SCAN_AVX2, "avx2" }, 
+	};
+
+	size_t i;
+	for(i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+		/* the cpu may not have it */
+		if(content_scan_set_backend(backends[i].backend) != backends[i].backend)
+			continue;
+
+		double best = 0;
+		int round;
+		for(round = 0; round < rounds; round++) {
+			double seconds = rename_once(ctx, content, renames);
+			if(round == 0 || seconds < best)
+				best = seconds;
+		}
+		printf("%-6s  %8.1f MB/s  (%.1f MB in %.3f s)\n", backends[i].name, 
+			size / best, size, best);
+	}
+
+	fz_drop_buffer(ctx, content);
+	rename_table_delete(renames);
+	fz_drop_context(ctx);
+	return(0);
+}
@@ -0,0 +1,377 @@
+/*
+  test-content-scan.c - the tokenizers must rename like the flex lexer
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "document.h"
+#include "content-scan.h"
+#include "rename-table.h"
+
+/* renames the same content streams with the flex lexer and with every
+   tokenizer the cpu supports and compares the results byte for byte: some
+   fixed cases and many generated ones */
+
+#define GENERATED_STREAMS 2000
+#define GENERATED_TOKENS 60
+
+struct scan_case
+{
+	const char *name;
+	const char *input;
+	size_t len;
+};
+
+#define SCAN_CASE(name, input) { name, input, sizeof(input) - 1 }
+
+static const struct scan_case cases[] = {
+	SCAN_CASE("inline image with computed length", 
+		"q BI /W 4 /H 2 /BPC 8 /CS /G ID \x00/F1 EI\xff\nEI Q /Im0 Do\n"),
+	SCAN_CASE("inline image with /L", 
+		"BI /W 9 /H 9 /BPC 8 /CS /RGB /F /DCT /L 6 ID \x01 EI \x02\nEI /GS1 gs\n"),
+	SCAN_CASE("inline image with a wrong /L", 
+		"BI /F /AHx /L 2 ID 0a1b /F1 2c\nEI /F1 Tf\n"),
+	SCAN_CASE("inline image without length", 
+		"BI /W 4 /H 2 /BPC 8 /CS /G /F /AHx ID /F1EIx (/Im0 EI\n/F1 Tf\n"),
+	SCAN_CASE("inline image with a decode array", 
+		"BI /W 2 /H 2 /BPC 8 /CS /CMYK /D [1 0 1 0 1 0 1 0] ID 0123456789abcdef\nEI\n"),
+	SCAN_CASE("nested dicts", 
+		"/OC <</A <</B <</C /F1>> /D [/Im0 <</E /GS1>>]>> /G [[/F1] 2]>> BDC EMC\n"),
+	SCAN_CASE("dict values", 
+		"/OC <</N null /T true /F false /I -12 /R .5 /S (/F1) /H <2F46>>> BDC EMC\n"),
+	SCAN_CASE("names inside strings", 
+		"BT (/F1 (/Im0) \\(/GS1) Tj [(/F1) -20 <2F4631>] TJ ET /F1 Tf\n"),
+	SCAN_CASE("escapes in strings", 
+		"(\\) /F1 \\\\) Tj (\\053\\7/Im0\r\n\\\n/GS1) Tj /GS1 gs\n"),
+	SCAN_CASE("BI as part of other tokens", 
+		"/BI Do /ABIC Do /F1BI Tf (BI) Tj <4249> Tj BT ET /OC <</BI /BIG /K [/BI]>> BDC EMC\n"),
+	SCAN_CASE("names next to delimiters", 
+		"[/F1/Im0]TJ(/F1)Tj/GS1<4142>Tj<</A/F1>>BDC EMC\n"),
+};
+
+/* all names of the cases and of the generator, so nothing is reported as
+   missing */
+static const char *names[] = {
+	"F1", "Im0", "GS1", "OC", "BI", "ABIC", "F1BI", "BIG", "P", "Span", 
+};
+
+static struct rename_table *new_renames(void)
+{
+	struct rename_table *renames = rename_table_new(16);
+	size_t i;
+	for(i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		char new_name[32];
+		snprintf(new_name, sizeof(new_name), "R%zu", i);
+		rename_table_add(renames, names[i], new_name);
+	}
+	return(renames);
+}
+
+static fz_buffer *rename_text(fz_context *ctx, const char *text, size_t len, 
+	const struct rename_table *renames)
+{
+	fz_buffer *buffer = fz_new_buffer(ctx, len + 64);
+	fz_output *output = fz_new_output_with_buffer(ctx, buffer);
+	fz_stream *input = fz_open_memory(ctx, (unsigned char *) text, len);
+
+	content_scan_rename_res(ctx, input, ctx, output, renames);
+
+	fz_drop_stream(ctx, input);
+	fz_drop_output(ctx, output);
+	return(buffer);
+}
+
+/* generated content streams */
+
+struct generator
+{
+	unsigned int state;
+	char *text;
+	size_t len;
+	size_t cap;
+};
+
+static unsigned int next_random(struct generator *gen)
+{
+	/* xorshift, the same streams on every run */
+	gen->state ^= gen->state << 13;
+	gen->state ^= gen->state >> 17;
+	gen->state ^= gen->state << 5;
+	return(gen->state);
+}
+
+static void put(struct generator *gen, const char *text, size_t len)
+{
+	if(gen->len + len > gen->cap) {
+		gen->cap = (gen->len + len) * 2;
+		gen->text = realloc(gen->text, gen->cap);
+	}
+	memcpy(gen->text + gen->len, text, len);
+	gen->len += len;
+}
+
+static void put_string(struct generator *gen, const char *text)
+{
+	put(gen, text, strlen(text));
+}
+
+static void put_choice(struct generator *gen, const char **choices, size_t count)
+{
+	put_string(gen, choices[next_random(gen) % count]);
+}
+
+#define PUT_CHOICE(gen, choices) \
+	put_choice(gen, choices, sizeof(choices) / sizeof(choices[0]))
+
+static void put_white(struct generator *gen)
+{
+	static const char *whites[] = { " ", " ", "\n", "\r\n", "\t", "  " };
+	PUT_CHOICE(gen, whites);
+}
+
+static void put_name(struct generator *gen)
+{
+	put_string(gen, "/");
+	PUT_CHOICE(gen, names);
+}
+
+static void put_literal_string(struct generator *gen)
+{
+	static const char *parts[] = { 
+		"abc", "/F1", "/BI", " ", "\\(", "\\)", "\\\\", "\\n", "\\053", 
+		"(nested /Im0)", "\r\n", "BI", "<<", ">", "%", "EI", "\\\n", 
+	};
+	put_string(gen, "(");
+	int count = next_random(gen) % 5;
+	while(count-- > 0)
+		PUT_CHOICE(gen, parts);
+	put_string(gen, ")");
+}
+
+static void put_hex_string(struct generator *gen)
+{
+	static const char *hex_strings[] = { "<>", "<2F4631>", "<42 49\n>", "<a0B1c>" };
+	PUT_CHOICE(gen, hex_strings);
+}
+
+static void put_value(struct generator *gen, int depth);
+
+static void put_array(struct generator *gen, int depth)
+{
+	put_string(gen, "[");
+	int count = next_random(gen) % 4;
+	while(count-- > 0) {
+		put_value(gen, depth + 1);
+		put_white(gen);
+	}
+	put_string(gen, "]");
+}
+
+static void put_dict(struct generator *gen, int depth)
+{
+	static const char *keys[] = { "/A", "/BI", "/MCID", "/Props", "/K" };
+	put_string(gen, "<<");
+	int count = next_random(gen) % 4;
+	while(count-- > 0) {
+		PUT_CHOICE(gen, keys);
+		put_white(gen);
+		put_value(gen, depth + 1);
+		put_white(gen);
+	}
+	put_string(gen, ">>");
+}
+
+static void put_value(struct generator *gen, int depth)
+{
+	static const char *simple[] = { "0", "-12", "3.25", ".5", "true", "null" };
+
+	/* arrays and dicts only down to a few levels */
+	switch(next_random(gen) % (depth < 3 ? 6 : 4)) {
+	case 0:
+		put_name(gen);
+		break;
+	case 1:
+		PUT_CHOICE(gen, simple);
+		break;
+	case 2:
+		put_literal_string(gen);
+		break;
+	case 3:
+		put_hex_string(gen);
+		break;
+	case 4:
+		put_array(gen, depth);
+		break;
+	default:
+		put_dict(gen, depth);
+		break;
+	}
+}
+
+static void put_inline_image(struct generator *gen)
+{
+	char text[128];
+	int i;
+
+	switch(next_random(gen) % 3) {
+	case 0: {
+		/* the length is computed, the data is anything */
+		int width = 1 + next_random(gen) % 8, height = next_random(gen) % 4;
+		snprintf(text, sizeof(text), "BI /W %d /H %d /BPC 8 /CS /RGB ID ", 
+			width, height);
+		put_string(gen, text);
+		for(i = 0; i < width * height * 3; i++) {
+			char byte = next_random(gen);
+			put(gen, &byte, 1);
+		}
+		break;
+	}
+	case 1: {
+		/* the length is given, the data contains EI */
+		int length = 1 + next_random(gen) % 16;
+		snprintf(text, sizeof(text), "BI /W 99 /H 99 /CS /G /F /DCT /L %d ID ", 
+			length);
+		put_string(gen, text);
+		for(i = 0; i < length; i++)
+			put_string(gen, (i % 4 == 1 ? "E" : i % 4 == 2 ? "I" : " "));
+		break;
+	}
+	default:
+		/* EI has to be searched, the data has no whitespace in front of EI */
+		put_string(gen, "BI /W 4 /H 4 /BPC 8 /CS /G /F /AHx ID ");
+		for(i = 1 + next_random(gen) % 12; i > 0; i--)
+			put_string(gen, (next_random(gen) % 4 == 0 ? "EI" : "0f"));
+		break;
+	}
+	put_string(gen, "\nEI");
+}
+
+static void put_token(struct generator *gen)
+{
+	static const char *operators[] = { 
+		"q", "Q", "BT", "ET", "Tf", "Tj", "TJ", "Do", "gs", "cm", "re", "f", 
+		"BDC", "BMC", "EMC", "B", "B*", "BX", "EX", "m", "l", "S", 
+	};
+
+	switch(next_random(gen) % 8) {
+	case 0:
+	case 1:
+		put_name(gen);
+		break;
+	case 2:
+		put_literal_string(gen);
+		break;
+	case 3:
+		put_hex_string(gen);
+		break;
+	case 4:
+		put_dict(gen, 0);
+		break;
+	case 5:
+		put_inline_image(gen);
+		break;
+	default:
+		PUT_CHOICE(gen, operators);
+		break;
+	}
+}
+
+static void generate(struct generator *gen, unsigned int seed)
+{
+	gen->state = seed * 2654435761u + 1;
+	gen->len = 0;
+
+	int i;
+	for(i = 0; i < GENERATED_TOKENS; i++) {
+		put_token(gen);
+		put_white(gen);
+	}
+}
+
+/* compares the tokenizers with the flex lexer, returns 0 if any differs */
+static int check_stream(fz_context *ctx, const char *name, const char *text, 
+	size_t len, const struct rename_table *renames)
+{
+	static const int backends[] = { 
+		CONTENT_SCAN_SCALAR, CONTENT_SCAN_SSE2, CONTENT_SCAN_AVX2, 
+	};
+	static const char *backend_names[] = { "scalar", "sse2", "avx2" };
+
+	content_scan_set_backend(CONTENT_SCAN_FLEX);
+	fz_buffer *expected = rename_text(ctx, text, len, renames);
+
+	int passed = 1;
+	size_t i;
+	for(i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+		/* the cpu may not have it */
+		if(content_scan_set_backend(backends[i]) != backends[i])
+			continue;
+
+		fz_buffer *result = rename_text(ctx, text, len, renames);
+		int at = 0;
+		while(at < expected->len && at < result->len && 
+			expected->data[at] == result->data[at])
+		{
+			at++;
+		}
+		if(at < expected->len || at < result->len) {
+			fprintf(stderr, "FAIL %s: %s differs from flex at byte %d\n", 
+				name, backend_names[i], at);
+			passed = 0;
+		}
+		fz_drop_buffer(ctx, result);
+	}
+
+	fz_drop_buffer(ctx, expected);
+	return(passed);
+}
+
+int main(int argc, char **argv)
+{
+	fz_context *ctx;
+	if(juggler_init(&ctx) != NoError)
+		return(1);
+
+	struct rename_table *renames = new_renames();
+	size_t failed = 0;
+
+	size_t i;
+	for(i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		if(!check_stream(ctx, cases[i].name, cases[i].input, cases[i].len, renames))
+			failed++;
+	}
+
+	struct generator gen = { 0, NULL, 0, 0 };
+	unsigned int seed;
+	for(seed = 1; seed <= GENERATED_STREAMS; seed++) {
+		char name[32];
+		snprintf(name, sizeof(name), "generated stream %u", seed);
+
+		generate(&gen, seed);
+		if(!check_stream(ctx, name, gen.text, gen.len, renames))
+			failed++;
+	}
+	free(gen.text);
+
+	size_t total = sizeof(cases) / sizeof(cases[0]) + GENERATED_STREAMS;
+	printf("test-content-scan: %zu of %zu streams passed\n", total - failed, total);
+
+	rename_table_delete(renames);
+	fz_drop_context(ctx);
+	return(failed > 0);
+}
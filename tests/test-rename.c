@@ -0,0 +1,138 @@
+/*
+  test-rename.c - compare renamed content streams byte for byte
+  Copyright (C) 2015 Stefan Klein
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "document.h"
+#include "rename-lexer.h"
+#include "rename-table.h"
+
+/* everything that is not a name outside of strings and inline images must
+   come out of rename_res_in_content_stream() unchanged */
+
+struct rename_case
+{
+	const char *name;
+	const char *input;
+	size_t input_len;
+	const char *expected;
+	size_t expected_len;
+};
+
+/* the data may contain \0, so the lengths come from the literals */
+#define RENAME_CASE(name, input, expected) \
+	{ name, input, sizeof(input) - 1, expected, sizeof(expected) - 1 }
+
+static const struct rename_case cases[] = {
+	RENAME_CASE("names", 
+		"q /F1 12 Tf /Im0 Do /GS1 gs Q\n", 
+		"q /R1 12 Tf /Im7 Do /G2 gs Q\n"),
+	RENAME_CASE("unknown names are kept", 
+		"/Missing Do\n", 
+		"/Missing Do\n"),
+	RENAME_CASE("literal strings", 
+		"BT /F1 1 Tf (/F1 \\(/Im0\\) (nested /GS1) \\\\) Tj ET\n", 
+		"BT /R1 1 Tf (/F1 \\(/Im0\\) (nested /GS1) \\\\) Tj ET\n"),
+	RENAME_CASE("literal strings over lines", 
+		"(a\\053/F1\r\n/Im0\\\nb\\7) Tj /F1 Tf\n", 
+		"(a\\053/F1\r\n/Im0\\\nb\\7) Tj /R1 Tf\n"),
+	RENAME_CASE("hex strings", 
+		"<2F4631 2f49\n6d30>Tj <>Tj /F1 Tf\n", 
+		"<2F4631 2f49\n6d30>Tj <>Tj /R1 Tf\n"),
+	RENAME_CASE("dicts", 
+		"/OC <</Key /F1 /Arr [/Im0 1] /Str (/GS1) /Hex <2F> /Sub <</In /GS1>>>> BDC EMC\n", 
+		"/OC <</Key /R1 /Arr [/Im7 1] /Str (/GS1) /Hex <2F> /Sub <</In /G2>>>> BDC EMC\n"),
+	RENAME_CASE("inline image with computed length", 
+		"q BI /W 4 /H 2 /BPC 8 /CS /G ID \x00/F1 EI\xff\nEI Q /Im0 Do\n", 
+		"q BI /W 4 /H 2 /BPC 8 /CS /G ID \x00/F1 EI\xff\nEI Q /Im7 Do\n"),
+	RENAME_CASE("inline image with /L", 
+		"BI /W 9 /H 9 /BPC 8 /CS /RGB /F /DCT /L 6 ID \x01 EI \x02\nEI /GS1 gs\n", 
+		"BI /W 9 /H 9 /BPC 8 /CS /RGB /F /DCT /L 6 ID \x01 EI \x02\nEI /G2 gs\n"),
+	RENAME_CASE("inline image without length", 
+		"BI /W 4 /H 2 /BPC 8 /CS /G /F /AHx ID /F1EIx (/Im0 EI\n/F1 Tf\n", 
+		"BI /W 4 /H 2 /BPC 8 /CS /G /F /AHx ID /F1EIx (/Im0 EI\n/R1 Tf\n"),
+};
+
+static struct rename_table *new_renames(void)
+{
+	struct rename_table *renames = rename_table_new(4);
+	rename_table_add(renames, "F1", "R1");
+	rename_table_add(renames, "Im0", "Im7");
+	rename_table_add(renames, "GS1", "G2");
+	rename_table_add(renames, "OC", "OC"); // a tag, but it's a name, too
+	return(renames);
+}
+
+static fz_buffer *rename_text(fz_context *ctx, const char *text, size_t len, 
+	const struct rename_table *renames)
+{
+	fz_buffer *buffer = fz_new_buffer(ctx, len + 64);
+	fz_output *output = fz_new_output_with_buffer(ctx, buffer);
+	fz_stream *input = fz_open_memory(ctx, (unsigned char *) text, len);
+
+	rename_res_in_content_stream(ctx, input, ctx, output, renames);
+
+	fz_drop_stream(ctx, input);
+	fz_drop_output(ctx, output);
+	return(buffer);
+}
+
+/* prints where the output differs first */
+static int check_case(fz_context *ctx, const struct rename_case *test, 
+	const struct rename_table *renames)
+{
+	fz_buffer *buffer = rename_text(ctx, test->input, test->input_len, renames);
+
+	size_t i = 0;
+	while(i < test->expected_len && i < (size_t) buffer->len && 
+		buffer->data[i] == (unsigned char) test->expected[i])
+	{
+		i++;
+	}
+	int passed = (i == test->expected_len && i == (size_t) buffer->len);
+	if(!passed) {
+		fprintf(stderr, "FAIL %s: differs at byte %zu (%d bytes instead of %zu)\n", 
+			test->name, i, buffer->len, test->expected_len);
+	}
+
+	fz_drop_buffer(ctx, buffer);
+	return(passed);
+}
+
+int main(int argc, char **argv)
+{
+	fz_context *ctx;
+	if(juggler_init(&ctx) != NoError)
+		return(1);
+
+	struct rename_table *renames = new_renames();
+
+	size_t failed = 0;
+	size_t i;
+	for(i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		if(!check_case(ctx, &cases[i], renames))
+			failed++;
+	}
+	printf("test-rename: %zu of %zu cases passed\n", 
+		sizeof(cases) / sizeof(cases[0]) - failed, sizeof(cases) / sizeof(cases[0]));
+
+	rename_table_delete(renames);
+	fz_drop_context(ctx);
+	return(failed > 0);
+}